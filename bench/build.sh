@@ -0,0 +1,18 @@
+#!/bin/bash
+
+echo "[INFO] Building benchmarks..."
+
+# Script'in bulunduğu dizinin bir üstüne git (project/)
+cd "$(dirname "$0")/.."
+
+# main.c hariç tüm interpreter kaynakları
+SOURCES=$(find src -type f -name "*.c" ! -path "src/main.c")
+
+gcc -O2 bench/lexer_bench.c $SOURCES -Isrc -o bench/lexer_bench -pthread -lcurl -lm -ldl
+
+if [ $? -eq 0 ]; then
+    echo -e "\033[0;32m[SUCCESS]\033[0m bench/lexer_bench created successfully."
+else
+    echo -e "\033[0;31m[ERROR]\033[0m Benchmark compilation failed."
+    exit 1
+fi
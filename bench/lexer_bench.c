@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/interpreter.h"
+#include "lexer/lexer.h"
+
+static const char *block_template =
+    "// helper %d: mixes every token class the lexer knows about\n"
+    "fn helper%d(alpha, beta) {\n"
+    "    total = alpha * 2 + beta - 7 %% 3;\n"
+    "    ratio = 3.14159 / (beta + 1);\n"
+    "    if (total >= 10 && ratio != 0) {\n"
+    "        out(\"value of helper %d is \\\"big\\\"\" + total);\n"
+    "    } : {\n"
+    "        rn total - 1;\n"
+    "    };\n"
+    "    for (i = 0; i < total; i++) {\n"
+    "        items[i] = array(4);\n"
+    "    };\n"
+    "    while (beta <= -3) { break; };\n"
+    "    rn total;\n"
+    "};\n\n";
+
+static char *generate_source(size_t target_bytes) {
+    size_t cap = target_bytes + 1024;
+    char *buf = (char*)malloc(cap);
+    size_t len = 0;
+    int n = 0;
+
+    while (len < target_bytes) {
+        int written = snprintf(buf + len, cap - len, block_template, n, n, n);
+        if (written < 0 || (size_t)written >= cap - len) break;
+        len += (size_t)written;
+        n++;
+    }
+
+    buf[len] = '\0';
+    return buf;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = (argc > 1) ? (size_t)atoi(argv[1]) : 16;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 5;
+    if (megabytes == 0) megabytes = 1;
+    if (iterations <= 0) iterations = 1;
+
+    char *source = generate_source(megabytes * 1024 * 1024);
+    size_t source_len = strlen(source);
+
+    init_interpreter();
+    set_source_code(source);
+
+    double best = 0;
+    int token_total = 0;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_seconds();
+        init_lexer();
+        double elapsed = now_seconds() - start;
+        token_total = lexer_token_count();
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("source:     %.1f MB, %d tokens\n", source_len / (1024.0 * 1024.0), token_total);
+    printf("best of %d: %.3f ms\n", iterations, best * 1000.0);
+    printf("throughput: %.1f MB/s, %.1f Mtokens/s\n",
+           source_len / (1024.0 * 1024.0) / best, token_total / 1e6 / best);
+
+    free_lexer();
+    free(source);
+    return 0;
+}
@@ -13,8 +13,25 @@ if [ -z "$SOURCES" ]; then
     exit 1
 fi
 
+# ./build.sh lib: gömülebilir kütüphane (libnac.a + libnac.so, main.c hariç)
+if [ "$1" = "lib" ]; then
+    LIB_SOURCES=$(echo "$SOURCES" | grep -v "^src/main.c$")
+    mkdir -p build/lib
+    rm -f build/lib/*.o
+    for f in $LIB_SOURCES; do
+        gcc -c -O2 -fPIC -pthread -Isrc "$f" -o "build/lib/$(echo "$f" | tr '/' '_' | sed 's/\.c$/.o/')" || {
+            echo -e "\033[0;31m[ERROR]\033[0m Compilation failed."
+            exit 1
+        }
+    done
+    ar rcs libnac.a build/lib/*.o
+    gcc -shared -o libnac.so build/lib/*.o -pthread -lcurl -lm -ldl
+    echo -e "\033[0;32m[SUCCESS]\033[0m libnac.a and libnac.so created successfully."
+    exit 0
+fi
+
 # Derle (çıktı project/ içine)
-gcc $SOURCES -Isrc -o nac -lcurl -lm
+gcc $SOURCES -Isrc -o nac -rdynamic -pthread -lcurl -lm -ldl
 
 if [ $? -eq 0 ]; then
     echo -e "\033[0;32m[SUCCESS]\033[0m nac binary created successfully."
@@ -22,4 +39,14 @@ if [ $? -eq 0 ]; then
 else
     echo -e "\033[0;31m[ERROR]\033[0m Compilation failed."
     exit 1
+fi
+
+# nac --serve istemcisi
+gcc tools/nac_client.c src/server/protocol.c -Isrc -o nac-client
+
+if [ $? -eq 0 ]; then
+    echo -e "\033[0;32m[SUCCESS]\033[0m nac-client binary created successfully."
+else
+    echo -e "\033[0;31m[ERROR]\033[0m Compilation failed."
+    exit 1
 fi
\ No newline at end of file
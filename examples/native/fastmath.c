@@ -0,0 +1,49 @@
+// Example native extension.
+//
+// gcc -shared -fPIC -Isrc examples/native/fastmath.c -o examples/native/fastmath.so
+// ./nac examples/native/fastmath.nac
+
+#include "nac_ext.h"
+
+static double number(Value v) {
+    if (v.type == TYPE_INT) return v.int_val;
+    if (v.type == TYPE_FLOAT) return v.float_val;
+    return 0;
+}
+
+// dot(a, b): dot product of two numeric arrays
+static Value dot(Value *args, int arg_count) {
+    (void)arg_count;
+    if (args[0].type != TYPE_ARRAY || args[1].type != TYPE_ARRAY ||
+        args[0].array_val.size != args[1].array_val.size) {
+        report_error("dot() requires 2 arrays of equal length");
+        return make_float(0);
+    }
+
+    double sum = 0;
+    for (int i = 0; i < args[0].array_val.size; i++) {
+        sum += number(args[0].array_val.elements[i]) * number(args[1].array_val.elements[i]);
+    }
+    return make_float(sum);
+}
+
+// sumTo(n): 0 + 1 + ... + n - 1
+static Value sum_to(Value *args, int arg_count) {
+    (void)arg_count;
+    long long n = (long long)number(args[0]);
+    long long sum = 0;
+    for (long long i = 0; i < n; i++) {
+        sum += i;
+    }
+    return make_float((double)sum);
+}
+
+int nac_extension_init(NacRegisterFn register_fn, int abi_version) {
+    if (abi_version != NAC_EXT_ABI_VERSION) {
+        return 1;
+    }
+
+    register_fn("dot", 2, dot);
+    register_fn("sumTo", 1, sum_to);
+    return 0;
+}
@@ -3,9 +3,9 @@
 
 #include <stdbool.h>
 
+#include "dispatch.h"
 #include "../runtime/value.h"
 
-bool is_builtin_function(const char *name);
-Value call_builtin_function(const char *name, Value *args, int arg_count);
+Value call_builtin_function(BuiltinId id, const char *name, Value *args, int arg_count);
 
 #endif
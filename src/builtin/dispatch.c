@@ -0,0 +1,264 @@
+#include "dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "builtin.h"
+#include "extended_builtin.h"
+#include "../core/interpreter.h"
+#include "../util/error.h"
+
+static const NativeDef builtin_defs[] = {
+    {"sqrt", -1, NATIVE_CORE, BUILTIN_SQRT, NULL, true},
+    {"pow", -1, NATIVE_CORE, BUILTIN_POW, NULL, true},
+    {"sin", -1, NATIVE_CORE, BUILTIN_SIN, NULL, true},
+    {"cos", -1, NATIVE_CORE, BUILTIN_COS, NULL, true},
+    {"tan", -1, NATIVE_CORE, BUILTIN_TAN, NULL, true},
+    {"abs", -1, NATIVE_CORE, BUILTIN_ABS, NULL, true},
+    {"floor", -1, NATIVE_CORE, BUILTIN_FLOOR, NULL, true},
+    {"ceil", -1, NATIVE_CORE, BUILTIN_CEIL, NULL, true},
+    {"round", -1, NATIVE_CORE, BUILTIN_ROUND, NULL, true},
+    {"log", -1, NATIVE_CORE, BUILTIN_LOG, NULL, true},
+    {"exp", -1, NATIVE_CORE, BUILTIN_EXP, NULL, true},
+    {"length", -1, NATIVE_CORE, BUILTIN_LENGTH, NULL, true},
+    {"upper", -1, NATIVE_CORE, BUILTIN_UPPER, NULL, true},
+    {"lower", -1, NATIVE_CORE, BUILTIN_LOWER, NULL, true},
+    {"push", -1, NATIVE_CORE, BUILTIN_PUSH, NULL, true},
+    {"pop", -1, NATIVE_CORE, BUILTIN_POP, NULL, true},
+    {"trim", -1, NATIVE_CORE, BUILTIN_TRIM, NULL, true},
+    {"replace", -1, NATIVE_CORE, BUILTIN_REPLACE, NULL, true},
+    {"substr", -1, NATIVE_CORE, BUILTIN_SUBSTR, NULL, true},
+    {"indexOf", -1, NATIVE_CORE, BUILTIN_INDEX_OF, NULL, true},
+    {"first", -1, NATIVE_CORE, BUILTIN_FIRST, NULL, true},
+    {"last", -1, NATIVE_CORE, BUILTIN_LAST, NULL, true},
+    {"reverse", -1, NATIVE_CORE, BUILTIN_REVERSE, NULL, true},
+    {"slice", -1, NATIVE_CORE, BUILTIN_SLICE, NULL, true},
+    {"join", -1, NATIVE_CORE, BUILTIN_JOIN, NULL, true},
+    {"read", -1, NATIVE_CORE, BUILTIN_READ, NULL, true},
+    {"write", -1, NATIVE_CORE, BUILTIN_WRITE, NULL, true},
+    {"append", -1, NATIVE_CORE, BUILTIN_APPEND, NULL, true},
+    {"map", -1, NATIVE_CORE, BUILTIN_MAP, NULL, true},
+    {"time", -1, NATIVE_CORE, BUILTIN_TIME, NULL, false},
+
+    {"jsonParse", -1, NATIVE_EXTENDED, BUILTIN_JSON_PARSE, NULL, true},
+    {"jsonStringify", -1, NATIVE_EXTENDED, BUILTIN_JSON_STRINGIFY, NULL, true},
+    {"httpRequest", -1, NATIVE_EXTENDED, BUILTIN_HTTP_REQUEST, NULL, true},
+    {"httpJson", -1, NATIVE_EXTENDED, BUILTIN_HTTP_JSON, NULL, true},
+    {"httpBatch", -1, NATIVE_EXTENDED, BUILTIN_HTTP_BATCH, NULL, false},
+    {"httpDownload", -1, NATIVE_EXTENDED, BUILTIN_HTTP_DOWNLOAD, NULL, false},
+    {"httpStream", -1, NATIVE_EXTENDED, BUILTIN_HTTP_STREAM, NULL, false},
+    {"httpCache", -1, NATIVE_EXTENDED, BUILTIN_HTTP_CACHE, NULL, false},
+    {"httpCacheStats", -1, NATIVE_EXTENDED, BUILTIN_HTTP_CACHE_STATS, NULL, false},
+    {"httpTimeout", -1, NATIVE_EXTENDED, BUILTIN_HTTP_TIMEOUT, NULL, false},
+    {"httpHedge", -1, NATIVE_EXTENDED, BUILTIN_HTTP_HEDGE, NULL, false},
+    {"httpStats", -1, NATIVE_EXTENDED, BUILTIN_HTTP_STATS, NULL, false},
+    {"moduleLoad", -1, NATIVE_EXTENDED, BUILTIN_MODULE_LOAD, NULL, true},
+    {"moduleRegister", -1, NATIVE_EXTENDED, BUILTIN_MODULE_REGISTER, NULL, true},
+    {"moduleGet", -1, NATIVE_EXTENDED, BUILTIN_MODULE_GET, NULL, true},
+    {"moduleRequire", -1, NATIVE_EXTENDED, BUILTIN_MODULE_REQUIRE, NULL, true},
+    {"moduleNames", -1, NATIVE_EXTENDED, BUILTIN_MODULE_NAMES, NULL, true},
+    {"moduleLoadNative", -1, NATIVE_EXTENDED, BUILTIN_MODULE_LOAD_NATIVE, NULL, false},
+    {"memoryStats", -1, NATIVE_EXTENDED, BUILTIN_MEMORY_STATS, NULL, false},
+    {"args", -1, NATIVE_EXTENDED, BUILTIN_ARGS, NULL, false},
+    {"parallelMap", -1, NATIVE_EXTENDED, BUILTIN_PARALLEL_MAP, NULL, false},
+    {"parallelReduce", -1, NATIVE_EXTENDED, BUILTIN_PARALLEL_REDUCE, NULL, false},
+    {"spawn", -1, NATIVE_EXTENDED, BUILTIN_SPAWN, NULL, false},
+    {"joinTask", -1, NATIVE_EXTENDED, BUILTIN_JOIN_TASK, NULL, false},
+    {"channel", -1, NATIVE_EXTENDED, BUILTIN_CHANNEL, NULL, false},
+    {"send", -1, NATIVE_EXTENDED, BUILTIN_SEND, NULL, false},
+    {"recv", -1, NATIVE_EXTENDED, BUILTIN_RECV, NULL, false},
+    {"trySend", -1, NATIVE_EXTENDED, BUILTIN_TRY_SEND, NULL, false},
+    {"tryRecv", -1, NATIVE_EXTENDED, BUILTIN_TRY_RECV, NULL, false},
+    {"close", -1, NATIVE_EXTENDED, BUILTIN_CLOSE, NULL, false},
+    {"sharedMap", -1, NATIVE_EXTENDED, BUILTIN_SHARED_MAP, NULL, false},
+    {"sharedSet", -1, NATIVE_EXTENDED, BUILTIN_SHARED_SET, NULL, false},
+    {"sharedGet", -1, NATIVE_EXTENDED, BUILTIN_SHARED_GET, NULL, false},
+    {"sharedAdd", -1, NATIVE_EXTENDED, BUILTIN_SHARED_ADD, NULL, false},
+    {"sharedSnapshot", -1, NATIVE_EXTENDED, BUILTIN_SHARED_SNAPSHOT, NULL, false},
+    {"counter", -1, NATIVE_EXTENDED, BUILTIN_COUNTER, NULL, false},
+    {"increment", -1, NATIVE_EXTENDED, BUILTIN_INCREMENT, NULL, false},
+    {"counterAdd", -1, NATIVE_EXTENDED, BUILTIN_COUNTER_ADD, NULL, false},
+    {"counterGet", -1, NATIVE_EXTENDED, BUILTIN_COUNTER_GET, NULL, false},
+    {"setTimeout", -1, NATIVE_EXTENDED, BUILTIN_SET_TIMEOUT, NULL, false},
+    {"setInterval", -1, NATIVE_EXTENDED, BUILTIN_SET_INTERVAL, NULL, false},
+    {"clearTimer", -1, NATIVE_EXTENDED, BUILTIN_CLEAR_TIMER, NULL, false},
+    {"onLine", -1, NATIVE_EXTENDED, BUILTIN_ON_LINE, NULL, false},
+    {"httpAsync", -1, NATIVE_EXTENDED, BUILTIN_HTTP_ASYNC, NULL, false},
+    {"runLoop", -1, NATIVE_EXTENDED, BUILTIN_RUN_LOOP, NULL, false},
+    {"httpRequestAsync", -1, NATIVE_EXTENDED, BUILTIN_HTTP_REQUEST_ASYNC, NULL, false},
+    {"readAsync", -1, NATIVE_EXTENDED, BUILTIN_READ_ASYNC, NULL, false},
+    {"delay", -1, NATIVE_EXTENDED, BUILTIN_DELAY, NULL, false},
+    {"all", -1, NATIVE_EXTENDED, BUILTIN_ALL, NULL, false},
+    {"readFiles", -1, NATIVE_EXTENDED, BUILTIN_READ_FILES, NULL, false},
+    {"writeFiles", -1, NATIVE_EXTENDED, BUILTIN_WRITE_FILES, NULL, false},
+    {"appendFiles", -1, NATIVE_EXTENDED, BUILTIN_APPEND_FILES, NULL, false},
+    {"forkMap", -1, NATIVE_EXTENDED, BUILTIN_FORK_MAP, NULL, false},
+    {"readLines", -1, NATIVE_EXTENDED, BUILTIN_READ_LINES, NULL, false},
+    {"next", -1, NATIVE_EXTENDED, BUILTIN_NEXT, NULL, false},
+    {"closeGenerator", -1, NATIVE_EXTENDED, BUILTIN_CLOSE_GENERATOR, NULL, false}
+};
+
+static unsigned long name_hash(const char *s) {
+    unsigned long h = 1469598103UL;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619UL;
+    }
+    return h;
+}
+
+static int find_slot(const NativeTable *table, const char *name) {
+    int mask = table->capacity - 1;
+    int slot = (int)(name_hash(name) & (unsigned long)mask);
+    while (table->slots[slot] && strcmp(table->slots[slot]->name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void table_insert(NativeTable *table, const NativeDef *def) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        const NativeDef **old = table->slots;
+        int old_capacity = table->capacity;
+
+        table->capacity *= 2;
+        table->slots = (const NativeDef**)calloc(table->capacity, sizeof(NativeDef*));
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i]) {
+                table->slots[find_slot(table, old[i]->name)] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    int slot = find_slot(table, def->name);
+    if (!table->slots[slot]) {
+        table->count++;
+    }
+    table->slots[slot] = def;
+}
+
+void native_table_init(NativeTable *table) {
+    table->capacity = 128;
+    table->count = 0;
+    table->slots = (const NativeDef**)calloc(table->capacity, sizeof(NativeDef*));
+
+    int count = sizeof(builtin_defs) / sizeof(builtin_defs[0]);
+    for (int i = 0; i < count; i++) {
+        table_insert(table, &builtin_defs[i]);
+    }
+}
+
+void native_table_free(NativeTable *table) {
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void native_table_add(NativeTable *table, const NativeDef *def) {
+    table_insert(table, def);
+}
+
+void native_table_inherit(NativeTable *table, const NativeTable *from) {
+    for (int i = 0; i < from->capacity; i++) {
+        if (from->slots[i] && from->slots[i]->kind == NATIVE_EXTENSION) {
+            table_insert(table, from->slots[i]);
+        }
+    }
+}
+
+const NativeDef *native_lookup(const char *name) {
+    const NativeTable *table = &nac_ctx->natives;
+    return table->slots[find_slot(table, name)];
+}
+
+int native_register(const char *name, int arity, NacNativeFn fn) {
+    if (!name || !name[0] || !fn) {
+        report_error("Native function needs a name and an implementation");
+        return 1;
+    }
+
+    const NativeDef *existing = native_lookup(name);
+    if (existing && existing->kind != NATIVE_EXTENSION) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Native module cannot replace built-in %s()", name);
+        report_error(msg);
+        return 1;
+    }
+    if (function_table_find(&nac_ctx->functions, name)) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Native module cannot replace script function %s()", name);
+        report_error(msg);
+        return 1;
+    }
+
+    // Never freed: cached call sites and other contexts may still point here.
+    NativeDef *def = (NativeDef*)malloc(sizeof(NativeDef));
+    def->name = strdup(name);
+    def->arity = arity;
+    def->kind = NATIVE_EXTENSION;
+    def->id = BUILTIN_NONE;
+    def->fn = fn;
+    def->reserved = false;
+
+    table_insert(&nac_ctx->natives, def);
+    return 0;
+}
+
+Value native_call(const NativeDef *def, Value *args, int arg_count) {
+    switch (def->kind) {
+        case NATIVE_CORE:
+            return call_builtin_function(def->id, def->name, args, arg_count);
+        case NATIVE_EXTENDED:
+            return call_extended_builtin(def->id, def->name, args, arg_count);
+        case NATIVE_EXTENSION:
+            break;
+    }
+
+    if (def->arity >= 0 && arg_count != def->arity) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "%s() requires %d argument(s)", def->name, def->arity);
+        report_error(msg);
+        return make_int(0);
+    }
+    return def->fn(args, arg_count);
+}
+
+bool native_load_extension(const char *path) {
+    char msg[512];
+
+#ifdef _WIN32
+    snprintf(msg, sizeof(msg), "Native modules are not supported on Windows: %s", path);
+    report_error(msg);
+    return false;
+#else
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        snprintf(msg, sizeof(msg), "Cannot load native module: %s", dlerror());
+        report_error(msg);
+        return false;
+    }
+
+    NacExtensionInitFn init;
+    *(void**)(&init) = dlsym(handle, NAC_EXT_INIT_SYMBOL);
+    if (!init) {
+        snprintf(msg, sizeof(msg), "Native module %s does not export %s", path, NAC_EXT_INIT_SYMBOL);
+        report_error(msg);
+        dlclose(handle);
+        return false;
+    }
+
+    // The handle stays open: registered functions point into it.
+    if (init(native_register, NAC_EXT_ABI_VERSION) != 0) {
+        snprintf(msg, sizeof(msg), "Native module %s failed to initialise", path);
+        report_error(msg);
+        return false;
+    }
+    return true;
+#endif
+}
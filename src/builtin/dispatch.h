@@ -0,0 +1,134 @@
+#ifndef NAC_DISPATCH_H
+#define NAC_DISPATCH_H
+
+#include <stdbool.h>
+
+#include "../nac_ext.h"
+#include "../runtime/value.h"
+
+typedef enum {
+    NATIVE_CORE,
+    NATIVE_EXTENDED,
+    NATIVE_EXTENSION
+} NativeKind;
+
+// One per built-in, so a call dispatches with a switch instead of comparing names.
+typedef enum {
+    BUILTIN_NONE,
+    BUILTIN_SQRT,
+    BUILTIN_POW,
+    BUILTIN_SIN,
+    BUILTIN_COS,
+    BUILTIN_TAN,
+    BUILTIN_ABS,
+    BUILTIN_FLOOR,
+    BUILTIN_CEIL,
+    BUILTIN_ROUND,
+    BUILTIN_LOG,
+    BUILTIN_EXP,
+    BUILTIN_LENGTH,
+    BUILTIN_UPPER,
+    BUILTIN_LOWER,
+    BUILTIN_PUSH,
+    BUILTIN_POP,
+    BUILTIN_TRIM,
+    BUILTIN_REPLACE,
+    BUILTIN_SUBSTR,
+    BUILTIN_INDEX_OF,
+    BUILTIN_FIRST,
+    BUILTIN_LAST,
+    BUILTIN_REVERSE,
+    BUILTIN_SLICE,
+    BUILTIN_JOIN,
+    BUILTIN_READ,
+    BUILTIN_WRITE,
+    BUILTIN_APPEND,
+    BUILTIN_MAP,
+    BUILTIN_TIME,
+    BUILTIN_JSON_PARSE,
+    BUILTIN_JSON_STRINGIFY,
+    BUILTIN_HTTP_REQUEST,
+    BUILTIN_HTTP_JSON,
+    BUILTIN_HTTP_BATCH,
+    BUILTIN_HTTP_DOWNLOAD,
+    BUILTIN_HTTP_STREAM,
+    BUILTIN_HTTP_CACHE,
+    BUILTIN_HTTP_CACHE_STATS,
+    BUILTIN_HTTP_TIMEOUT,
+    BUILTIN_HTTP_HEDGE,
+    BUILTIN_HTTP_STATS,
+    BUILTIN_MODULE_LOAD,
+    BUILTIN_MODULE_REGISTER,
+    BUILTIN_MODULE_GET,
+    BUILTIN_MODULE_REQUIRE,
+    BUILTIN_MODULE_NAMES,
+    BUILTIN_MODULE_LOAD_NATIVE,
+    BUILTIN_MEMORY_STATS,
+    BUILTIN_ARGS,
+    BUILTIN_PARALLEL_MAP,
+    BUILTIN_PARALLEL_REDUCE,
+    BUILTIN_SPAWN,
+    BUILTIN_JOIN_TASK,
+    BUILTIN_CHANNEL,
+    BUILTIN_SEND,
+    BUILTIN_RECV,
+    BUILTIN_TRY_SEND,
+    BUILTIN_TRY_RECV,
+    BUILTIN_CLOSE,
+    BUILTIN_SHARED_MAP,
+    BUILTIN_SHARED_SET,
+    BUILTIN_SHARED_GET,
+    BUILTIN_SHARED_ADD,
+    BUILTIN_SHARED_SNAPSHOT,
+    BUILTIN_COUNTER,
+    BUILTIN_INCREMENT,
+    BUILTIN_COUNTER_ADD,
+    BUILTIN_COUNTER_GET,
+    BUILTIN_SET_TIMEOUT,
+    BUILTIN_SET_INTERVAL,
+    BUILTIN_CLEAR_TIMER,
+    BUILTIN_ON_LINE,
+    BUILTIN_HTTP_ASYNC,
+    BUILTIN_RUN_LOOP,
+    BUILTIN_HTTP_REQUEST_ASYNC,
+    BUILTIN_READ_ASYNC,
+    BUILTIN_DELAY,
+    BUILTIN_ALL,
+    BUILTIN_READ_FILES,
+    BUILTIN_WRITE_FILES,
+    BUILTIN_APPEND_FILES,
+    BUILTIN_FORK_MAP,
+    BUILTIN_READ_LINES,
+    BUILTIN_NEXT,
+    BUILTIN_CLOSE_GENERATOR
+} BuiltinId;
+
+// Definitions live for the whole process, so call sites can cache them.
+// Calls always reach a reserved built-in; the others, added once scripts
+// could already use their names, give way to a script function.
+typedef struct NativeDef {
+    const char *name;
+    int arity;
+    NativeKind kind;
+    BuiltinId id;
+    NacNativeFn fn;
+    bool reserved;
+} NativeDef;
+
+typedef struct {
+    const NativeDef **slots;
+    int capacity;
+    int count;
+} NativeTable;
+
+void native_table_init(NativeTable *table);
+void native_table_free(NativeTable *table);
+void native_table_add(NativeTable *table, const NativeDef *def);
+void native_table_inherit(NativeTable *table, const NativeTable *from);
+
+const NativeDef *native_lookup(const char *name);
+int native_register(const char *name, int arity, NacNativeFn fn);
+Value native_call(const NativeDef *def, Value *args, int arg_count);
+bool native_load_extension(const char *path);
+
+#endif
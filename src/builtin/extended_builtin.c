@@ -1,13 +1,34 @@
 #include "extended_builtin.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "../core/interpreter.h"
+#include "dispatch.h"
+#include "../io/file_batch.h"
 #include "../module/module.h"
 #include "../net/http.h"
+#include "../net/http_batch.h"
+#include "../net/http_cache.h"
+#include "../net/http_policy.h"
+#include "../runtime/async.h"
 #include "../runtime/json.h"
+#include "../runtime/channel.h"
+#include "../runtime/event_loop.h"
+#include "../runtime/fork_map.h"
+#include "../runtime/generator.h"
+#include "../runtime/parallel.h"
+#include "../runtime/shared.h"
+#include "../runtime/tasks.h"
 #include "../util/error.h"
+#include "../util/memory.h"
+
+// Byte counts past INT_MAX come back as floats rather than wrapping.
+static Value byte_count(size_t bytes) {
+    return bytes > INT_MAX ? make_float((double)bytes) : make_int((int)bytes);
+}
 
 static int body_to_json(Value arg, char **out_json) {
     if (arg.type == TYPE_STRING) {
@@ -19,159 +40,583 @@ static int body_to_json(Value arg, char **out_json) {
     return (*out_json != NULL);
 }
 
-bool is_extended_builtin(const char *name) {
-    const char *builtins[] = {
-        "jsonParse", "jsonStringify",
-        "httpRequest", "httpJson",
-        "moduleLoad", "moduleRegister", "moduleGet", "moduleRequire", "moduleNames"
-    };
+Value call_extended_builtin(BuiltinId id, const char *name, Value *args, int arg_count) {
+    switch (id) {
+        case BUILTIN_JSON_PARSE: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("jsonParse() requires 1 string argument");
+                return make_int(0);
+            }
 
-    int count = sizeof(builtins) / sizeof(builtins[0]);
-    for (int i = 0; i < count; i++) {
-        if (strcmp(name, builtins[i]) == 0) {
-            return true;
+            Value parsed;
+            if (!json_parse_value(args[0].str_val, &parsed)) {
+                return make_int(0);
+            }
+            return parsed;
         }
-    }
 
-    return false;
-}
+        case BUILTIN_JSON_STRINGIFY: {
+            if (arg_count != 1) {
+                report_error("jsonStringify() requires 1 argument");
+                return make_string("");
+            }
 
-Value call_extended_builtin(const char *name, Value *args, int arg_count) {
-    if (strcmp(name, "jsonParse") == 0) {
-        if (arg_count != 1 || args[0].type != TYPE_STRING) {
-            report_error("jsonParse() requires 1 string argument");
-            return make_int(0);
+            char *json = json_stringify_value(args[0]);
+            if (!json) {
+                return make_string("");
+            }
+
+            Value out = make_string(json);
+            free(json);
+            return out;
         }
 
-        Value parsed;
-        if (!json_parse_value(args[0].str_val, &parsed)) {
-            return make_int(0);
+        case BUILTIN_HTTP_REQUEST: case BUILTIN_HTTP_JSON: {
+            bool is_json = id == BUILTIN_HTTP_JSON;
+            if (arg_count < 2 || arg_count > (is_json ? 4 : 3)) {
+                report_error("httpRequest requires 2 or 3 arguments, httpJson 2 to 4");
+                return make_int(0);
+            }
+
+            if (args[0].type != TYPE_STRING || args[1].type != TYPE_STRING) {
+                report_error("httpRequest/httpJson require method and url as strings");
+                return make_int(0);
+            }
+
+            const char *path = NULL;
+            if (arg_count == 4) {
+                if (args[3].type != TYPE_STRING) {
+                    report_error("httpJson() path must be a string");
+                    return make_int(0);
+                }
+                path = args[3].str_val;
+            }
+
+            const char *body = NULL;
+            char *json_body = NULL;
+
+            if (arg_count >= 3) {
+                if (!body_to_json(args[2], &json_body)) {
+                    report_error("Could not serialize HTTP body");
+                    return make_int(0);
+                }
+                body = (args[2].type == TYPE_STRING) ? args[2].str_val : json_body;
+            }
+
+    #ifndef _WIN32
+            // Parsed while the body downloads rather than after.
+            if (is_json) {
+                Value parsed;
+                http_json_unix(args[0].str_val, args[1].str_val, body, path, &parsed);
+                free(json_body);
+                return parsed;
+            }
+    #endif
+
+            char *response = NULL;
+    #ifdef _WIN32
+            response = http_request_win_response(args[0].str_val, args[1].str_val, body);
+    #else
+            response = http_request_unix_response(args[0].str_val, args[1].str_val, body);
+    #endif
+
+            if (json_body) {
+                free(json_body);
+            }
+
+            if (!response) {
+                return make_string("");
+            }
+
+            if (!is_json) {
+                Value out = make_string(response);
+                free(response);
+                return out;
+            }
+
+            Value parsed;
+            JsonStream *stream = json_stream_create(path);
+            json_stream_feed(stream, response, strlen(response));
+            bool ok = json_stream_finish(stream, &parsed);
+            json_stream_free(stream);
+            free(response);
+            if (!ok) {
+                if (!nac_ctx->halted) {
+                    report_error("httpJson() response is not valid JSON");
+                }
+                return make_int(0);
+            }
+
+            return parsed;
         }
-        return parsed;
-    }
 
-    if (strcmp(name, "jsonStringify") == 0) {
-        if (arg_count != 1) {
-            report_error("jsonStringify() requires 1 argument");
-            return make_string("");
+        case BUILTIN_HTTP_DOWNLOAD: case BUILTIN_HTTP_STREAM: {
+            if (arg_count < 3 || arg_count > 4 || args[0].type != TYPE_STRING || args[1].type != TYPE_STRING ||
+                args[2].type != TYPE_STRING) {
+                char msg[128];
+                snprintf(msg, sizeof(msg), "%s() requires method, url, %s and an optional body", name,
+                         id == BUILTIN_HTTP_DOWNLOAD ? "a file path" : "a function name");
+                report_error(msg);
+                return make_int(0);
+            }
+
+            char *json_body = NULL;
+            const char *body = NULL;
+            if (arg_count == 4) {
+                if (!body_to_json(args[3], &json_body)) {
+                    report_error("Could not serialize HTTP body");
+                    return make_int(0);
+                }
+                body = (args[3].type == TYPE_STRING) ? args[3].str_val : json_body;
+            }
+
+            Value result;
+            if (id == BUILTIN_HTTP_DOWNLOAD) {
+                result = make_int((int)http_download(args[0].str_val, args[1].str_val, body, args[2].str_val));
+            } else {
+                result = make_int(http_stream(args[0].str_val, args[1].str_val, body, args[2].str_val));
+            }
+            free(json_body);
+            return result;
         }
 
-        char *json = json_stringify_value(args[0]);
-        if (!json) {
-            return make_string("");
+        case BUILTIN_HTTP_CACHE: {
+            if (arg_count != 1 || (args[0].type != TYPE_STRING && args[0].type != TYPE_INT)) {
+                report_error("httpCache() requires a directory, or 0 to turn the cache off");
+                return make_int(0);
+            }
+            return make_int(http_cache_open(args[0].type == TYPE_STRING ? args[0].str_val : NULL) ? 1 : 0);
         }
 
-        Value out = make_string(json);
-        free(json);
-        return out;
-    }
+        case BUILTIN_HTTP_CACHE_STATS: {
+            return http_cache_stats();
+        }
 
-    if (strcmp(name, "httpRequest") == 0 || strcmp(name, "httpJson") == 0) {
-        if (arg_count < 2 || arg_count > 3) {
-            report_error("httpRequest/httpJson require 2 or 3 arguments");
-            return make_int(0);
+        case BUILTIN_HTTP_TIMEOUT: {
+            if (arg_count != 2) {
+                report_error("httpTimeout() requires a connect and a total timeout in milliseconds");
+                return make_int(0);
+            }
+            http_set_timeouts(to_int(args[0]), to_int(args[1]));
+            return make_int(1);
         }
 
-        if (args[0].type != TYPE_STRING || args[1].type != TYPE_STRING) {
-            report_error("httpRequest/httpJson require method and url as strings");
-            return make_int(0);
+        case BUILTIN_HTTP_HEDGE: {
+            if (arg_count < 1 || arg_count > 2) {
+                report_error("httpHedge() requires a percentile and an optional minimum delay");
+                return make_int(0);
+            }
+            http_set_hedge(to_float(args[0]), arg_count == 2 ? to_int(args[1]) : 0);
+            return make_int(1);
         }
 
-        const char *body = NULL;
-        char *json_body = NULL;
+        case BUILTIN_HTTP_STATS: {
+            return http_stats();
+        }
 
-        if (arg_count == 3) {
-            if (!body_to_json(args[2], &json_body)) {
-                report_error("Could not serialize HTTP body");
+        case BUILTIN_HTTP_BATCH: {
+            if (arg_count < 1 || arg_count > 2) {
+                report_error("httpBatch() requires an array of requests and an optional concurrency");
                 return make_int(0);
             }
-            body = (args[2].type == TYPE_STRING) ? args[2].str_val : json_body;
+            return http_batch(args[0], arg_count == 2 ? to_int(args[1]) : 0);
         }
 
-        char *response = NULL;
-#ifdef _WIN32
-        response = http_request_win_response(args[0].str_val, args[1].str_val, body);
-#else
-        response = http_request_unix_response(args[0].str_val, args[1].str_val, body);
-#endif
+        case BUILTIN_MODULE_LOAD: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("moduleLoad() requires 1 string path argument");
+                return make_int(0);
+            }
 
-        if (json_body) {
-            free(json_body);
+            int ok = 0;
+            return module_load_json_file(args[0].str_val, &ok);
         }
 
-        if (!response) {
-            return make_string("");
+        case BUILTIN_MODULE_REGISTER: {
+            if (arg_count != 2 || args[0].type != TYPE_STRING) {
+                report_error("moduleRegister() requires (name, module)");
+                return make_int(0);
+            }
+
+            return make_int(module_register(args[0].str_val, args[1]));
         }
 
-        if (strcmp(name, "httpRequest") == 0) {
-            Value out = make_string(response);
-            free(response);
-            return out;
+        case BUILTIN_MODULE_GET: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("moduleGet() requires 1 string name argument");
+                return make_int(0);
+            }
+
+            int found = 0;
+            Value module = module_get_copy(args[0].str_val, &found);
+            if (!found) {
+                report_error("moduleGet() module not found");
+                return make_int(0);
+            }
+
+            return module;
         }
 
-        Value parsed;
-        int ok = json_parse_value(response, &parsed);
-        free(response);
-        if (!ok) {
-            report_error("httpJson() response is not valid JSON");
-            return make_int(0);
+        case BUILTIN_MODULE_REQUIRE: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("moduleRequire() requires 1 string name argument");
+                return make_int(0);
+            }
+
+            int ok = 0;
+            return module_require_local(args[0].str_val, &ok);
         }
 
-        return parsed;
-    }
+        case BUILTIN_MODULE_NAMES: {
+            if (arg_count != 0) {
+                report_error("moduleNames() requires 0 arguments");
+                return make_array(0);
+            }
+
+            return module_list_names();
+        }
+
+        case BUILTIN_MODULE_LOAD_NATIVE: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("moduleLoadNative() requires 1 string argument");
+                return make_int(0);
+            }
+            return make_int(native_load_extension(args[0].str_val) ? 1 : 0);
+        }
+
+        case BUILTIN_MEMORY_STATS: {
+            if (arg_count != 0) {
+                report_error("memoryStats() requires 0 arguments");
+                return make_map();
+            }
+
+            Value stats = make_map();
+            for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+                map_set(&stats, memory_category_name((MemCategory)i), byte_count(memory_used((MemCategory)i)));
+            }
+            map_set(&stats, "total", byte_count(memory_used_total()));
+            map_set(&stats, "peak", byte_count(memory_peak()));
+            map_set(&stats, "limit", byte_count(memory_limit()));
+            return stats;
+        }
+
+        case BUILTIN_ARGS: {
+            if (arg_count != 0) {
+                report_error("args() requires 0 arguments");
+                return make_array(0);
+            }
+
+            Value list = make_array(nac_ctx->script_argc);
+            for (int i = 0; i < list.array_val.size; i++) {
+                list.array_val.elements[i] = make_string(nac_ctx->script_argv[i]);
+            }
+            return list;
+        }
+
+        case BUILTIN_PARALLEL_MAP: {
+            if (arg_count != 2 || args[1].type != TYPE_STRING) {
+                report_error("parallelMap() requires 2 arguments (array, function name)");
+                return make_int(0);
+            }
+            return parallel_map(args[0], args[1].str_val);
+        }
+
+        case BUILTIN_PARALLEL_REDUCE: {
+            if (arg_count != 3 || args[1].type != TYPE_STRING) {
+                report_error("parallelReduce() requires 3 arguments (array, function name, initial)");
+                return make_int(0);
+            }
+            return parallel_reduce(args[0], args[1].str_val, args[2]);
+        }
+
+        case BUILTIN_FORK_MAP: {
+            if (arg_count < 2 || arg_count > 3 || args[1].type != TYPE_STRING) {
+                report_error("forkMap() requires an array, a function name and an optional worker count");
+                return make_int(0);
+            }
+            return fork_map(args[0], args[1].str_val, arg_count == 3 ? to_int(args[2]) : 0);
+        }
+
+        case BUILTIN_SPAWN: {
+            if (arg_count < 1 || args[0].type != TYPE_STRING) {
+                report_error("spawn() requires a function name");
+                return make_int(0);
+            }
+            return task_spawn(args[0].str_val, args + 1, arg_count - 1);
+        }
 
-    if (strcmp(name, "moduleLoad") == 0) {
-        if (arg_count != 1 || args[0].type != TYPE_STRING) {
-            report_error("moduleLoad() requires 1 string path argument");
+        case BUILTIN_JOIN_TASK: {
+            if (arg_count != 1) {
+                report_error("joinTask() requires 1 argument (task)");
+                return make_int(0);
+            }
+            return task_join(args[0]);
+        }
+
+        case BUILTIN_CHANNEL: {
+            if (arg_count != 1) {
+                report_error("channel() requires 1 argument (capacity)");
+                return make_int(0);
+            }
+            return channel_create(args[0]);
+        }
+
+        case BUILTIN_SEND: case BUILTIN_TRY_SEND: {
+            if (arg_count != 2) {
+                report_error("send() requires 2 arguments (channel, value)");
+                return make_int(0);
+            }
+            bool sent;
+            channel_send(args[0], args[1], id == BUILTIN_SEND, &sent);
+            return make_int(sent ? 1 : 0);
+        }
+
+        case BUILTIN_RECV: case BUILTIN_TRY_RECV: {
+            if (arg_count != 1 && arg_count != 2) {
+                report_error("recv() requires a channel and an optional end value");
+                return make_int(0);
+            }
+            return channel_recv(args[0], arg_count == 2 ? args[1] : make_int(0), id == BUILTIN_RECV);
+        }
+
+        case BUILTIN_CLOSE: {
+            if (arg_count != 1) {
+                report_error("close() requires 1 argument (channel)");
+                return make_int(0);
+            }
+            channel_close(args[0]);
             return make_int(0);
         }
 
-        int ok = 0;
-        return module_load_json_file(args[0].str_val, &ok);
-    }
+        case BUILTIN_SHARED_MAP: {
+            return shared_map_create();
+        }
 
-    if (strcmp(name, "moduleRegister") == 0) {
-        if (arg_count != 2 || args[0].type != TYPE_STRING) {
-            report_error("moduleRegister() requires (name, module)");
+        case BUILTIN_SHARED_SET: {
+            if (arg_count != 3) {
+                report_error("sharedSet() requires 3 arguments (map, key, value)");
+                return make_int(0);
+            }
+            shared_map_set(args[0], args[1], args[2]);
             return make_int(0);
         }
 
-        return make_int(module_register(args[0].str_val, args[1]));
-    }
+        case BUILTIN_SHARED_GET: {
+            if (arg_count != 3) {
+                report_error("sharedGet() requires 3 arguments (map, key, default)");
+                return make_int(0);
+            }
+            return shared_map_get(args[0], args[1], args[2]);
+        }
 
-    if (strcmp(name, "moduleGet") == 0) {
-        if (arg_count != 1 || args[0].type != TYPE_STRING) {
-            report_error("moduleGet() requires 1 string name argument");
+        case BUILTIN_SHARED_ADD: {
+            if (arg_count != 3) {
+                report_error("sharedAdd() requires 3 arguments (map, key, delta)");
+                return make_int(0);
+            }
+            return shared_map_add(args[0], args[1], args[2]);
+        }
+
+        case BUILTIN_SHARED_SNAPSHOT: {
+            if (arg_count != 1) {
+                report_error("sharedSnapshot() requires 1 argument (map)");
+                return make_map();
+            }
+            return shared_map_snapshot(args[0]);
+        }
+
+        case BUILTIN_COUNTER: {
+            if (arg_count > 1) {
+                report_error("counter() takes an optional initial value");
+                return make_int(0);
+            }
+            return counter_create(arg_count == 1 ? args[0] : make_int(0));
+        }
+
+        case BUILTIN_INCREMENT: {
+            if (arg_count != 1) {
+                report_error("increment() requires 1 argument (counter)");
+                return make_int(0);
+            }
+            return counter_add(args[0], 1);
+        }
+
+        case BUILTIN_COUNTER_ADD: {
+            if (arg_count != 2) {
+                report_error("counterAdd() requires 2 arguments (counter, delta)");
+                return make_int(0);
+            }
+            return counter_add(args[0], to_int(args[1]));
+        }
+
+        case BUILTIN_COUNTER_GET: {
+            if (arg_count != 1) {
+                report_error("counterGet() requires 1 argument (counter)");
+                return make_int(0);
+            }
+            return counter_get(args[0]);
+        }
+
+        case BUILTIN_SET_TIMEOUT: case BUILTIN_SET_INTERVAL: {
+            if (arg_count < 2 || args[0].type != TYPE_STRING) {
+                report_error("setTimeout/setInterval require a function name and a delay in ms");
+                return make_int(0);
+            }
+            return loop_set_timer(args[0].str_val, args[1], args + 2, arg_count - 2, id == BUILTIN_SET_INTERVAL);
+        }
+
+        case BUILTIN_CLEAR_TIMER: {
+            if (arg_count != 1) {
+                report_error("clearTimer() requires 1 argument (timer)");
+                return make_int(0);
+            }
+            loop_clear_timer(args[0]);
             return make_int(0);
         }
 
-        int found = 0;
-        Value module = module_get_copy(args[0].str_val, &found);
-        if (!found) {
-            report_error("moduleGet() module not found");
+        case BUILTIN_ON_LINE: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("onLine() requires a function name");
+                return make_int(0);
+            }
+            loop_on_line(args[0].str_val);
             return make_int(0);
         }
 
-        return module;
-    }
+        case BUILTIN_HTTP_ASYNC: {
+            if (arg_count < 3 || arg_count > 4 || args[0].type != TYPE_STRING ||
+                args[1].type != TYPE_STRING || args[2].type != TYPE_STRING) {
+                report_error("httpAsync() requires method, url, callback name and an optional body");
+                return make_int(0);
+            }
+
+            char *json_body = NULL;
+            const char *body = NULL;
+            if (arg_count == 4) {
+                if (!body_to_json(args[3], &json_body)) {
+                    report_error("Could not serialize HTTP body");
+                    return make_int(0);
+                }
+                body = (args[3].type == TYPE_STRING) ? args[3].str_val : json_body;
+            }
+
+            bool ok = http_async_request(args[0].str_val, args[1].str_val, body, args[2].str_val, 0);
+            free(json_body);
+            return make_int(ok ? 1 : 0);
+        }
+
+        case BUILTIN_HTTP_REQUEST_ASYNC: {
+            if (arg_count < 2 || arg_count > 3 || args[0].type != TYPE_STRING || args[1].type != TYPE_STRING) {
+                report_error("httpRequestAsync() requires method, url and an optional body");
+                return make_int(0);
+            }
+
+            char *json_body = NULL;
+            const char *body = NULL;
+            if (arg_count == 3) {
+                if (!body_to_json(args[2], &json_body)) {
+                    report_error("Could not serialize HTTP body");
+                    return make_int(0);
+                }
+                body = (args[2].type == TYPE_STRING) ? args[2].str_val : json_body;
+            }
+
+            int promise = promise_create();
+            if (!http_async_request(args[0].str_val, args[1].str_val, body, NULL, promise)) {
+                promise_reject(promise, "HTTP: request could not be started");
+            }
+            free(json_body);
+            return make_int(promise);
+        }
+
+        case BUILTIN_READ_ASYNC: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("readAsync() requires a file path");
+                return make_int(0);
+            }
+            return file_batch_read_one(args[0].str_val);
+        }
+
+        case BUILTIN_READ_FILES: {
+            if (arg_count < 1 || arg_count > 2 || (arg_count == 2 && args[1].type != TYPE_STRING)) {
+                report_error("readFiles() requires an array of paths and an optional callback name");
+                return make_int(0);
+            }
+            return file_batch_start(FILE_BATCH_READ, args[0], make_int(0), arg_count == 2 ? args[1].str_val : NULL);
+        }
 
-    if (strcmp(name, "moduleRequire") == 0) {
-        if (arg_count != 1 || args[0].type != TYPE_STRING) {
-            report_error("moduleRequire() requires 1 string name argument");
+        case BUILTIN_WRITE_FILES: case BUILTIN_APPEND_FILES: {
+            if (arg_count < 2 || arg_count > 3 || (arg_count == 3 && args[2].type != TYPE_STRING)) {
+                char msg[128];
+                snprintf(msg, sizeof(msg), "%s() requires arrays of paths and contents and an optional callback name",
+                         name);
+                report_error(msg);
+                return make_int(0);
+            }
+            FileBatchOp op = (id == BUILTIN_WRITE_FILES) ? FILE_BATCH_WRITE : FILE_BATCH_APPEND;
+            return file_batch_start(op, args[0], args[1], arg_count == 3 ? args[2].str_val : NULL);
+        }
+
+        case BUILTIN_READ_LINES: {
+            if (arg_count != 1 || args[0].type != TYPE_STRING) {
+                report_error("readLines() requires a file path");
+                return make_int(0);
+            }
+            return generator_lines(args[0].str_val);
+        }
+
+        case BUILTIN_NEXT: {
+            if (arg_count < 1 || arg_count > 2) {
+                report_error("next() requires a generator and an optional end value");
+                return make_int(0);
+            }
+            Generator *gen = generator_find(args[0], "next()");
+            Value item;
+            if (gen && generator_next(gen, &item)) {
+                return item;
+            }
+            return arg_count == 2 ? copy_value(args[1]) : make_int(0);
+        }
+
+        case BUILTIN_CLOSE_GENERATOR: {
+            if (arg_count != 1) {
+                report_error("closeGenerator() requires a generator");
+                return make_int(0);
+            }
+            Generator *gen = generator_find(args[0], "closeGenerator()");
+            if (gen) {
+                generator_close(gen);
+            }
             return make_int(0);
         }
 
-        int ok = 0;
-        return module_require_local(args[0].str_val, &ok);
-    }
+        case BUILTIN_DELAY: {
+            if (arg_count != 1) {
+                report_error("delay() requires a delay in milliseconds");
+                return make_int(0);
+            }
+            return async_delay(args[0]);
+        }
 
-    if (strcmp(name, "moduleNames") == 0) {
-        if (arg_count != 0) {
-            report_error("moduleNames() requires 0 arguments");
-            return make_array(0);
+        case BUILTIN_ALL: {
+            if (arg_count != 1) {
+                report_error("all() requires an array of promises");
+                return make_int(0);
+            }
+            return async_all(args[0]);
+        }
+
+        case BUILTIN_RUN_LOOP: {
+            EventLoop *loop = event_loop_get();
+            if (loop) {
+                event_loop_run(loop);
+            }
+            return make_int(0);
         }
 
-        return module_list_names();
+
+        default:
+            break;
     }
 
     report_error("Unknown extended built-in function");
@@ -3,9 +3,9 @@
 
 #include <stdbool.h>
 
+#include "dispatch.h"
 #include "../runtime/value.h"
 
-bool is_extended_builtin(const char *name);
-Value call_extended_builtin(const char *name, Value *args, int arg_count);
+Value call_extended_builtin(BuiltinId id, const char *name, Value *args, int arg_count);
 
 #endif
@@ -0,0 +1,123 @@
+#include "../nac.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interpreter.h"
+#include "../io/io.h"
+#include "../runtime/eval.h"
+
+static void reset_errors(NacContext *ctx) {
+    ctx->error_occurred = false;
+    ctx->error_count = 0;
+    ctx->halted = false;
+    ctx->last_error[0] = '\0';
+}
+
+NacContext *nac_context_new(void) {
+    return context_create();
+}
+
+void nac_context_free(NacContext *ctx) {
+    context_destroy(ctx);
+}
+
+int nac_load(NacContext *ctx, const char *source, const char *name) {
+    NacContext *previous = context_enter(ctx);
+    reset_errors(ctx);
+
+    free(ctx->owned_script_name);
+    ctx->owned_script_name = strdup(name ? name : "<embedded>");
+    set_script_name(ctx->owned_script_name);
+    set_source_code(strdup(source));
+
+    Program program;
+    program_init(&program);
+
+    int status = NAC_ERROR;
+    if (compile_program(&program) && run_program(&program) == 0) {
+        status = NAC_OK;
+    }
+
+    program_free(&program);
+    free(ctx->code);
+    ctx->code = NULL;
+    ctx->code_len = 0;
+
+    context_enter(previous);
+    return status;
+}
+
+int nac_load_file(NacContext *ctx, const char *path) {
+    char *source = try_read_file(path);
+    if (!source) {
+        snprintf(ctx->last_error, sizeof(ctx->last_error), "Cannot open file: %s", path);
+        return NAC_ERROR;
+    }
+
+    int status = nac_load(ctx, source, path);
+    free(source);
+    return status;
+}
+
+int nac_has_function(NacContext *ctx, const char *name) {
+    NacContext *previous = context_enter(ctx);
+    int found = find_function(name) != NULL;
+    context_enter(previous);
+    return found;
+}
+
+int nac_call(NacContext *ctx, const char *name, const Value *args, int arg_count, Value *result) {
+    NacContext *previous = context_enter(ctx);
+    reset_errors(ctx);
+
+    int status = NAC_ERROR;
+    Function *func = find_function(name);
+    if (!func) {
+        snprintf(ctx->last_error, sizeof(ctx->last_error), "Undefined function: %s", name);
+    } else {
+        Value out = call_function(func, (Value*)args, arg_count);
+        // The returned value is the context's last return value; hand it over
+        // so the next call without `rn` cannot alias it.
+        ctx->return_value = make_int(0);
+        if (!ctx->error_occurred) {
+            status = NAC_OK;
+        }
+        if (result && status == NAC_OK) {
+            *result = out;
+        } else {
+            free_value(&out);
+        }
+    }
+
+    context_enter(previous);
+    return status;
+}
+
+int nac_set_global(NacContext *ctx, const char *name, Value value) {
+    NacContext *previous = context_enter(ctx);
+    set_var(name, value);
+    context_enter(previous);
+    return NAC_OK;
+}
+
+int nac_get_global(NacContext *ctx, const char *name, Value *result) {
+    NacContext *previous = context_enter(ctx);
+    Value *found = get_var(name);
+
+    int status = NAC_ERROR;
+    if (found) {
+        *result = copy_value(*found);
+        status = NAC_OK;
+    } else {
+        snprintf(ctx->last_error, sizeof(ctx->last_error), "Undefined variable: %s", name);
+    }
+
+    context_enter(previous);
+    return status;
+}
+
+const char *nac_last_error(const NacContext *ctx) {
+    return ctx->last_error;
+}
@@ -1,78 +1,224 @@
 #include "interpreter.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "../io/file_batch.h"
 #include "../lexer/lexer.h"
+#include "../module/module.h"
 #include "../parser/parser.h"
+#include "../runtime/channel.h"
+#include "../net/http.h"
+#include "../runtime/async.h"
+#include "../runtime/coroutine.h"
 #include "../runtime/eval.h"
+#include "../runtime/event_loop.h"
+#include "../runtime/generator.h"
+#include "../runtime/parallel.h"
+#include "../runtime/shared.h"
+#include "../runtime/tasks.h"
+#include "program_cache.h"
+#include "snapshot.h"
+#include "../util/heap_profile.h"
+#include "../util/thread_pool.h"
 
-char *code = NULL;
-int pos = 0;
-int code_len = 0;
-Token current_token;
+NAC_THREAD_LOCAL NacContext *nac_ctx = NULL;
+static atomic_ulong next_context_id = 1;
 
-VarTable *global_vars;
-VarTable *call_stack_vars[MAX_CALL_DEPTH];
-int call_depth = 0;
+NacContext *context_create(void) {
+    NacContext *ctx = (NacContext*)calloc(1, sizeof(NacContext));
+    ctx->id = atomic_fetch_add(&next_context_id, 1);
+    ctx->global_vars = create_var_table();
+    ctx->return_value = make_int(0);
+    function_table_init(&ctx->functions);
+    native_table_init(&ctx->natives);
+    return ctx;
+}
 
-Function functions[MAX_FUNCS];
-int func_count = 0;
+void context_destroy(NacContext *ctx) {
+    if (!ctx) return;
 
-bool should_break = false;
-bool should_continue = false;
-bool should_return = false;
-Value return_value;
+    NacContext *previous = context_enter(ctx);
+    free(ctx->code);
+    free(ctx->owned_script_name);
+    ctx->code = NULL;
+    free_lexer();
+    function_table_free(&ctx->functions);
+    free(ctx->imports);
+    while (ctx->call_depth > 0) {
+        free_var_table(ctx->call_stack_vars[--ctx->call_depth]);
+    }
+    free_var_table(ctx->global_vars);
+    free_value(&ctx->return_value);
+    module_registry_free();
+    task_exports_free(ctx);
+    http_async_free(ctx);
+    file_batch_free(ctx);
+    event_loop_free(ctx);
+    async_free(ctx);
+    generators_free(ctx);
+    coroutines_free(ctx);
+    native_table_free(&ctx->natives);
+    context_enter(previous == ctx ? NULL : previous);
 
-bool error_occurred = false;
-int error_count = 0;
+    free(ctx);
+}
+
+NacContext *context_enter(NacContext *ctx) {
+    NacContext *previous = nac_ctx;
+    nac_ctx = ctx;
+    return previous;
+}
 
 void init_interpreter(void) {
-    global_vars = create_var_table();
-    func_count = 0;
-    call_depth = 0;
-    should_break = false;
-    should_continue = false;
-    should_return = false;
-    return_value = make_int(0);
-    error_occurred = false;
-    error_count = 0;
+    context_enter(context_create());
+}
+
+void set_script_name(const char *name) {
+    nac_ctx->script_name = name;
+}
+
+void set_script_args(int argc, char **argv) {
+    nac_ctx->script_argc = argc;
+    nac_ctx->script_argv = argv;
 }
 
 void set_source_code(char *source) {
-    code = source;
-    code_len = strlen(code);
-    pos = 0;
+    nac_ctx->code = source;
+    nac_ctx->code_len = strlen(source);
+}
+
+static bool execute_statement(ASTNode *stmt) {
+    if (stmt) {
+        eval_node(stmt);
+        free_ast(stmt);
+    }
+
+    heap_profile_poll();
+
+    if (nac_ctx->error_count > 10) {
+        fprintf(stderr, "Too many errors, stopping execution.\n");
+        return false;
+    }
+    return !nac_ctx->halted;
+}
+
+static int finish_run(void) {
+    if (nac_ctx->error_occurred) {
+        fprintf(stderr, "\nExecution completed with %d error(s).\n", nac_ctx->error_count);
+        return 1;
+    }
+
+    return 0;
 }
 
 int run_interpreter(void) {
     init_lexer();
     next_token();
 
-    while (current_token.type != TOK_EOF) {
+    while (nac_ctx->current_token.type != TOK_EOF) {
+        if (!execute_statement(parse_statement())) break;
+    }
+
+    return finish_run();
+}
+
+// Definitions are captured into the program and replayed in source order
+// when it runs.
+bool compile_program(Program *program) {
+    Program *outer = nac_ctx->compiling;
+    nac_ctx->compiling = program;
+    set_eager_parsing(true);
+    init_lexer();
+    next_token();
+
+    while (nac_ctx->current_token.type != TOK_EOF) {
         ASTNode *stmt = parse_statement();
         if (stmt) {
-            eval_node(stmt);
-            free_ast(stmt);
+            program_add_statement(program, stmt);
         }
+    }
+
+    set_eager_parsing(false);
+    free_lexer();
+    nac_ctx->compiling = outer;
+    return !nac_ctx->error_occurred;
+}
+
+void define_function(const Function *func) {
+    if (nac_ctx->compiling) {
+        program_add_function(nac_ctx->compiling, func);
+    } else {
+        function_table_add(&nac_ctx->functions, func);
+    }
+}
+
+int run_program(Program *program) {
+    for (int i = 0; i < program->count; i++) {
+        ProgramItem *item = &program->items[i];
+        if (item->is_function) {
+            function_table_add(&nac_ctx->functions, &item->function);
+            item->function.body = NULL;
+            continue;
+        }
+
+        ASTNode *stmt = item->statement;
+        item->statement = NULL;
+        if (!execute_statement(stmt)) break;
+    }
+
+    return finish_run();
+}
+
+int run_interpreter_cached(const char *cache_path) {
+    Program program;
+    program_init(&program);
 
-        if (error_count > 10) {
-            fprintf(stderr, "Too many errors, stopping execution.\n");
-            break;
+    if (!program_cache_load(cache_path, nac_ctx->code, nac_ctx->code_len, &program)) {
+        if (!compile_program(&program)) {
+            program_free(&program);
+            fprintf(stderr, "\nCompilation failed with %d error(s).\n", nac_ctx->error_count);
+            return 1;
         }
+        program_cache_store(cache_path, nac_ctx->code, nac_ctx->code_len, &program);
     }
 
-    if (error_occurred) {
-        fprintf(stderr, "\nExecution completed with %d error(s).\n", error_count);
+    int exit_code = run_program(&program);
+    program_free(&program);
+    return exit_code;
+}
+
+int check_interpreter(void) {
+    set_eager_parsing(true);
+    init_lexer();
+    next_token();
+
+    while (nac_ctx->current_token.type != TOK_EOF) {
+        free_ast(parse_statement());
+    }
+
+    set_eager_parsing(false);
+
+    if (nac_ctx->error_occurred) {
+        fprintf(stderr, "\nCheck failed with %d error(s).\n", nac_ctx->error_count);
         return 1;
     }
 
+    printf("Syntax OK\n");
     return 0;
 }
 
 void shutdown_interpreter(void) {
-    free(code);
-    free_lexer();
-    free_var_table(global_vars);
+    channels_close_all();
+    thread_pool_shutdown();
+    parallel_shutdown();
+    tasks_shutdown();
+    channels_shutdown();
+    shared_shutdown();
+    heap_profile_stop();
+    program_cache_close();
+    snapshot_close();
+    context_destroy(nac_ctx);
 }
@@ -3,40 +3,108 @@
 
 #include <stdbool.h>
 
+#include "../builtin/dispatch.h"
+#include "../lexer/lexer.h"
 #include "../lexer/token.h"
 #include "../parser/parser.h"
+#include "../runtime/functable.h"
 #include "../runtime/value.h"
 #include "../runtime/vartable.h"
+#include "program_cache.h"
 
 #define NAC_VERSION "3.3.0"
 #define NAC_TAG "NaC" NAC_VERSION
 #define MAX_CALL_DEPTH 100
 
-extern char *code;
-extern int pos;
-extern int code_len;
-extern Token current_token;
+#if defined(_MSC_VER)
+#define NAC_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+// initial-exec keeps nac_ctx a plain %fs-relative load inside libnac.so too.
+#define NAC_THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+#define NAC_THREAD_LOCAL _Thread_local
+#endif
+
+struct ModuleEntry;
+struct TaskExports;
+struct EventLoop;
+struct HttpMulti;
+
+// Everything one interpreter instance owns. Several contexts can live in one
+// process; the interpreter always works on the calling thread's nac_ctx.
+typedef struct NacContext {
+    unsigned long id;
+    const char *script_name;
+    char *owned_script_name;
+    char *code;
+    int code_len;
+    Token current_token;
+    LexerState lexer;
+    bool eager_parsing;
+    bool saw_yield;  // the function body being parsed is a generator
+
+    VarTable *global_vars;
+    VarTable *shared_globals;  // read-only fallback for worker contexts
+    VarTable *call_stack_vars[MAX_CALL_DEPTH];
+    int call_depth;
+    const char *call_stack_names[MAX_CALL_DEPTH];
+    int exec_line;
+    int exec_col;
+    int parse_depth;
 
-extern VarTable *global_vars;
-extern VarTable *call_stack_vars[MAX_CALL_DEPTH];
-extern int call_depth;
+    FunctionTable functions;
+    NativeTable natives;
+    Program *compiling;
 
-extern Function functions[MAX_FUNCS];
-extern int func_count;
+    // Namespace of the running module code, so `helper()` inside module
+    // `m` finds `m.helper` first.
+    const char *scope;
+    int scope_len;
+    const Program **imports;
+    int import_count;
+    int import_capacity;
 
-extern bool should_break;
-extern bool should_continue;
-extern bool should_return;
-extern Value return_value;
+    bool should_break;
+    bool should_continue;
+    bool should_return;
+    Value return_value;
 
-extern bool error_occurred;
-extern int error_count;
+    bool error_occurred;
+    int error_count;
+    bool halted;  // the memory quota was crossed; the script unwinds
+    char last_error[512];
+
+    int script_argc;
+    char **script_argv;
+
+    struct ModuleEntry *modules;
+    struct TaskExports *exports;  // what spawned tasks see, see tasks.c
+    struct EventLoop *loop;
+    struct HttpMulti *http;
+    struct AsyncState *async;
+    struct FileRing *files;
+    struct Coroutine *coroutines;
+    struct GeneratorState *generators;
+} NacContext;
+
+extern NAC_THREAD_LOCAL NacContext *nac_ctx;
 
 extern char latest[64];
 
+NacContext *context_create(void);
+void context_destroy(NacContext *ctx);
+NacContext *context_enter(NacContext *ctx);
+
 void init_interpreter(void);
 void set_source_code(char *source);
+void set_script_name(const char *name);
+void set_script_args(int argc, char **argv);
 int run_interpreter(void);
+int run_interpreter_cached(const char *cache_path);
+bool compile_program(Program *program);
+void define_function(const Function *func);
+int run_program(Program *program);
+int check_interpreter(void);
 void shutdown_interpreter(void);
 
 void get_latest(void);
@@ -0,0 +1,189 @@
+#include "program_cache.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../io/io.h"
+#include "../parser/ast_io.h"
+#include "../util/bytebuf.h"
+#include "interpreter.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define CACHE_MAGIC "NACC"
+#define CACHE_FORMAT 4
+
+#define ITEM_FUNCTION 'F'
+#define ITEM_STATEMENT 'S'
+
+// Function bodies are decoded lazily straight from the cache file, so the
+// mapping stays alive until program_cache_close().
+static void *cache_data = NULL;
+static size_t cache_data_len = 0;
+
+void program_init(Program *program) {
+    program->items = NULL;
+    program->count = 0;
+    program->capacity = 0;
+}
+
+static ProgramItem *program_push(Program *program) {
+    if (program->count >= program->capacity) {
+        program->capacity = (program->capacity == 0) ? 64 : program->capacity * 2;
+        program->items = (ProgramItem*)realloc(program->items, sizeof(ProgramItem) * program->capacity);
+    }
+
+    ProgramItem *item = &program->items[program->count++];
+    memset(item, 0, sizeof(ProgramItem));
+    return item;
+}
+
+void program_add_function(Program *program, const Function *func) {
+    ProgramItem *item = program_push(program);
+    item->is_function = true;
+    item->function = *func;
+}
+
+void program_add_statement(Program *program, ASTNode *stmt) {
+    ProgramItem *item = program_push(program);
+    item->statement = stmt;
+}
+
+void program_free(Program *program) {
+    for (int i = 0; i < program->count; i++) {
+        if (program->items[i].is_function) {
+            free_ast(program->items[i].function.body);
+        } else {
+            free_ast(program->items[i].statement);
+        }
+    }
+
+    free(program->items);
+    program_init(program);
+}
+
+// False if the name does not fit; a truncated name could be the script
+// itself.
+bool program_cache_path(const char *script_path, char *out, size_t out_size) {
+    int n = snprintf(out, out_size, "%sc", script_path);
+    return n > 0 && (size_t)n < out_size;
+}
+
+static void write_header(ByteBuf *buf, const char *source, size_t source_len) {
+    bytebuf_put(buf, CACHE_MAGIC, 4);
+    bytebuf_put_varint(buf, CACHE_FORMAT);
+    bytebuf_put_str(buf, NAC_VERSION);
+    bytebuf_put_u64(buf, (uint64_t)source_len);
+    bytebuf_put_u64(buf, hash_bytes(source, source_len));
+}
+
+static bool header_matches(ByteReader *r, const char *source, size_t source_len) {
+    const void *magic = reader_take(r, 4);
+    if (!magic || memcmp(magic, CACHE_MAGIC, 4) != 0) return false;
+    if (reader_varint(r) != CACHE_FORMAT) return false;
+
+    char version[64];
+    if (!reader_str(r, version, sizeof(version)) || strcmp(version, NAC_VERSION) != 0) return false;
+
+    if (reader_u64(r) != (uint64_t)source_len) return false;
+    if (reader_u64(r) != hash_bytes(source, source_len)) return false;
+
+    return !r->failed;
+}
+
+static bool decode_program(ByteReader *r, Program *program) {
+    uint64_t count = reader_varint(r);
+
+    for (uint64_t i = 0; i < count && !r->failed; i++) {
+        unsigned char kind = reader_u8(r);
+        if (kind == ITEM_FUNCTION) {
+            Function func;
+            if (!function_read(r, &func)) break;
+            program_add_function(program, &func);
+        } else if (kind == ITEM_STATEMENT) {
+            ASTNode *stmt = ast_read(r);
+            if (r->failed) break;
+            program_add_statement(program, stmt);
+        } else {
+            r->failed = true;
+        }
+    }
+
+    if (r->failed || r->pos != r->len) {
+        program_free(program);
+        return false;
+    }
+    return true;
+}
+
+bool program_cache_load(const char *cache_path, const char *source, size_t source_len, Program *program) {
+    void *data = NULL;
+    size_t len = 0;
+    if (!map_file(cache_path, &data, &len)) return false;
+
+    ByteReader r;
+    reader_init(&r, data, len);
+    if (!header_matches(&r, source, source_len) || !decode_program(&r, program)) {
+        unmap_file(data, len);
+        return false;
+    }
+
+    program_cache_close();
+    cache_data = data;
+    cache_data_len = len;
+    return true;
+}
+
+bool program_cache_store(const char *cache_path, const char *source, size_t source_len, const Program *program) {
+    ByteBuf buf;
+    bytebuf_init(&buf);
+    write_header(&buf, source, source_len);
+
+    bytebuf_put_varint(&buf, (uint64_t)program->count);
+    for (int i = 0; i < program->count; i++) {
+        const ProgramItem *item = &program->items[i];
+        if (item->is_function) {
+            bytebuf_put_u8(&buf, ITEM_FUNCTION);
+            function_write(&buf, &item->function);
+        } else {
+            bytebuf_put_u8(&buf, ITEM_STATEMENT);
+            ast_write(&buf, item->statement);
+        }
+    }
+
+    // Write to a temporary file and rename so readers never map a partial cache.
+    char tmp_path[PATH_MAX];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    FILE *f = (n > 0 && (size_t)n < sizeof(tmp_path)) ? fopen(tmp_path, "wb") : NULL;
+    if (!f) {
+        bytebuf_free(&buf);
+        return false;
+    }
+
+    bool ok = fwrite(buf.data, 1, buf.len, f) == buf.len;
+    ok = (fclose(f) == 0) && ok;
+    bytebuf_free(&buf);
+
+    if (ok) {
+#ifdef _WIN32
+        remove(cache_path);
+#endif
+        ok = rename(tmp_path, cache_path) == 0;
+    }
+    if (!ok) {
+        remove(tmp_path);
+    }
+    return ok;
+}
+
+void program_cache_close(void) {
+    if (!cache_data) return;
+
+    unmap_file(cache_data, cache_data_len);
+    cache_data = NULL;
+    cache_data_len = 0;
+}
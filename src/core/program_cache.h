@@ -0,0 +1,31 @@
+#ifndef NAC_PROGRAM_CACHE_H
+#define NAC_PROGRAM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../parser/parser.h"
+
+typedef struct {
+    bool is_function;
+    Function function;
+    ASTNode *statement;
+} ProgramItem;
+
+typedef struct {
+    ProgramItem *items;
+    int count;
+    int capacity;
+} Program;
+
+void program_init(Program *program);
+void program_add_function(Program *program, const Function *func);
+void program_add_statement(Program *program, ASTNode *stmt);
+void program_free(Program *program);
+
+bool program_cache_path(const char *script_path, char *out, size_t out_size);
+bool program_cache_load(const char *cache_path, const char *source, size_t source_len, Program *program);
+void program_cache_close(void);
+bool program_cache_store(const char *cache_path, const char *source, size_t source_len, const Program *program);
+
+#endif
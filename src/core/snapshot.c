@@ -0,0 +1,171 @@
+#include "snapshot.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../io/io.h"
+#include "../module/module.h"
+#include "../parser/ast_io.h"
+#include "../runtime/value_io.h"
+#include "../util/bytebuf.h"
+#include "../util/error.h"
+#include "interpreter.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define SNAPSHOT_MAGIC "NACS"
+#define SNAPSHOT_FORMAT 4
+
+// Restored function bodies are decoded lazily from the snapshot, so the
+// mapping stays alive until snapshot_close().
+static void *snapshot_data = NULL;
+static size_t snapshot_data_len = 0;
+
+static int count_globals(void) {
+    int count = 0;
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        for (VarEntry *entry = nac_ctx->global_vars->buckets[i]; entry; entry = entry->next) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void count_module(const char *name, Value value, void *ctx) {
+    (void)name;
+    (void)value;
+    (*(int*)ctx)++;
+}
+
+static void write_module(const char *name, Value value, void *ctx) {
+    ByteBuf *buf = (ByteBuf*)ctx;
+    bytebuf_put_str(buf, name);
+    value_write(buf, value);
+}
+
+bool snapshot_save(const char *path) {
+    ByteBuf buf;
+    bytebuf_init(&buf);
+
+    bytebuf_put(&buf, SNAPSHOT_MAGIC, 4);
+    bytebuf_put_varint(&buf, SNAPSHOT_FORMAT);
+    bytebuf_put_str(&buf, NAC_VERSION);
+
+    FunctionTable *functions = &nac_ctx->functions;
+    bytebuf_put_varint(&buf, (uint64_t)functions->count);
+    for (int i = 0; i < functions->count; i++) {
+        parse_function_body(functions->items[i]);
+        function_write(&buf, functions->items[i]);
+    }
+
+    bytebuf_put_varint(&buf, (uint64_t)count_globals());
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        for (VarEntry *entry = nac_ctx->global_vars->buckets[i]; entry; entry = entry->next) {
+            bytebuf_put_str(&buf, entry->name);
+            value_write(&buf, entry->value);
+        }
+    }
+
+    int module_count = 0;
+    module_foreach(count_module, &module_count);
+    bytebuf_put_varint(&buf, (uint64_t)module_count);
+    module_foreach(write_module, &buf);
+
+    char tmp_path[PATH_MAX];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    bool named = n > 0 && (size_t)n < sizeof(tmp_path);
+
+    FILE *f = named ? fopen(tmp_path, "wb") : NULL;
+    bool ok = f && fwrite(buf.data, 1, buf.len, f) == buf.len;
+    if (f) {
+        ok = (fclose(f) == 0) && ok;
+    }
+    bytebuf_free(&buf);
+
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok) {
+        if (named) remove(tmp_path);
+        fprintf(stderr, "Cannot write snapshot: %s\n", path);
+    }
+    return ok;
+}
+
+static bool restore_state(ByteReader *r) {
+    const void *magic = reader_take(r, 4);
+    if (!magic || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0) return false;
+    if (reader_varint(r) != SNAPSHOT_FORMAT) return false;
+
+    char version[64];
+    if (!reader_str(r, version, sizeof(version)) || strcmp(version, NAC_VERSION) != 0) {
+        report_error("Snapshot was written by a different NaC version");
+        return false;
+    }
+
+    uint64_t funcs = reader_varint(r);
+    for (uint64_t i = 0; i < funcs; i++) {
+        Function func;
+        if (!function_read(r, &func)) return false;
+        function_table_add(&nac_ctx->functions, &func);
+    }
+
+    uint64_t globals = reader_varint(r);
+    for (uint64_t i = 0; i < globals && !r->failed; i++) {
+        char name[MAX_TOKEN_LEN];
+        Value value;
+        reader_str(r, name, sizeof(name));
+        if (!value_read(r, &value)) return false;
+        set_var(name, value);
+        free_value(&value);
+    }
+
+    uint64_t modules = reader_varint(r);
+    for (uint64_t i = 0; i < modules && !r->failed; i++) {
+        char name[MAX_STRING_LEN];
+        Value value;
+        reader_str(r, name, sizeof(name));
+        if (!value_read(r, &value)) return false;
+        module_register(name, value);
+        free_value(&value);
+    }
+
+    return !r->failed && r->pos == r->len;
+}
+
+bool snapshot_restore(const char *path) {
+    void *data = NULL;
+    size_t len = 0;
+    if (!map_file(path, &data, &len)) {
+        fprintf(stderr, "Cannot open snapshot: %s\n", path);
+        return false;
+    }
+
+    ByteReader r;
+    reader_init(&r, data, len);
+    if (!restore_state(&r)) {
+        fprintf(stderr, "Invalid snapshot: %s\n", path);
+        unmap_file(data, len);
+        return false;
+    }
+
+    snapshot_close();
+    snapshot_data = data;
+    snapshot_data_len = len;
+    return true;
+}
+
+void snapshot_close(void) {
+    if (!snapshot_data) return;
+
+    unmap_file(snapshot_data, snapshot_data_len);
+    snapshot_data = NULL;
+    snapshot_data_len = 0;
+}
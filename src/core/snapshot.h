@@ -0,0 +1,10 @@
+#ifndef NAC_SNAPSHOT_H
+#define NAC_SNAPSHOT_H
+
+#include <stdbool.h>
+
+bool snapshot_save(const char *path);
+bool snapshot_restore(const char *path);
+void snapshot_close(void);
+
+#endif
@@ -0,0 +1,557 @@
+#include "file_batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "../runtime/async.h"
+#include "../runtime/event_loop.h"
+#include "../util/error.h"
+#include "../util/thread_pool.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct FileBatch {
+    FileBatchOp op;
+    int promise;
+    bool single;  // readAsync(): settles with the content itself
+    char callback[MAX_TOKEN_LEN];
+    int remaining;
+    Value results;
+} FileBatch;
+
+typedef struct FileJob {
+    PoolWork work;
+    FileBatch *batch;
+    FileBatchOp op;
+    EventLoop *loop;
+    int index;
+    int slot;
+    int result;  // bytes transferred, or negative on failure
+    int len;
+    char path[MAX_STRING_LEN];
+    char data[MAX_STRING_LEN];
+    struct FileJob *next;
+} FileJob;
+
+static void job_run_blocking(FileJob *job) {
+    const char *mode = (job->op == FILE_BATCH_READ) ? "rb" : (job->op == FILE_BATCH_WRITE) ? "wb" : "ab";
+    FILE *f = fopen(job->path, mode);
+    if (!f) {
+        job->result = -1;
+        return;
+    }
+    if (job->op == FILE_BATCH_READ) {
+        job->result = (int)fread(job->data, 1, MAX_STRING_LEN - 1, f);
+    } else {
+        job->result = (int)fwrite(job->data, 1, job->len, f);
+    }
+    fclose(f);
+}
+
+static void batch_release(FileBatch *batch) {
+    if (!batch->single) {
+        free_value(&batch->results);
+    }
+    free(batch);
+}
+
+// For jobs dropped at shutdown.
+static void job_discard(void *data) {
+    FileJob *job = (FileJob*)data;
+    if (--job->batch->remaining == 0) {
+        batch_release(job->batch);
+    }
+    free(job);
+}
+
+// Runs on the script's thread once a job has finished, in completion order.
+static void job_settle(FileJob *job) {
+    FileBatch *batch = job->batch;
+    if (job->loop) {
+        event_loop_hold(job->loop, -1);
+    }
+
+    Value value;
+    if (job->op == FILE_BATCH_READ) {
+        if (job->result >= 0) {
+            job->data[job->result] = '\0';
+            value = make_string(job->data);
+        } else {
+            value = make_int(0);
+        }
+    } else {
+        value = make_int(job->result >= 0 ? job->result : -1);
+    }
+
+    if (batch->single) {
+        if (job->result >= 0) {
+            promise_resolve(batch->promise, value);
+        } else {
+            char msg[MAX_STRING_LEN + 32];
+            snprintf(msg, sizeof(msg), "Cannot open file: %s", job->path);
+            promise_reject(batch->promise, msg);
+        }
+        free(batch);
+        free(job);
+        return;
+    }
+
+    if (batch->callback[0]) {
+        Value args[2] = { make_string(job->path), value };
+        loop_call(batch->callback, args, 2);
+    }
+    batch->results.array_val.elements[job->index] = value;
+
+    if (--batch->remaining == 0) {
+        promise_resolve(batch->promise, batch->results);
+        free(batch);
+    }
+    free(job);
+}
+
+#ifdef __linux__
+
+#define RING_ENTRIES 1024
+#define RING_FILES 256  // files in flight; each takes three SQEs
+
+enum { STAGE_OPEN, STAGE_IO, STAGE_CLOSE };
+
+// One io_uring per context. Every file is a linked open -> read/write ->
+// close chain on a registered file slot, so a whole batch goes to the
+// kernel in one io_uring_enter and completions come back through an eventfd
+// on the event loop.
+typedef struct FileRing {
+    int fd;
+    int event_fd;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned local_tail;
+    unsigned to_submit;
+    long flush_timer;
+    FileJob *slots[RING_FILES];
+    int free_slots[RING_FILES];
+    int free_count;
+    FileJob *pending;
+    FileJob *pending_tail;
+} FileRing;
+
+static void ring_close(FileRing *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->event_fd >= 0) close(ring->event_fd);
+    if (ring->fd >= 0) close(ring->fd);
+    ring->sqes = NULL;
+    ring->sq_ptr = ring->cq_ptr = NULL;
+    ring->fd = ring->event_fd = -1;
+}
+
+static bool ring_setup(FileRing *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring->fd < 0) return false;
+
+    // Opening into and closing registered slots needs 5.15; CQE_SKIP (5.17)
+    // is the nearest feature bit to test for it.
+    if (!(params.features & IORING_FEAT_CQE_SKIP)) return false;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            return false;
+        }
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    char *sq = (char*)ring->sq_ptr;
+    char *cq = (char*)ring->cq_ptr;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->local_tail = *ring->sq_tail;
+
+    int files[RING_FILES];
+    for (int i = 0; i < RING_FILES; i++) {
+        files[i] = -1;
+        ring->free_slots[i] = RING_FILES - 1 - i;
+    }
+    ring->free_count = RING_FILES;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, files, RING_FILES) != 0) {
+        return false;
+    }
+
+    ring->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->event_fd < 0) return false;
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_EVENTFD, &ring->event_fd, 1) == 0;
+}
+
+static struct io_uring_sqe *ring_next_sqe(FileRing *ring, int slot, int stage) {
+    unsigned index = ring->local_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = ((unsigned long long)slot << 2) | (unsigned)stage;
+    ring->sq_array[index] = index;
+    ring->local_tail++;
+    ring->to_submit++;
+    return sqe;
+}
+
+// Moves waiting jobs into free slots while the submission queue has room.
+static void ring_fill(FileRing *ring) {
+    while (ring->pending && ring->free_count > 0) {
+        unsigned used = ring->local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_entries - used < 3) break;
+
+        FileJob *job = ring->pending;
+        ring->pending = job->next;
+        if (!ring->pending) ring->pending_tail = NULL;
+
+        int slot = ring->free_slots[--ring->free_count];
+        ring->slots[slot] = job;
+        job->slot = slot;
+
+        struct io_uring_sqe *sqe = ring_next_sqe(ring, slot, STAGE_OPEN);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long long)(uintptr_t)job->path;
+        sqe->len = 0666;
+        sqe->open_flags = (job->op == FILE_BATCH_READ) ? O_RDONLY
+                        : (job->op == FILE_BATCH_WRITE) ? (O_WRONLY | O_CREAT | O_TRUNC)
+                        : (O_WRONLY | O_CREAT | O_APPEND);
+        sqe->file_index = (unsigned)slot + 1;
+        // A failed open cancels the rest of the chain, close included.
+        sqe->flags = IOSQE_IO_LINK;
+
+        sqe = ring_next_sqe(ring, slot, STAGE_IO);
+        sqe->opcode = (job->op == FILE_BATCH_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->fd = slot;
+        sqe->addr = (unsigned long long)(uintptr_t)job->data;
+        sqe->len = (job->op == FILE_BATCH_READ) ? MAX_STRING_LEN - 1 : (unsigned)job->len;
+        sqe->off = (job->op == FILE_BATCH_APPEND) ? (unsigned long long)-1 : 0;
+        // A failed read or write still closes the slot.
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+        sqe = ring_next_sqe(ring, slot, STAGE_CLOSE);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = (unsigned)slot + 1;
+    }
+}
+
+static void ring_submit(FileRing *ring, unsigned wait) {
+    __atomic_store_n(ring->sq_tail, ring->local_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    if (ring->to_submit == 0 && !wait) return;
+
+    long submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait, flags, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted > 0) {
+        ring->to_submit -= (unsigned)submitted;
+    }
+}
+
+// Collects the jobs whose chain has finished. The close is always the last
+// completion of a chain, including a cancelled one.
+static FileJob *ring_reap(FileRing *ring) {
+    FileJob *done = NULL;
+    FileJob **done_tail = &done;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        int slot = (int)(cqe->user_data >> 2);
+        int stage = (int)(cqe->user_data & 3);
+        FileJob *job = ring->slots[slot];
+
+        if (stage == STAGE_OPEN) {
+            if (cqe->res < 0) job->result = cqe->res;
+        } else if (stage == STAGE_IO) {
+            if (job->result >= 0) job->result = cqe->res;
+        } else {
+            ring->slots[slot] = NULL;
+            ring->free_slots[ring->free_count++] = slot;
+            job->next = NULL;
+            *done_tail = job;
+            done_tail = &job->next;
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return done;
+}
+
+static void on_ready(int fd, int events, void *data) {
+    (void)fd;
+    (void)events;
+    FileRing *ring = (FileRing*)data;
+    uint64_t count;
+    ssize_t got = read(ring->event_fd, &count, sizeof(count));
+    (void)got;
+
+    FileJob *done = ring_reap(ring);
+    ring_fill(ring);
+    ring_submit(ring, 0);
+
+    // Settling runs script callbacks, which may queue more work.
+    while (done) {
+        FileJob *next = done->next;
+        job_settle(done);
+        done = next;
+    }
+}
+
+static void on_flush(void *data) {
+    FileRing *ring = (FileRing*)data;
+    ring->flush_timer = 0;
+    ring_submit(ring, 0);
+}
+
+// NULL when io_uring is unavailable; the first failure is remembered.
+static FileRing *ring_get(EventLoop *loop) {
+    FileRing *ring = nac_ctx->files;
+    if (ring) return (ring->fd >= 0) ? ring : NULL;
+
+    ring = (FileRing*)calloc(1, sizeof(FileRing));
+    ring->fd = -1;
+    ring->event_fd = -1;
+    nac_ctx->files = ring;
+
+    if (!ring_setup(ring) || !event_loop_watch(loop, ring->event_fd, LOOP_READ, on_ready, ring, false)) {
+        ring_close(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+static bool ring_queue(EventLoop *loop, FileJob *job) {
+    FileRing *ring = ring_get(loop);
+    if (!ring) return false;
+
+    event_loop_hold(loop, 1);
+    job->next = NULL;
+    if (ring->pending_tail) ring->pending_tail->next = job;
+    else ring->pending = job;
+    ring->pending_tail = job;
+
+    // Everything queued before the script next waits goes in one submission.
+    ring_fill(ring);
+    if (ring->to_submit > 0 && !ring->flush_timer) {
+        ring->flush_timer = event_loop_timer(loop, 0, 0, on_flush, ring, NULL, false);
+    }
+    return true;
+}
+
+// The kernel may still be writing into job buffers, so in-flight chains
+// are waited for; jobs that never started are dropped.
+static void ring_free(FileRing *ring) {
+    while (ring->pending) {
+        FileJob *job = ring->pending;
+        ring->pending = job->next;
+        job_discard(job);
+    }
+    if (ring->fd >= 0) {
+        while (ring->free_count < RING_FILES) {
+            ring_submit(ring, 1);
+            FileJob *done = ring_reap(ring);
+            while (done) {
+                FileJob *next = done->next;
+                job_discard(done);
+                done = next;
+            }
+        }
+    }
+    ring_close(ring);
+    free(ring);
+}
+
+#else
+
+typedef struct FileRing FileRing;
+
+static bool ring_queue(EventLoop *loop, FileJob *job) {
+    (void)loop;
+    (void)job;
+    return false;
+}
+
+static void ring_free(FileRing *ring) {
+    (void)ring;
+}
+
+#endif
+
+static void finish_blocking(void *data) {
+    job_settle((FileJob*)data);
+}
+
+static void run_blocking(PoolWork *work) {
+    FileJob *job = (FileJob*)work;
+    job_run_blocking(job);
+    event_loop_post(job->loop, finish_blocking, job_discard, job);
+}
+
+// io_uring where available, otherwise a blocking call on a pool thread.
+// Without an event loop the job runs and settles right here.
+static void job_start(FileJob *job) {
+    EventLoop *loop = event_loop_get();
+    if (!loop) {
+        job_run_blocking(job);
+        job_settle(job);
+        return;
+    }
+
+    job->loop = loop;
+    if (ring_queue(loop, job)) return;
+
+    event_loop_expect_post(loop);
+    job->work.run = run_blocking;
+    thread_pool_submit(&job->work);
+}
+
+static FileJob *job_create(FileBatch *batch, int index, const char *path) {
+    FileJob *job = (FileJob*)calloc(1, sizeof(FileJob));
+    job->batch = batch;
+    job->op = batch->op;
+    job->index = index;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    return job;
+}
+
+static void content_text(Value v, char *out, size_t size) {
+    if (v.type == TYPE_STRING) {
+        snprintf(out, size, "%s", v.str_val);
+    } else if (v.type == TYPE_INT) {
+        snprintf(out, size, "%d", v.int_val);
+    } else if (v.type == TYPE_FLOAT) {
+        snprintf(out, size, "%g", v.float_val);
+    } else {
+        out[0] = '\0';
+    }
+}
+
+// Settles with one result per path, in order: the content (0 if the file
+// could not be read) or the bytes written (-1 on failure). callback, if
+// given, is called as callback(path, result) as each file completes.
+Value file_batch_start(FileBatchOp op, Value paths, Value contents, const char *callback) {
+    if (paths.type != TYPE_ARRAY) {
+        report_error("File batch requires an array of paths");
+        return make_int(0);
+    }
+    int count = paths.array_val.size;
+    for (int i = 0; i < count; i++) {
+        if (paths.array_val.elements[i].type != TYPE_STRING) {
+            report_error("File batch paths must be strings");
+            return make_int(0);
+        }
+    }
+    if (op != FILE_BATCH_READ && (contents.type != TYPE_ARRAY || contents.array_val.size != count)) {
+        report_error("File batch requires one content per path");
+        return make_int(0);
+    }
+    Value results = make_array(count);
+    if (results.array_val.size < count) {
+        return make_int(0);
+    }
+
+    FileBatch *batch = (FileBatch*)calloc(1, sizeof(FileBatch));
+    batch->op = op;
+    batch->promise = promise_create();
+    batch->remaining = count;
+    batch->results = results;
+    if (callback) {
+        snprintf(batch->callback, sizeof(batch->callback), "%s", callback);
+    }
+
+    int promise = batch->promise;
+    if (count == 0) {
+        promise_resolve(promise, batch->results);
+        free(batch);
+        return make_int(promise);
+    }
+
+    for (int i = 0; i < count; i++) {
+        FileJob *job = job_create(batch, i, paths.array_val.elements[i].str_val);
+        if (op != FILE_BATCH_READ) {
+            content_text(contents.array_val.elements[i], job->data, sizeof(job->data));
+            job->len = (int)strlen(job->data);
+        }
+        job_start(job);
+    }
+    return make_int(promise);
+}
+
+Value file_batch_read_one(const char *path) {
+    FileBatch *batch = (FileBatch*)calloc(1, sizeof(FileBatch));
+    batch->op = FILE_BATCH_READ;
+    batch->promise = promise_create();
+    batch->single = true;
+    batch->remaining = 1;
+
+    int promise = batch->promise;
+    job_start(job_create(batch, 0, path));
+    return make_int(promise);
+}
+
+void file_batch_free(NacContext *ctx) {
+    if (!ctx->files) return;
+
+    NacContext *previous = context_enter(ctx);
+    ring_free(ctx->files);
+    ctx->files = NULL;
+    context_enter(previous);
+}
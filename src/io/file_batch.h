@@ -0,0 +1,18 @@
+#ifndef NAC_FILE_BATCH_H
+#define NAC_FILE_BATCH_H
+
+#include "../runtime/value.h"
+
+struct NacContext;
+
+typedef enum {
+    FILE_BATCH_READ,
+    FILE_BATCH_WRITE,
+    FILE_BATCH_APPEND
+} FileBatchOp;
+
+Value file_batch_start(FileBatchOp op, Value paths, Value contents, const char *callback);
+Value file_batch_read_one(const char *path);
+void file_batch_free(struct NacContext *ctx);
+
+#endif
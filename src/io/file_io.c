@@ -3,21 +3,86 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-char *read_file(const char *filename) {
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+char *try_read_file(const char *filename) {
     FILE *f = fopen(filename, "rb");
     if (!f) {
-        fprintf(stderr, "Cannot open file: %s\n", filename);
-        exit(1);
+        return NULL;
     }
 
     fseek(f, 0, SEEK_END);
     long size = ftell(f);
     fseek(f, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
 
     char *content = (char*)malloc(size + 1);
-    fread(content, 1, size, f);
-    content[size] = '\0';
+    size_t got = fread(content, 1, size, f);
+    content[got] = '\0';
 
     fclose(f);
     return content;
 }
+
+char *read_file(const char *filename) {
+    char *content = try_read_file(filename);
+    if (!content) {
+        fprintf(stderr, "Cannot open file: %s\n", filename);
+        exit(1);
+    }
+    return content;
+}
+
+bool map_file(const char *path, void **data, size_t *len) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    *data = mapped;
+    *len = (size_t)st.st_size;
+    return true;
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(f);
+        return false;
+    }
+
+    *data = malloc(size);
+    *len = fread(*data, 1, size, f);
+    fclose(f);
+    return true;
+#endif
+}
+
+void unmap_file(void *data, size_t len) {
+#ifndef _WIN32
+    munmap(data, len);
+#else
+    (void)len;
+    free(data);
+#endif
+}
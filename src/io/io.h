@@ -1,7 +1,13 @@
 #ifndef NAC_IO_H
 #define NAC_IO_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 char *read_file(const char *filename);
+char *try_read_file(const char *filename);
+bool map_file(const char *path, void **data, size_t *len);
+void unmap_file(void *data, size_t len);
 void console_print(const char *text);
 int console_read_line(char *buffer, int size);
 
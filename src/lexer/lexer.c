@@ -1,97 +1,221 @@
 #include "lexer.h"
 
 #include <ctype.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../core/interpreter.h"
 #include "../util/error.h"
+#include "../util/memory.h"
 
-static Token *tokens = NULL;
-static int token_count = 0;
-static int token_capacity = 0;
-static int token_pos = 0;
+#define CHAR_SPACE 0x01
+#define CHAR_DIGIT 0x02
+#define CHAR_IDENT_START 0x04
+#define CHAR_IDENT 0x08
 
-static int current_line = 1;
-static int current_col = 1;
+#define TEXT_CHUNK_SIZE 65536
+#define KEYWORD_SLOTS 32
 
-static void advance(void) {
-    if (pos < code_len) {
-        if (code[pos] == '\n') {
-            current_line++;
-            current_col = 1;
-        } else {
-            current_col++;
-        }
-        pos++;
+typedef struct TextChunk {
+    struct TextChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} TextChunk;
+
+typedef struct {
+    const char *word;
+    int len;
+    NaCTokenType type;
+} Keyword;
+
+typedef struct {
+    const char *src;
+    int pos;
+    int len;
+    int line;
+    int line_start;
+    Token *tok;
+    LexerState *lx;
+} Scanner;
+
+static unsigned char char_class[256];
+static Keyword keyword_table[KEYWORD_SLOTS];
+static atomic_int tables_state = 0;
+
+// Perfect hash over the keyword set: (first + last + 5 * len) & 31 is
+// collision-free for every keyword, so a lookup is one probe and one memcmp.
+static unsigned int keyword_hash(const char *s, int len) {
+    return ((unsigned char)s[0] + (unsigned char)s[len - 1] + 5u * (unsigned int)len) & (KEYWORD_SLOTS - 1);
+}
+
+static void add_keyword(const char *word, NaCTokenType type) {
+    int len = (int)strlen(word);
+    Keyword *slot = &keyword_table[keyword_hash(word, len)];
+    slot->word = word;
+    slot->len = len;
+    slot->type = type;
+}
+
+// Built once per process; contexts on other threads wait for the first one.
+static void init_tables(void) {
+    if (atomic_load_explicit(&tables_state, memory_order_acquire) == 2) return;
+
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&tables_state, &expected, 1)) {
+        while (atomic_load_explicit(&tables_state, memory_order_acquire) != 2) {}
+        return;
+    }
+
+    for (int c = 0; c < 256; c++) {
+        unsigned char cls = 0;
+        if (isspace(c)) cls |= CHAR_SPACE;
+        if (isdigit(c)) cls |= CHAR_DIGIT | CHAR_IDENT;
+        if (isalpha(c) || c == '_') cls |= CHAR_IDENT_START | CHAR_IDENT;
+        char_class[c] = cls;
+    }
+    char_class['$'] |= CHAR_IDENT_START;
+
+    add_keyword("fn", TOK_FN);
+    add_keyword("rn", TOK_RN);
+    add_keyword("if", TOK_IF);
+    add_keyword("for", TOK_FOR);
+    add_keyword("while", TOK_WHILE);
+    add_keyword("in", TOK_IN);
+    add_keyword("out", TOK_OUT);
+    add_keyword("time", TOK_TIME);
+    add_keyword("break", TOK_BREAK);
+    add_keyword("continue", TOK_CONTINUE);
+    add_keyword("array", TOK_ARRAY);
+    add_keyword("http", TOK_HTTP);
+    add_keyword("import", TOK_IMPORT);
+    add_keyword("async", TOK_ASYNC);
+    add_keyword("await", TOK_AWAIT);
+    add_keyword("yield", TOK_YIELD);
+
+    atomic_store_explicit(&tables_state, 2, memory_order_release);
+}
+
+static NaCTokenType lookup_keyword(const char *s, int len) {
+    const Keyword *kw = &keyword_table[keyword_hash(s, len)];
+    if (kw->len == len && memcmp(kw->word, s, len) == 0) {
+        return kw->type;
+    }
+    return TOK_IDENT;
+}
+
+static const char *store_text(LexerState *lx, const char *s, size_t len) {
+    TextChunk *head = lx->text_chunks;
+    if (!head || head->used + len + 1 > head->capacity) {
+        size_t capacity = (len + 1 > TEXT_CHUNK_SIZE) ? len + 1 : TEXT_CHUNK_SIZE;
+        TextChunk *chunk = (TextChunk*)nac_alloc(MEM_TOKEN, sizeof(TextChunk) + capacity);
+        chunk->next = head;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        lx->text_chunks = head = chunk;
     }
+
+    char *dst = head->data + head->used;
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    head->used += len + 1;
+    return dst;
 }
 
-static void skip_whitespace_and_comments(void) {
-    while (pos < code_len) {
-        while (pos < code_len && isspace(code[pos])) {
-            advance();
+static void free_text_chunks(LexerState *lx) {
+    while (lx->text_chunks) {
+        TextChunk *next = lx->text_chunks->next;
+        nac_free(lx->text_chunks);
+        lx->text_chunks = next;
+    }
+}
+
+static void new_line_at(Scanner *sc, int newline_pos) {
+    sc->line++;
+    sc->line_start = newline_pos + 1;
+}
+
+static void skip_whitespace_and_comments(Scanner *sc) {
+    const char *src = sc->src;
+    int p = sc->pos;
+    int end = sc->len;
+
+    while (p < end) {
+        // Indentation: consume runs of spaces eight bytes at a time.
+        while (p + 8 <= end) {
+            unsigned long long word;
+            memcpy(&word, src + p, sizeof(word));
+            if (word != 0x2020202020202020ULL) break;
+            p += 8;
         }
-        if (pos < code_len - 1 && code[pos] == '/' && code[pos + 1] == '/') {
-            while (pos < code_len && code[pos] != '\n') {
-                advance();
-            }
+
+        unsigned char c = (unsigned char)src[p];
+        if (char_class[c] & CHAR_SPACE) {
+            if (c == '\n') new_line_at(sc, p);
+            p++;
+            continue;
+        }
+
+        if (c == '/' && p + 1 < end && src[p + 1] == '/') {
+            const char *nl = (const char*)memchr(src + p + 2, '\n', end - p - 2);
+            p = nl ? (int)(nl - src) : end;
             continue;
         }
+
         break;
     }
-}
-
-static void scan_token(void) {
-    skip_whitespace_and_comments();
 
-    current_token.line = current_line;
-    current_token.col = current_col;
+    sc->pos = p;
+}
 
-    if (pos >= code_len) {
-        current_token.type = TOK_EOF;
-        return;
-    }
+// Scans the token at pos into sc->tok and returns the position after it,
+// or -1 if pos holds a character that starts no token.
+static int scan_at(Scanner *sc, int pos) {
+    const char *code = sc->src;
+    int code_len = sc->len;
+    Token *tok = sc->tok;
 
-    char c = code[pos];
+    unsigned char c = (unsigned char)code[pos];
 
-    if (isdigit(c) || (c == '-' && pos + 1 < code_len && isdigit(code[pos + 1]))) {
+    if ((char_class[c] & CHAR_DIGIT) ||
+        (c == '-' && pos + 1 < code_len && (char_class[(unsigned char)code[pos + 1]] & CHAR_DIGIT))) {
         int sign = 1;
         if (c == '-') {
             sign = -1;
-            advance();
+            pos++;
         }
 
         double value = 0;
-        while (pos < code_len && isdigit(code[pos])) {
+        while (pos < code_len && (char_class[(unsigned char)code[pos]] & CHAR_DIGIT)) {
             value = value * 10 + (code[pos] - '0');
-            advance();
+            pos++;
         }
 
         if (pos < code_len && code[pos] == '.') {
-            advance();
+            pos++;
             double decimal = 0.1;
-            while (pos < code_len && isdigit(code[pos])) {
+            while (pos < code_len && (char_class[(unsigned char)code[pos]] & CHAR_DIGIT)) {
                 value += (code[pos] - '0') * decimal;
                 decimal *= 0.1;
-                advance();
+                pos++;
             }
-            current_token.type = TOK_FLOAT;
-            current_token.float_val = sign * value;
+            tok->type = TOK_FLOAT;
+            tok->float_val = sign * value;
         } else {
-            current_token.type = TOK_INT;
-            current_token.int_val = sign * (int)value;
+            tok->type = TOK_INT;
+            tok->int_val = sign * (int)value;
         }
-        return;
+        return pos;
     }
 
     if (c == '"') {
-        advance();
+        pos++;
         char str[MAX_STRING_LEN];
         int len = 0;
         while (pos < code_len && code[pos] != '"' && len < MAX_STRING_LEN - 1) {
             if (code[pos] == '\\' && pos + 1 < code_len) {
-                advance();
+                pos++;
                 switch (code[pos]) {
                     case 'n': str[len++] = '\n'; break;
                     case 't': str[len++] = '\t'; break;
@@ -102,136 +226,277 @@ static void scan_token(void) {
             } else {
                 str[len++] = code[pos];
             }
-            advance();
+            if (code[pos] == '\n') new_line_at(sc, pos);
+            pos++;
         }
-        str[len] = '\0';
-        if (pos < code_len && code[pos] == '"') advance();
-        current_token.type = TOK_STRING;
-        strncpy(current_token.str_val, str, MAX_STRING_LEN - 1);
-        return;
+        if (pos < code_len && code[pos] == '"') pos++;
+        tok->type = TOK_STRING;
+        tok->str_val = store_text(sc->lx, str, len);
+        return pos;
     }
 
-    if (isalpha(c) || c == '_' || c == '$') {
+    if (char_class[c] & CHAR_IDENT_START) {
         int start = pos;
-        while (pos < code_len && (isalnum(code[pos]) || code[pos] == '_')) {
-            advance();
+        pos++;
+        while (pos < code_len && (char_class[(unsigned char)code[pos]] & CHAR_IDENT)) {
+            pos++;
+        }
+        // Qualified names such as `math.square` refer to imported functions.
+        while (pos + 1 < code_len && code[pos] == '.' && (char_class[(unsigned char)code[pos + 1]] & CHAR_IDENT_START)) {
+            pos += 2;
+            while (pos < code_len && (char_class[(unsigned char)code[pos]] & CHAR_IDENT)) {
+                pos++;
+            }
         }
         int len = pos - start;
-        char ident[MAX_TOKEN_LEN];
-        strncpy(ident, &code[start], len);
-        ident[len] = '\0';
-
-        if (strcmp(ident, "fn") == 0) { current_token.type = TOK_FN; return; }
-        if (strcmp(ident, "rn") == 0) { current_token.type = TOK_RN; return; }
-        if (strcmp(ident, "if") == 0) { current_token.type = TOK_IF; return; }
-        if (strcmp(ident, "for") == 0) { current_token.type = TOK_FOR; return; }
-        if (strcmp(ident, "while") == 0) { current_token.type = TOK_WHILE; return; }
-        if (strcmp(ident, "in") == 0) { current_token.type = TOK_IN; return; }
-        if (strcmp(ident, "out") == 0) { current_token.type = TOK_OUT; return; }
-        if (strcmp(ident, "time") == 0) { current_token.type = TOK_TIME; return; }
-        if (strcmp(ident, "break") == 0) { current_token.type = TOK_BREAK; return; }
-        if (strcmp(ident, "continue") == 0) { current_token.type = TOK_CONTINUE; return; }
-        if (strcmp(ident, "array") == 0) { current_token.type = TOK_ARRAY; return; }
-        if (strcmp(ident, "http") == 0) { current_token.type = TOK_HTTP; return; }
-
-        current_token.type = TOK_IDENT;
-        strncpy(current_token.ident, ident, MAX_TOKEN_LEN - 1);
-        return;
+
+        NaCTokenType type = lookup_keyword(&code[start], len);
+        tok->type = type;
+        // Contextual keywords keep their text in case they turn out to be names.
+        if (type == TOK_IDENT || type >= TOK_IMPORT) {
+            if (len > MAX_TOKEN_LEN - 1) len = MAX_TOKEN_LEN - 1;
+            tok->ident = store_text(sc->lx, &code[start], len);
+        }
+        return pos;
     }
 
     if (c == '+') {
         if (pos + 1 < code_len && code[pos + 1] == '+') {
-            advance(); advance(); current_token.type = TOK_PLUSPLUS; return;
+            pos += 2; tok->type = TOK_PLUSPLUS; return pos;
         }
-        advance(); current_token.type = TOK_PLUS; return;
+        pos++; tok->type = TOK_PLUS; return pos;
     }
     if (c == '-') {
         if (pos + 1 < code_len && code[pos + 1] == '-') {
-            advance(); advance(); current_token.type = TOK_MINUSMINUS; return;
+            pos += 2; tok->type = TOK_MINUSMINUS; return pos;
         }
-        advance(); current_token.type = TOK_MINUS; return;
+        pos++; tok->type = TOK_MINUS; return pos;
     }
-    if (c == '*') { advance(); current_token.type = TOK_STAR; return; }
-    if (c == '/') { advance(); current_token.type = TOK_SLASH; return; }
-    if (c == '%') { advance(); current_token.type = TOK_PERCENT; return; }
+    if (c == '*') { pos++; tok->type = TOK_STAR; return pos; }
+    if (c == '/') { pos++; tok->type = TOK_SLASH; return pos; }
+    if (c == '%') { pos++; tok->type = TOK_PERCENT; return pos; }
     if (c == '=') {
         if (pos + 1 < code_len && code[pos + 1] == '=') {
-            advance(); advance(); current_token.type = TOK_EQ; return;
+            pos += 2; tok->type = TOK_EQ; return pos;
         }
-        advance(); current_token.type = TOK_ASSIGN; return;
+        pos++; tok->type = TOK_ASSIGN; return pos;
     }
     if (c == '!') {
         if (pos + 1 < code_len && code[pos + 1] == '=') {
-            advance(); advance(); current_token.type = TOK_NEQ; return;
+            pos += 2; tok->type = TOK_NEQ; return pos;
         }
-        advance(); current_token.type = TOK_NOT; return;
+        pos++; tok->type = TOK_NOT; return pos;
     }
     if (c == '<') {
         if (pos + 1 < code_len && code[pos + 1] == '=') {
-            advance(); advance(); current_token.type = TOK_LTE; return;
+            pos += 2; tok->type = TOK_LTE; return pos;
         }
-        advance(); current_token.type = TOK_LT; return;
+        pos++; tok->type = TOK_LT; return pos;
     }
     if (c == '>') {
         if (pos + 1 < code_len && code[pos + 1] == '=') {
-            advance(); advance(); current_token.type = TOK_GTE; return;
+            pos += 2; tok->type = TOK_GTE; return pos;
         }
-        advance(); current_token.type = TOK_GT; return;
+        pos++; tok->type = TOK_GT; return pos;
     }
     if (c == '&' && pos + 1 < code_len && code[pos + 1] == '&') {
-        advance(); advance(); current_token.type = TOK_AND; return;
+        pos += 2; tok->type = TOK_AND; return pos;
     }
     if (c == '|' && pos + 1 < code_len && code[pos + 1] == '|') {
-        advance(); advance(); current_token.type = TOK_OR; return;
+        pos += 2; tok->type = TOK_OR; return pos;
     }
-    if (c == ';') { advance(); current_token.type = TOK_SEMI; return; }
-    if (c == ',') { advance(); current_token.type = TOK_COMMA; return; }
-    if (c == '(') { advance(); current_token.type = TOK_LPAREN; return; }
-    if (c == ')') { advance(); current_token.type = TOK_RPAREN; return; }
-    if (c == '{') { advance(); current_token.type = TOK_LBRACE; return; }
-    if (c == '}') { advance(); current_token.type = TOK_RBRACE; return; }
-    if (c == '[') { advance(); current_token.type = TOK_LBRACKET; return; }
-    if (c == ']') { advance(); current_token.type = TOK_RBRACKET; return; }
-    if (c == ':') { advance(); current_token.type = TOK_COLON; return; }
+    if (c == ';') { pos++; tok->type = TOK_SEMI; return pos; }
+    if (c == ',') { pos++; tok->type = TOK_COMMA; return pos; }
+    if (c == '(') { pos++; tok->type = TOK_LPAREN; return pos; }
+    if (c == ')') { pos++; tok->type = TOK_RPAREN; return pos; }
+    if (c == '{') { pos++; tok->type = TOK_LBRACE; return pos; }
+    if (c == '}') { pos++; tok->type = TOK_RBRACE; return pos; }
+    if (c == '[') { pos++; tok->type = TOK_LBRACKET; return pos; }
+    if (c == ']') { pos++; tok->type = TOK_RBRACKET; return pos; }
+    if (c == ':') { pos++; tok->type = TOK_COLON; return pos; }
 
-    report_error("Unknown character");
-    advance();
-    scan_token();
+    return -1;
 }
 
-void init_lexer(void) {
-    if (tokens) {
-        free(tokens);
+static void scan_token(Scanner *sc) {
+    for (;;) {
+        skip_whitespace_and_comments(sc);
+
+        Token *tok = sc->tok;
+        tok->line = sc->line;
+        tok->col = sc->pos - sc->line_start + 1;
+        tok->match = -1;
+
+        if (sc->pos >= sc->len) {
+            tok->type = TOK_EOF;
+            return;
+        }
+
+        int next = scan_at(sc, sc->pos);
+        if (next >= 0) {
+            sc->pos = next;
+            return;
+        }
+
+        report_error("Unknown character");
+        sc->pos++;
+    }
+}
+
+static bool starts_statement(const Token *tokens, int i) {
+    if (i == 0) return true;
+    NaCTokenType prev = tokens[i - 1].type;
+    return prev == TOK_SEMI || prev == TOK_LBRACE || prev == TOK_RBRACE;
+}
+
+static bool starts_operand(NaCTokenType type) {
+    switch (type) {
+        case TOK_IDENT: case TOK_INT: case TOK_FLOAT: case TOK_STRING:
+        case TOK_LPAREN: case TOK_AWAIT: case TOK_TIME: case TOK_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether tokens[i] is the name in `name = ...`, `name++` or `name[...] = ...`.
+static bool is_assigned(const Token *tokens, int count, int i) {
+    NaCTokenType next = tokens[i + 1].type;
+    if (next == TOK_ASSIGN || next == TOK_PLUSPLUS || next == TOK_MINUSMINUS) return true;
+    if (next != TOK_LBRACKET) return false;
+
+    int depth = 0;
+    for (int j = i + 1; j < count; j++) {
+        if (tokens[j].type == TOK_LBRACKET) depth++;
+        else if (tokens[j].type == TOK_RBRACKET && --depth == 0) {
+            return j + 1 < count && tokens[j + 1].type == TOK_ASSIGN;
+        }
+    }
+    return false;
+}
+
+// import, async, await and yield are keywords only where they begin their
+// construct; anywhere else they are ordinary names, so scripts written
+// before they existed still parse.
+static void resolve_contextual(LexerState *lx) {
+    Token *tokens = lx->tokens;
+    int count = lx->token_count;
+
+    for (int i = 0; i + 1 < count; i++) {
+        Token *tok = &tokens[i];
+        if (tok->type < TOK_IMPORT) continue;
+
+        NaCTokenType next = tokens[i + 1].type;
+        bool named = i > 0 && tokens[i - 1].type == TOK_FN;
+        bool keyword = false;
+        switch (tok->type) {
+            case TOK_IMPORT:
+                keyword = next == TOK_STRING;
+                break;
+            case TOK_ASYNC:
+                keyword = next == TOK_FN;
+                break;
+            case TOK_AWAIT:
+                keyword = !named && starts_operand(next);
+                break;
+            case TOK_YIELD:
+                keyword = starts_statement(tokens, i) && !is_assigned(tokens, count, i);
+                break;
+            default:
+                break;
+        }
+        if (!keyword) {
+            tok->type = TOK_IDENT;
+        }
     }
-    token_capacity = 1024;
-    tokens = malloc(sizeof(Token) * token_capacity);
-    token_count = 0;
-    token_pos = 0;
-    current_line = 1;
-    current_col = 1;
+}
+
+void init_lexer(void) {
+    init_tables();
+    free_lexer();
+
+    LexerState *lx = &nac_ctx->lexer;
+    lx->token_capacity = 1024;
+    lx->tokens = nac_alloc(MEM_TOKEN, sizeof(Token) * lx->token_capacity);
+    lx->token_count = 0;
+    lx->token_pos = 0;
+
+    Scanner sc;
+    sc.src = nac_ctx->code;
+    sc.pos = 0;
+    sc.len = nac_ctx->code_len;
+    sc.line = 1;
+    sc.line_start = 0;
+    sc.tok = &nac_ctx->current_token;
+    sc.lx = lx;
 
-    // Build token array
+    int brace_capacity = 64;
+    int brace_depth = 0;
+    int *open_braces = (int*)nac_alloc(MEM_TOKEN, sizeof(int) * brace_capacity);
+
+    // Build token array, pairing each '{' with its closing '}' so function
+    // bodies can be skipped without parsing them.
     do {
-        scan_token();
-        if (token_count >= token_capacity) {
-            token_capacity *= 2;
-            tokens = realloc(tokens, sizeof(Token) * token_capacity);
+        scan_token(&sc);
+        if (lx->token_count >= lx->token_capacity) {
+            lx->token_capacity *= 2;
+            lx->tokens = nac_realloc(MEM_TOKEN, lx->tokens, sizeof(Token) * lx->token_capacity);
         }
-        tokens[token_count++] = current_token;
-    } while (current_token.type != TOK_EOF);
+
+        if (sc.tok->type == TOK_LBRACE) {
+            if (brace_depth >= brace_capacity) {
+                brace_capacity *= 2;
+                open_braces = (int*)nac_realloc(MEM_TOKEN, open_braces, sizeof(int) * brace_capacity);
+            }
+            open_braces[brace_depth++] = lx->token_count;
+        } else if (sc.tok->type == TOK_RBRACE && brace_depth > 0) {
+            int open = open_braces[--brace_depth];
+            lx->tokens[open].match = lx->token_count;
+            sc.tok->match = open;
+        }
+
+        lx->tokens[lx->token_count++] = *sc.tok;
+    } while (sc.tok->type != TOK_EOF);
+
+    nac_free(open_braces);
+    resolve_contextual(lx);
 }
 
 void free_lexer(void) {
-    if (tokens) {
-        free(tokens);
-        tokens = NULL;
+    LexerState *lx = &nac_ctx->lexer;
+    if (lx->tokens) {
+        nac_free(lx->tokens);
+        lx->tokens = NULL;
+    }
+    lx->token_count = 0;
+    lx->token_pos = 0;
+    free_text_chunks(lx);
+}
+
+int lexer_token_count(void) {
+    return nac_ctx->lexer.token_count;
+}
+
+int lexer_position(void) {
+    return nac_ctx->lexer.token_pos - 1;
+}
+
+void lexer_seek(int index) {
+    LexerState *lx = &nac_ctx->lexer;
+    if (index >= 0 && index < lx->token_count) {
+        lx->token_pos = index;
+        next_token();
+    } else {
+        lx->token_pos = lx->token_count;
+        nac_ctx->current_token.type = TOK_EOF;
     }
 }
 
 void next_token(void) {
-    if (token_pos < token_count) {
-        current_token = tokens[token_pos++];
+    LexerState *lx = &nac_ctx->lexer;
+    if (lx->token_pos < lx->token_count) {
+        nac_ctx->current_token = lx->tokens[lx->token_pos++];
     } else {
-        current_token.type = TOK_EOF;
+        nac_ctx->current_token.type = TOK_EOF;
     }
 }
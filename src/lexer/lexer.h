@@ -1,8 +1,23 @@
 #ifndef NAC_LEXER_H
 #define NAC_LEXER_H
 
+#include "token.h"
+
+struct TextChunk;
+
+typedef struct {
+    Token *tokens;
+    int token_count;
+    int token_capacity;
+    int token_pos;
+    struct TextChunk *text_chunks;
+} LexerState;
+
 void init_lexer(void);
 void free_lexer(void);
 void next_token(void);
+int lexer_token_count(void);
+int lexer_position(void);
+void lexer_seek(int index);
 
 #endif
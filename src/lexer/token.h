@@ -47,18 +47,24 @@ typedef enum {
     TOK_CONTINUE,
     TOK_ARRAY,
     TOK_WHILE,
-    TOK_HTTP
+    TOK_HTTP,
+    // Contextual keywords, resolved by the lexer; they must stay last.
+    TOK_IMPORT,
+    TOK_ASYNC,
+    TOK_AWAIT,
+    TOK_YIELD
 } NaCTokenType;
 
 typedef struct {
     NaCTokenType type;
     int line;
     int col;
+    int match;
     union {
         int int_val;
         double float_val;
-        char str_val[MAX_STRING_LEN];
-        char ident[MAX_TOKEN_LEN];
+        const char *str_val;
+        const char *ident;
     };
 } Token;
 
@@ -1,13 +1,110 @@
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "core/interpreter.h"
+#include "core/program_cache.h"
+#include "core/snapshot.h"
 #include "io/io.h"
+#include "server/protocol.h"
+#include "server/server.h"
+#include "util/heap_profile.h"
+#include "util/memory.h"
+#include "util/thread_pool.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+static void print_usage(const char *prog) {
+    printf("NaC Language Interpreter (%s)\n", NAC_VERSION);
+    printf("Usage: %s [options] <file.nac> [args...]\n", prog);
+    printf("       %s --serve[=socket] [--workers=N] [--snapshot=<path>]\n\n", prog);
+    printf("Options:\n");
+    printf("  --cache                Reuse the compiled program from <file.nac>c when the\n");
+    printf("                         source is unchanged, and refresh it when it is not\n");
+    printf("  --check                Parse the whole script, including every function body,\n");
+    printf("                         and report syntax errors without running it\n");
+    printf("  --save-snapshot=<path> After the script finishes, save its functions, globals\n");
+    printf("                         and module registry to <path>\n");
+    printf("  --snapshot=<path>      Restore a saved snapshot before running the script\n");
+    printf("  --heap-profile[=path]  Write per-line allocation profile at exit or on SIGUSR1\n");
+    printf("                         (folded stacks, default %s)\n", HEAP_PROFILE_DEFAULT_PATH);
+    printf("  --max-memory=<size>    Abort the script cleanly once it owns more than <size>\n");
+    printf("                         bytes (suffixes K, M, G)\n");
+    printf("  --threads=N            Worker threads for parallelMap/parallelReduce\n");
+    printf("                         (default: one per CPU)\n");
+    printf("  --serve[=socket]       Run as a daemon that keeps compiled scripts warm and\n");
+    printf("                         runs nac-client requests (default\n");
+    printf("                         $XDG_RUNTIME_DIR/nac.sock or /tmp/nac-$UID/nac.sock)\n");
+    printf("  --workers=N            Scripts the daemon runs at once (default %d)\n\n", SERVE_DEFAULT_WORKERS);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("NaC Language Interpreter (%s)\n", NAC_VERSION);
-        printf("Usage: %s <file.nac>\n\n", argv[0]);
+    const char *script = NULL;
+    const char *heap_profile_path = NULL;
+    int heap_profile = 0;
+    int check_only = 0;
+    int use_cache = 0;
+    const char *save_snapshot_path = NULL;
+    const char *snapshot_path = NULL;
+    const char *serve_path = NULL;
+    char default_socket[NAC_SERVE_PATH_MAX];
+    int workers = SERVE_DEFAULT_WORKERS;
+    int script_index = 0;
+
+    for (int i = 1; i < argc && !script; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            check_only = 1;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            use_cache = 1;
+        } else if (strncmp(argv[i], "--save-snapshot=", 16) == 0) {
+            save_snapshot_path = argv[i] + 16;
+        } else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+            snapshot_path = argv[i] + 11;
+        } else if (strcmp(argv[i], "--heap-profile") == 0) {
+            heap_profile = 1;
+        } else if (strncmp(argv[i], "--heap-profile=", 15) == 0) {
+            heap_profile = 1;
+            heap_profile_path = argv[i] + 15;
+        } else if (strncmp(argv[i], "--max-memory=", 13) == 0) {
+            size_t limit = 0;
+            if (!memory_parse_size(argv[i] + 13, &limit)) {
+                fprintf(stderr, "Invalid --max-memory value: %s\n", argv[i] + 13);
+                return 1;
+            }
+            memory_set_limit(limit);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            thread_pool_configure(atoi(argv[i] + 10));
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (!serve_default_socket(default_socket, sizeof(default_socket), true)) {
+                fprintf(stderr, "Cannot use the default socket directory; pass --serve=<socket>\n");
+                return 1;
+            }
+            serve_path = default_socket;
+        } else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = atoi(argv[i] + 10);
+        } else {
+            script = argv[i];
+            script_index = i;
+        }
+    }
+
+    if (serve_path) {
+        init_interpreter();
+        int exit_code = 1;
+        if (!snapshot_path || snapshot_restore(snapshot_path)) {
+            exit_code = serve_forever(serve_path, workers);
+        }
+        shutdown_interpreter();
+        return exit_code;
+    }
+
+    if (!script) {
+        print_usage(argv[0]);
 
         get_latest();
 
@@ -20,11 +117,39 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if (heap_profile) {
+        heap_profile_start(heap_profile_path);
+    }
+
     init_interpreter();
 
-    set_source_code(read_file(argv[1]));
+    if (snapshot_path && !snapshot_restore(snapshot_path)) {
+        shutdown_interpreter();
+        return 1;
+    }
+
+    set_script_name(script);
+    set_script_args(argc - script_index - 1, argv + script_index + 1);
+    set_source_code(read_file(script));
+
+    int exit_code;
+    if (check_only) {
+        exit_code = check_interpreter();
+    } else if (use_cache) {
+        char cache_path[PATH_MAX];
+        if (program_cache_path(script, cache_path, sizeof(cache_path))) {
+            exit_code = run_interpreter_cached(cache_path);
+        } else {
+            exit_code = run_interpreter();
+        }
+    } else {
+        exit_code = run_interpreter();
+    }
+
+    if (save_snapshot_path && exit_code == 0 && !snapshot_save(save_snapshot_path)) {
+        exit_code = 1;
+    }
 
-    int exit_code = run_interpreter();
     shutdown_interpreter();
 
     return exit_code;
@@ -4,20 +4,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../core/interpreter.h"
 #include "../runtime/json.h"
 #include "../util/error.h"
+#include "../util/memory.h"
 
 #define MAX_MODULES 128
 
-typedef struct {
+typedef struct ModuleEntry {
     int used;
     char name[MAX_STRING_LEN];
     Value value;
 } ModuleEntry;
 
-static ModuleEntry registry[MAX_MODULES];
+static ModuleEntry *module_registry(void) {
+    if (!nac_ctx->modules) {
+        nac_ctx->modules = (ModuleEntry*)calloc(MAX_MODULES, sizeof(ModuleEntry));
+    }
+    return nac_ctx->modules;
+}
 
 static int find_module(const char *name) {
+    ModuleEntry *registry = module_registry();
     for (int i = 0; i < MAX_MODULES; i++) {
         if (registry[i].used && strcmp(registry[i].name, name) == 0) {
             return i;
@@ -27,6 +35,7 @@ static int find_module(const char *name) {
 }
 
 static int first_free_slot(void) {
+    ModuleEntry *registry = module_registry();
     for (int i = 0; i < MAX_MODULES; i++) {
         if (!registry[i].used) {
             return i;
@@ -68,6 +77,7 @@ int module_register(const char *name, Value module_value) {
         return 0;
     }
 
+    ModuleEntry *registry = module_registry();
     int idx = find_module(name);
     if (idx < 0) {
         idx = first_free_slot();
@@ -85,11 +95,14 @@ int module_register(const char *name, Value module_value) {
     registry[idx].used = 1;
     strncpy(registry[idx].name, name, MAX_STRING_LEN - 1);
     registry[idx].name[MAX_STRING_LEN - 1] = '\0';
+    MemCategory previous = memory_set_value_category(MEM_MODULE);
     registry[idx].value = copy_value(module_value);
+    memory_set_value_category(previous);
     return 1;
 }
 
 Value module_get_copy(const char *name, int *found) {
+    ModuleEntry *registry = module_registry();
     int idx = find_module(name);
     if (idx < 0) {
         if (found) {
@@ -174,6 +187,7 @@ Value module_require_local(const char *name, int *ok) {
 }
 
 Value module_list_names(void) {
+    ModuleEntry *registry = module_registry();
     int count = 0;
     for (int i = 0; i < MAX_MODULES; i++) {
         if (registry[i].used) {
@@ -183,7 +197,7 @@ Value module_list_names(void) {
 
     Value arr = make_array(count);
     int out_idx = 0;
-    for (int i = 0; i < MAX_MODULES; i++) {
+    for (int i = 0; i < MAX_MODULES && out_idx < arr.array_val.size; i++) {
         if (registry[i].used) {
             free_value(&arr.array_val.elements[out_idx]);
             arr.array_val.elements[out_idx] = make_string(registry[i].name);
@@ -193,3 +207,27 @@ Value module_list_names(void) {
 
     return arr;
 }
+
+void module_foreach(ModuleVisitor visit, void *ctx) {
+    ModuleEntry *registry = module_registry();
+    for (int i = 0; i < MAX_MODULES; i++) {
+        if (registry[i].used) {
+            visit(registry[i].name, registry[i].value, ctx);
+        }
+    }
+}
+
+void module_registry_free(void) {
+    ModuleEntry *registry = nac_ctx->modules;
+    if (!registry) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_MODULES; i++) {
+        if (registry[i].used) {
+            free_value(&registry[i].value);
+        }
+    }
+    free(registry);
+    nac_ctx->modules = NULL;
+}
@@ -3,10 +3,14 @@
 
 #include "../runtime/value.h"
 
+typedef void (*ModuleVisitor)(const char *name, Value value, void *ctx);
+
 int module_register(const char *name, Value module_value);
 Value module_get_copy(const char *name, int *found);
 Value module_load_json_file(const char *path, int *ok);
 Value module_require_local(const char *name, int *ok);
 Value module_list_names(void);
+void module_foreach(ModuleVisitor visit, void *ctx);
+void module_registry_free(void);
 
 #endif
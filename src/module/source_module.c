@@ -0,0 +1,244 @@
+#include "source_module.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../core/interpreter.h"
+#include "../io/io.h"
+#include "../runtime/eval.h"
+#include "../util/error.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+typedef struct {
+    char *path;
+    long long mtime;
+    long long size;
+    Program *program;
+} CachedModule;
+
+// Compiled modules are shared by every context in the process. Entries are
+// never freed: imported functions point straight at their bodies.
+static CachedModule *cache = NULL;
+static int cache_count = 0;
+static int cache_capacity = 0;
+static atomic_flag cache_lock = ATOMIC_FLAG_INIT;
+
+static void lock_cache(void) {
+    while (atomic_flag_test_and_set_explicit(&cache_lock, memory_order_acquire)) {}
+}
+
+static void unlock_cache(void) {
+    atomic_flag_clear_explicit(&cache_lock, memory_order_release);
+}
+
+static bool is_absolute(const char *path) {
+#ifdef _WIN32
+    return path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+#else
+    return path[0] == '/';
+#endif
+}
+
+// Relative imports are resolved against the importing file's directory.
+void source_module_resolve(const char *importer, const char *path, char *out, size_t out_size) {
+    const char *slash = importer ? strrchr(importer, '/') : NULL;
+#ifdef _WIN32
+    const char *backslash = importer ? strrchr(importer, '\\') : NULL;
+    if (backslash > slash) slash = backslash;
+#endif
+
+    if (is_absolute(path) || !slash) {
+        snprintf(out, out_size, "%s", path);
+    } else {
+        snprintf(out, out_size, "%.*s/%s", (int)(slash - importer), importer, path);
+    }
+}
+
+void source_module_default_alias(const char *path, char *out, size_t out_size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    const char *dot = strrchr(base, '.');
+    int len = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+    snprintf(out, out_size, "%.*s", len, base);
+}
+
+static CachedModule *find_cached(const char *path) {
+    for (int i = 0; i < cache_count; i++) {
+        if (strcmp(cache[i].path, path) == 0) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Compiles with a fresh lexer; the importer's token stream may still be live.
+static Program *compile_module(const char *path) {
+    char *source = try_read_file(path);
+    if (!source) return NULL;
+
+    NacContext *ctx = nac_ctx;
+    LexerState saved_lexer = ctx->lexer;
+    Token saved_token = ctx->current_token;
+    char *saved_code = ctx->code;
+    int saved_code_len = ctx->code_len;
+    const char *saved_name = ctx->script_name;
+    bool saved_eager = ctx->eager_parsing;
+    bool saved_error = ctx->error_occurred;
+
+    memset(&ctx->lexer, 0, sizeof(ctx->lexer));
+    ctx->error_occurred = false;
+    set_script_name(path);
+    set_source_code(source);
+
+    Program *program = (Program*)malloc(sizeof(Program));
+    program_init(program);
+    bool ok = compile_program(program);
+
+    ctx->lexer = saved_lexer;
+    ctx->current_token = saved_token;
+    ctx->code = saved_code;
+    ctx->code_len = saved_code_len;
+    ctx->script_name = saved_name;
+    ctx->eager_parsing = saved_eager;
+    ctx->error_occurred = saved_error || !ok;
+    free(source);
+
+    if (!ok) {
+        program_free(program);
+        free(program);
+        return NULL;
+    }
+    return program;
+}
+
+const Program *source_module_load(const char *path) {
+    char resolved[PATH_MAX];
+    struct stat st;
+#ifdef _WIN32
+    bool found = _fullpath(resolved, path, sizeof(resolved)) != NULL && stat(resolved, &st) == 0;
+#else
+    bool found = realpath(path, resolved) != NULL && stat(resolved, &st) == 0;
+#endif
+    if (!found) {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "Cannot open module: %s", path);
+        report_error(msg);
+        return NULL;
+    }
+
+    lock_cache();
+    CachedModule *entry = find_cached(resolved);
+    if (entry && entry->mtime == (long long)st.st_mtime && entry->size == (long long)st.st_size) {
+        Program *program = entry->program;
+        unlock_cache();
+        return program;
+    }
+    unlock_cache();
+
+    Program *program = compile_module(resolved);
+    if (!program) {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "Cannot import module: %s", path);
+        report_error(msg);
+        return NULL;
+    }
+
+    lock_cache();
+    entry = find_cached(resolved);
+    if (entry && entry->mtime == (long long)st.st_mtime && entry->size == (long long)st.st_size) {
+        // Another context compiled it first.
+        unlock_cache();
+        program_free(program);
+        free(program);
+        return entry->program;
+    }
+    if (!entry) {
+        if (cache_count >= cache_capacity) {
+            cache_capacity = (cache_capacity == 0) ? 16 : cache_capacity * 2;
+            cache = (CachedModule*)realloc(cache, sizeof(CachedModule) * cache_capacity);
+        }
+        entry = &cache[cache_count++];
+        entry->path = strdup(resolved);
+    }
+    entry->mtime = (long long)st.st_mtime;
+    entry->size = (long long)st.st_size;
+    entry->program = program;
+    unlock_cache();
+
+    source_module_preload(program);
+    return program;
+}
+
+static bool already_imported(const Program *program) {
+    for (int i = 0; i < nac_ctx->import_count; i++) {
+        if (nac_ctx->imports[i] == program) return true;
+    }
+    return false;
+}
+
+static void remember_import(const Program *program) {
+    if (nac_ctx->import_count >= nac_ctx->import_capacity) {
+        nac_ctx->import_capacity = (nac_ctx->import_capacity == 0) ? 16 : nac_ctx->import_capacity * 2;
+        nac_ctx->imports = (const Program**)realloc(nac_ctx->imports, sizeof(Program*) * nac_ctx->import_capacity);
+    }
+    nac_ctx->imports[nac_ctx->import_count++] = program;
+}
+
+// Functions are registered as `alias.name` and share the cached bodies.
+// Top-level statements run once per context, however often the module is
+// imported.
+bool source_module_import(const char *path, const char *alias) {
+    const Program *program = source_module_load(path);
+    if (!program) return false;
+
+    for (int i = 0; i < program->count; i++) {
+        const ProgramItem *item = &program->items[i];
+        if (!item->is_function) continue;
+
+        Function func = item->function;
+        int len = snprintf(func.name, sizeof(func.name), "%s.%s", alias, item->function.name);
+        func.shared_body = true;
+        if (len < (int)sizeof(func.name) && !find_function(func.name)) {
+            function_table_add(&nac_ctx->functions, &func);
+        }
+    }
+
+    if (already_imported(program)) return true;
+    remember_import(program);
+
+    const char *saved_scope = nac_ctx->scope;
+    int saved_scope_len = nac_ctx->scope_len;
+    nac_ctx->scope = alias;
+    nac_ctx->scope_len = (int)strlen(alias);
+
+    for (int i = 0; i < program->count; i++) {
+        const ProgramItem *item = &program->items[i];
+        if (item->is_function) continue;
+        eval_node(item->statement);
+        if (nac_ctx->should_break || nac_ctx->should_continue || nac_ctx->should_return) break;
+    }
+
+    nac_ctx->should_break = nac_ctx->should_continue = nac_ctx->should_return = false;
+    nac_ctx->scope = saved_scope;
+    nac_ctx->scope_len = saved_scope_len;
+    return true;
+}
+
+// Compiles every module a program imports at top level, so forked daemon
+// workers start with the whole import graph already parsed.
+void source_module_preload(const Program *program) {
+    for (int i = 0; i < program->count; i++) {
+        const ProgramItem *item = &program->items[i];
+        if (!item->is_function && item->statement && item->statement->type == AST_IMPORT) {
+            source_module_load(item->statement->import_stmt.path);
+        }
+    }
+}
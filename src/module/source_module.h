@@ -0,0 +1,15 @@
+#ifndef NAC_SOURCE_MODULE_H
+#define NAC_SOURCE_MODULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../core/program_cache.h"
+
+void source_module_resolve(const char *importer, const char *path, char *out, size_t out_size);
+void source_module_default_alias(const char *path, char *out, size_t out_size);
+const Program *source_module_load(const char *path);
+bool source_module_import(const char *path, const char *alias);
+void source_module_preload(const Program *program);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef NAC_H
+#define NAC_H
+
+// Embedding API. Build the library with `./build.sh lib` and include this
+// header with -I pointing at src/.
+//
+// Each NacContext is a complete interpreter: its own globals, functions,
+// module registry and error state. A context must only be used by one thread
+// at a time; different contexts may be used from different threads.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "runtime/value.h"
+
+#define NAC_OK 0
+#define NAC_ERROR 1
+
+typedef struct NacContext NacContext;
+
+NacContext *nac_context_new(void);
+void nac_context_free(NacContext *ctx);
+
+// Compile the source and run its top-level statements once. Functions and
+// globals it defines stay in the context for later nac_call()s.
+int nac_load(NacContext *ctx, const char *source, const char *name);
+int nac_load_file(NacContext *ctx, const char *path);
+
+int nac_has_function(NacContext *ctx, const char *name);
+
+// Arguments are copied; *result (if non-NULL) receives a value the caller
+// must release with free_value().
+int nac_call(NacContext *ctx, const char *name, const Value *args, int arg_count, Value *result);
+
+int nac_set_global(NacContext *ctx, const char *name, Value value);
+int nac_get_global(NacContext *ctx, const char *name, Value *result);
+
+// Message of the most recent error in this context, or "" if none.
+const char *nac_last_error(const NacContext *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
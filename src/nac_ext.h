@@ -0,0 +1,37 @@
+#ifndef NAC_EXT_H
+#define NAC_EXT_H
+
+// Native extension ABI.
+//
+// An extension is a shared object exporting
+//
+//     int nac_extension_init(NacRegisterFn register_fn, int abi_version);
+//
+// which calls register_fn once per function and returns 0 on success. It is
+// loaded from a script with moduleLoadNative("path/to/ext.so"); the
+// registered functions are then called like built-ins.
+//
+// A native function receives borrowed arguments and returns a Value the
+// interpreter takes ownership of. Build values with make_int, make_float,
+// make_string, make_array, make_map and map_set; report failures with
+// report_error. Arity -1 accepts any number of arguments.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "runtime/value.h"
+#include "util/error.h"
+
+#define NAC_EXT_ABI_VERSION 1
+#define NAC_EXT_INIT_SYMBOL "nac_extension_init"
+
+typedef Value (*NacNativeFn)(Value *args, int arg_count);
+typedef int (*NacRegisterFn)(const char *name, int arity, NacNativeFn fn);
+typedef int (*NacExtensionInitFn)(NacRegisterFn register_fn, int abi_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
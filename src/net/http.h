@@ -1,10 +1,25 @@
 #ifndef NAC_HTTP_H
 #define NAC_HTTP_H
 
+#include <stdbool.h>
+
+struct NacContext;
+struct Value;
+
 char *http_request_win_response(const char *method, const char *url, const char *body);
 char *http_request_unix_response(const char *method, const char *url, const char *body);
+void http_json_unix(const char *method, const char *url, const char *body, const char *path, struct Value *out);
 
 void http_request_win(const char *method, const char *url, const char *body);
 void http_request_unix(const char *method, const char *url, const char *body);
 
+long http_download(const char *method, const char *url, const char *body, const char *path);
+int http_stream(const char *method, const char *url, const char *body, const char *func_name);
+
+bool http_async_request(const char *method, const char *url, const char *body, const char *callback, int promise);
+void http_async_free(struct NacContext *ctx);
+
+void http_pool_after_fork(void);
+void http_policy_after_fork(void);
+
 #endif
@@ -0,0 +1,214 @@
+#include "http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "../runtime/async.h"
+#include "../runtime/event_loop.h"
+#include "../util/error.h"
+
+#ifdef __linux__
+
+#include "http_curl.h"
+
+// Requests share one curl multi handle per context. curl reports which
+// sockets it wants watched and when it next needs a timeout; both are
+// forwarded to the context's event loop, so any number of transfers wait
+// together in one epoll_wait.
+typedef struct HttpCall {
+    CURL *easy;
+    HttpBuffer buffer;
+    struct curl_slist *headers;
+    char callback[MAX_TOKEN_LEN];
+    int promise;
+    struct HttpCall *prev;
+    struct HttpCall *next;
+} HttpCall;
+
+typedef struct HttpMulti {
+    CURLM *multi;
+    long timer;
+    HttpCall *calls;
+} HttpMulti;
+
+static void call_free(HttpCall *call) {
+    if (call->headers) {
+        curl_slist_free_all(call->headers);
+    }
+    http_curl_release(call->easy);
+    free(call->buffer.data);
+    free(call);
+}
+
+static void unlink_call(HttpMulti *http, HttpCall *call) {
+    if (call->prev) call->prev->next = call->next;
+    else http->calls = call->next;
+    if (call->next) call->next->prev = call->prev;
+}
+
+static void finish_calls(HttpMulti *http) {
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(http->multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+
+        CURL *easy = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        HttpCall *call = NULL;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&call);
+        double seconds = 0;
+        curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME, &seconds);
+        http_record(result, seconds * 1000.0);
+        curl_multi_remove_handle(http->multi, easy);
+        unlink_call(http, call);
+
+        Value args[2];
+        if (result == CURLE_OK) {
+            long status = 0;
+            curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+            args[0] = make_string(call->buffer.data ? call->buffer.data : "");
+            args[1] = make_int((int)status);
+        } else {
+            char msg_text[256];
+            snprintf(msg_text, sizeof(msg_text), "HTTP: %s", curl_easy_strerror(result));
+            args[0] = make_string(msg_text);
+            args[1] = make_int(0);
+        }
+
+        char callback[MAX_TOKEN_LEN];
+        memcpy(callback, call->callback, sizeof(callback));
+        int promise = call->promise;
+        call_free(call);
+        event_loop_hold(nac_ctx->loop, -1);
+
+        if (promise) {
+            // A promise gets the body, or is rejected if the transfer failed.
+            if (result == CURLE_OK) {
+                promise_resolve(promise, args[0]);
+            } else {
+                promise_reject(promise, args[0].str_val);
+                free_value(&args[0]);
+            }
+        } else {
+            loop_call(callback, args, 2);
+        }
+    }
+}
+
+static void on_ready(int fd, int events, void *data) {
+    HttpMulti *http = (HttpMulti*)data;
+    int flags = ((events & LOOP_READ) ? CURL_CSELECT_IN : 0) | ((events & LOOP_WRITE) ? CURL_CSELECT_OUT : 0);
+    int running;
+    curl_multi_socket_action(http->multi, fd, flags, &running);
+    finish_calls(http);
+}
+
+static void on_timeout(void *data) {
+    HttpMulti *http = (HttpMulti*)data;
+    http->timer = 0;
+    int running;
+    curl_multi_socket_action(http->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    finish_calls(http);
+}
+
+static int on_socket(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp) {
+    (void)easy;
+    (void)socketp;
+    EventLoop *loop = nac_ctx->loop;
+    if (what == CURL_POLL_REMOVE) {
+        event_loop_unwatch(loop, fd);
+        return 0;
+    }
+
+    int events = ((what & CURL_POLL_IN) ? LOOP_READ : 0) | ((what & CURL_POLL_OUT) ? LOOP_WRITE : 0);
+    return event_loop_watch(loop, fd, events, on_ready, userp, false) ? 0 : -1;
+}
+
+static int on_timer(CURLM *multi, long timeout_ms, void *userp) {
+    (void)multi;
+    HttpMulti *http = (HttpMulti*)userp;
+    EventLoop *loop = nac_ctx->loop;
+    if (http->timer) {
+        event_loop_cancel(loop, http->timer);
+        http->timer = 0;
+    }
+    if (timeout_ms >= 0) {
+        http->timer = event_loop_timer(loop, (double)timeout_ms, 0, on_timeout, http, NULL, false);
+    }
+    return 0;
+}
+
+// Completion runs the named callback, or settles the promise when one is given.
+bool http_async_request(const char *method, const char *url, const char *body, const char *callback, int promise) {
+    EventLoop *loop = event_loop_get();
+    if (!loop) return false;
+
+    HttpMulti *http = nac_ctx->http;
+    if (!http) {
+        http = (HttpMulti*)calloc(1, sizeof(HttpMulti));
+        http->multi = curl_multi_init();
+        curl_multi_setopt(http->multi, CURLMOPT_SOCKETFUNCTION, on_socket);
+        curl_multi_setopt(http->multi, CURLMOPT_SOCKETDATA, http);
+        curl_multi_setopt(http->multi, CURLMOPT_TIMERFUNCTION, on_timer);
+        curl_multi_setopt(http->multi, CURLMOPT_TIMERDATA, http);
+        nac_ctx->http = http;
+    }
+
+    HttpCall *call = (HttpCall*)calloc(1, sizeof(HttpCall));
+    call->easy = http_curl_prepare(method, url, body, &call->buffer, &call->headers);
+    if (!call->easy) {
+        free(call);
+        return false;
+    }
+    if (callback) {
+        strncpy(call->callback, callback, MAX_TOKEN_LEN - 1);
+    }
+    call->promise = promise;
+    curl_easy_setopt(call->easy, CURLOPT_PRIVATE, call);
+
+    call->next = http->calls;
+    if (http->calls) http->calls->prev = call;
+    http->calls = call;
+
+    event_loop_hold(loop, 1);
+    curl_multi_add_handle(http->multi, call->easy);
+    return true;
+}
+
+// Unfinished requests are dropped without running their callbacks.
+void http_async_free(NacContext *ctx) {
+    HttpMulti *http = ctx->http;
+    if (!http) return;
+
+    NacContext *previous = context_enter(ctx);
+    while (http->calls) {
+        HttpCall *call = http->calls;
+        curl_multi_remove_handle(http->multi, call->easy);
+        unlink_call(http, call);
+        call_free(call);
+    }
+    curl_multi_cleanup(http->multi);
+    free(http);
+    ctx->http = NULL;
+    context_enter(previous);
+}
+
+#else
+
+bool http_async_request(const char *method, const char *url, const char *body, const char *callback, int promise) {
+    (void)method;
+    (void)url;
+    (void)body;
+    (void)callback;
+    (void)promise;
+    event_loop_get();
+    return false;
+}
+
+void http_async_free(NacContext *ctx) {
+    (void)ctx;
+}
+
+#endif
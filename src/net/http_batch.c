@@ -0,0 +1,242 @@
+#include "http_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http.h"
+#include "../runtime/json.h"
+#include "../util/error.h"
+
+typedef struct {
+    const char *method;
+    const char *url;
+    const char *body;
+    char *json_body;
+    Value *headers;
+    int timeout_ms;
+    int connect_timeout_ms;
+} BatchRequest;
+
+// Reads one request map; false (with an error reported) if it is malformed.
+static bool request_read(Value *request, int index, BatchRequest *out) {
+    memset(out, 0, sizeof(*out));
+    out->method = "GET";
+
+    Value *url = request->type == TYPE_MAP ? map_get(request, "url") : NULL;
+    if (!url || url->type != TYPE_STRING) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "httpBatch(): request %d needs a url", index);
+        report_error(msg);
+        return false;
+    }
+    out->url = url->str_val;
+
+    Value *method = map_get(request, "method");
+    if (method && method->type == TYPE_STRING) {
+        out->method = method->str_val;
+    }
+
+    Value *body = map_get(request, "body");
+    if (body && body->type == TYPE_STRING) {
+        out->body = body->str_val;
+    } else if (body) {
+        out->json_body = json_stringify_value(*body);
+        out->body = out->json_body;
+    }
+
+    Value *headers = map_get(request, "headers");
+    if (headers && headers->type == TYPE_MAP) {
+        out->headers = headers;
+    }
+
+    Value *timeout = map_get(request, "timeout");
+    if (timeout && timeout->type == TYPE_INT) {
+        out->timeout_ms = timeout->int_val;
+    }
+    Value *connect_timeout = map_get(request, "connectTimeout");
+    if (connect_timeout && connect_timeout->type == TYPE_INT) {
+        out->connect_timeout_ms = connect_timeout->int_val;
+    }
+    return true;
+}
+
+static Value response_make(int status, const char *body, double time_ms, const char *error) {
+    Value response = make_map();
+    Value field = make_int(status);
+    map_set(&response, "status", field);
+    field = make_string(body ? body : "");
+    map_set(&response, "body", field);
+    field = make_float(time_ms);
+    map_set(&response, "time", field);
+    if (error) {
+        field = make_string(error);
+        map_set(&response, "error", field);
+    }
+    return response;
+}
+
+#ifndef _WIN32
+
+#include "http_curl.h"
+
+// All requests go through one curl multi handle on the calling thread; at
+// most `concurrency` are in flight, and a new one starts as each finishes.
+typedef struct {
+    CURL *curl;
+    HttpBuffer buffer;
+    struct curl_slist *headers;
+    int index;
+} BatchTransfer;
+
+static struct curl_slist *headers_append(struct curl_slist *list, Value *headers) {
+    char line[MAX_STRING_LEN + 256];
+    for (int i = 0; i < headers->map_val.size; i++) {
+        Value *v = &headers->map_val.values[i];
+        if (v->type == TYPE_STRING) {
+            snprintf(line, sizeof(line), "%s: %s", headers->map_val.keys[i], v->str_val);
+        } else if (v->type == TYPE_INT) {
+            snprintf(line, sizeof(line), "%s: %d", headers->map_val.keys[i], v->int_val);
+        } else {
+            continue;
+        }
+        list = curl_slist_append(list, line);
+    }
+    return list;
+}
+
+static bool transfer_start(CURLM *multi, Value *request, int index, BatchTransfer *t, Value *result) {
+    BatchRequest req;
+    if (!request_read(request, index, &req)) {
+        *result = response_make(0, NULL, 0, "invalid request");
+        return false;
+    }
+
+    t->index = index;
+    t->curl = http_curl_prepare(req.method, req.url, req.body, &t->buffer, &t->headers);
+    free(req.json_body);
+    if (!t->curl) {
+        *result = response_make(0, NULL, 0, "could not create request");
+        return false;
+    }
+
+    if (req.headers) {
+        t->headers = headers_append(t->headers, req.headers);
+        curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, t->headers);
+    }
+    // Per-request deadlines override the ones set with httpTimeout().
+    if (req.timeout_ms > 0) {
+        curl_easy_setopt(t->curl, CURLOPT_TIMEOUT_MS, (long)req.timeout_ms);
+    }
+    if (req.connect_timeout_ms > 0) {
+        curl_easy_setopt(t->curl, CURLOPT_CONNECTTIMEOUT_MS, (long)req.connect_timeout_ms);
+    }
+    curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+    curl_multi_add_handle(multi, t->curl);
+    return true;
+}
+
+static void transfer_finish(CURLM *multi, BatchTransfer *t, CURLcode code, Value *result) {
+    long status = 0;
+    double seconds = 0;
+    curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(t->curl, CURLINFO_TOTAL_TIME, &seconds);
+    http_record(code, seconds * 1000.0);
+
+    if (code == CURLE_OK) {
+        *result = response_make((int)status, t->buffer.data, seconds * 1000.0, NULL);
+    } else {
+        *result = response_make(0, NULL, seconds * 1000.0, curl_easy_strerror(code));
+    }
+
+    curl_multi_remove_handle(multi, t->curl);
+    http_curl_release(t->curl);
+    if (t->headers) {
+        curl_slist_free_all(t->headers);
+    }
+    free(t->buffer.data);
+    memset(t, 0, sizeof(*t));
+}
+
+Value http_batch(Value requests, int concurrency) {
+    if (requests.type != TYPE_ARRAY) {
+        report_error("httpBatch() requires an array of request maps");
+        return make_int(0);
+    }
+    if (concurrency <= 0) {
+        concurrency = HTTP_BATCH_DEFAULT_CONCURRENCY;
+    }
+
+    int count = requests.array_val.size;
+    Value results = make_array(count);
+    if (results.array_val.size < count) {
+        return make_int(0);
+    }
+    BatchTransfer *transfers = (BatchTransfer*)calloc(count > 0 ? count : 1, sizeof(BatchTransfer));
+    CURLM *multi = curl_multi_init();
+
+    int next = 0;
+    int active = 0;
+    while (next < count || active > 0) {
+        while (active < concurrency && next < count) {
+            int i = next++;
+            if (transfer_start(multi, &requests.array_val.elements[i], i, &transfers[i], &results.array_val.elements[i])) {
+                active++;
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            BatchTransfer *t = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+            CURLcode code = msg->data.result;
+            transfer_finish(multi, t, code, &results.array_val.elements[t->index]);
+            active--;
+        }
+
+        if (active > 0) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    free(transfers);
+    return results;
+}
+
+#else
+
+// No curl on Windows: the requests run one after another.
+Value http_batch(Value requests, int concurrency) {
+    (void)concurrency;
+    if (requests.type != TYPE_ARRAY) {
+        report_error("httpBatch() requires an array of request maps");
+        return make_int(0);
+    }
+
+    int count = requests.array_val.size;
+    Value results = make_array(count);
+    if (results.array_val.size < count) {
+        return make_int(0);
+    }
+    for (int i = 0; i < count; i++) {
+        BatchRequest req;
+        if (!request_read(&requests.array_val.elements[i], i, &req)) {
+            results.array_val.elements[i] = response_make(0, NULL, 0, "invalid request");
+            continue;
+        }
+        char *body = http_request_win_response(req.method, req.url, req.body);
+        free(req.json_body);
+        results.array_val.elements[i] = body ? response_make(200, body, 0, NULL)
+                                             : response_make(0, NULL, 0, "request failed");
+        free(body);
+    }
+    return results;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef NAC_HTTP_BATCH_H
+#define NAC_HTTP_BATCH_H
+
+#include "../runtime/value.h"
+
+#define HTTP_BATCH_DEFAULT_CONCURRENCY 16
+
+Value http_batch(Value requests, int concurrency);
+
+#endif
@@ -0,0 +1,417 @@
+#include "http_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util/error.h"
+
+#ifndef _WIN32
+
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http.h"
+#include "http_curl.h"
+
+// A client-side cache for GET requests made by httpRequest and httpJson.
+// Bodies live in <dir>/objects, named by a hash of their content. Each URL
+// has its own entry file in <dir>/entries, named by a hash of the URL, that
+// points at its body and keeps the validators:
+//
+//   url \t object \t stored_at \t max_age \t etag \t last_modified
+//
+// Storing a response replaces one small file, and entries are read from
+// disk on every lookup, so processes sharing the directory see each other's
+// entries and never overwrite other URLs. Two URLs whose hashes collide
+// evict each other. A fresh entry (younger than its max-age) is served
+// without a request; a stale one is revalidated with If-None-Match /
+// If-Modified-Since and served from disk on 304.
+#define CACHE_FIELD_LEN 256
+#define CACHE_URL_MAX 2048
+
+typedef struct {
+    char object[40];
+    long stored_at;
+    long max_age;      // -1: no max-age, always revalidate
+    char etag[CACHE_FIELD_LEN];
+    char last_modified[CACHE_FIELD_LEN];
+} CacheEntry;
+
+typedef struct {
+    char etag[CACHE_FIELD_LEN];
+    char last_modified[CACHE_FIELD_LEN];
+    long max_age;
+    bool no_store;
+} CacheHeaders;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *cache_dir = NULL;
+static atomic_int tmp_serial = 0;
+static atomic_int stat_hits = 0;
+static atomic_int stat_revalidated = 0;
+static atomic_int stat_misses = 0;
+static atomic_int stat_stored = 0;
+
+static unsigned long long hash_bytes(const char *data, size_t len) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Writes data to path through a temporary file that is renamed into place,
+// so readers in any process see the old file or the new one, never half.
+static bool replace_file(const char *path, const char *data, size_t len) {
+    char tmp_path[1200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d.%d", path, (int)getpid(),
+             atomic_fetch_add(&tmp_serial, 1));
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, len, f) == len;
+    if (fclose(f) != 0 || !ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+// Copies the next tab-separated field of *line into out.
+static void next_field(char **line, char *out, size_t out_size) {
+    char *end = strchr(*line, '\t');
+    size_t len = end ? (size_t)(end - *line) : strlen(*line);
+    snprintf(out, out_size, "%.*s", (int)len, *line);
+    *line = end ? end + 1 : *line + len;
+}
+
+static void entry_path(const char *dir, const char *url, char *path, size_t size) {
+    snprintf(path, size, "%s/entries/%016llx", dir, hash_bytes(url, strlen(url)));
+}
+
+static bool entry_load(const char *dir, const char *url, CacheEntry *entry) {
+    char path[1100];
+    entry_path(dir, url, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char line[CACHE_URL_MAX + 4 * CACHE_FIELD_LEN];
+    bool found = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!found) return false;
+
+    line[strcspn(line, "\n")] = '\0';
+    char *p = line;
+    char field[CACHE_URL_MAX + 1];
+    next_field(&p, field, sizeof(field));
+    if (strcmp(field, url) != 0) return false;
+
+    memset(entry, 0, sizeof(*entry));
+    next_field(&p, entry->object, sizeof(entry->object));
+    next_field(&p, field, sizeof(field));
+    entry->stored_at = strtol(field, NULL, 10);
+    next_field(&p, field, sizeof(field));
+    entry->max_age = strtol(field, NULL, 10);
+    next_field(&p, entry->etag, sizeof(entry->etag));
+    next_field(&p, entry->last_modified, sizeof(entry->last_modified));
+    return entry->object[0] != '\0';
+}
+
+static void entry_store(const char *dir, const char *url, const CacheEntry *entry) {
+    char line[CACHE_URL_MAX + 4 * CACHE_FIELD_LEN];
+    int len = snprintf(line, sizeof(line), "%s\t%s\t%ld\t%ld\t%s\t%s\n", url, entry->object,
+                       entry->stored_at, entry->max_age, entry->etag, entry->last_modified);
+    if (len < 0 || (size_t)len >= sizeof(line)) return;
+
+    char path[1100];
+    entry_path(dir, url, path, sizeof(path));
+    replace_file(path, line, (size_t)len);
+}
+
+// Turns caching on for the rest of the process, or off for an empty dir.
+bool http_cache_open(const char *dir) {
+    pthread_mutex_lock(&cache_lock);
+    free(cache_dir);
+    cache_dir = NULL;
+
+    bool ok = true;
+    if (dir && strlen(dir) >= 1000) {
+        report_error("httpCache: cache directory name is too long");
+        ok = false;
+    } else if (dir && dir[0]) {
+        const char *subdirs[] = { "objects", "entries" };
+        mkdir(dir, 0755);
+        for (int i = 0; i < 2 && ok; i++) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", dir, subdirs[i]);
+            mkdir(path, 0755);
+
+            struct stat st;
+            if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                char msg[1100];
+                snprintf(msg, sizeof(msg), "httpCache: cannot create %s", path);
+                report_error(msg);
+                ok = false;
+            }
+        }
+        if (ok) {
+            cache_dir = strdup(dir);
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+bool http_cache_enabled(void) {
+    pthread_mutex_lock(&cache_lock);
+    bool enabled = cache_dir != NULL;
+    pthread_mutex_unlock(&cache_lock);
+    return enabled;
+}
+
+// Copies the cache directory, so a concurrent httpCache() cannot free it
+// under a request. False when caching is off.
+static bool current_dir(char *out, size_t size) {
+    pthread_mutex_lock(&cache_lock);
+    bool on = cache_dir != NULL;
+    if (on) snprintf(out, size, "%s", cache_dir);
+    pthread_mutex_unlock(&cache_lock);
+    return on;
+}
+
+static void object_path(const char *dir, const char *object, char *path, size_t size) {
+    snprintf(path, size, "%s/objects/%s", dir, object);
+}
+
+static char *object_read(const char *dir, const char *object) {
+    char path[1100];
+    object_path(dir, object, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = (char*)malloc((size_t)len + 1);
+    size_t got = fread(data, 1, (size_t)len, f);
+    fclose(f);
+    data[got] = '\0';
+    return data;
+}
+
+// Named by FNV-1a and length, so identical bodies are stored once.
+static void object_write(const char *dir, const char *data, size_t len, char *object, size_t object_size) {
+    snprintf(object, object_size, "%016llx-%zx", hash_bytes(data, len), len);
+
+    char path[1100];
+    object_path(dir, object, path, sizeof(path));
+    if (access(path, F_OK) == 0) return;
+    if (!replace_file(path, data, len)) {
+        object[0] = '\0';
+    }
+}
+
+static bool header_is(const char *line, const char *name, const char **value) {
+    size_t n = strlen(name);
+    if (strncasecmp(line, name, n) != 0 || line[n] != ':') return false;
+    const char *v = line + n + 1;
+    while (*v == ' ' || *v == '\t') v++;
+    *value = v;
+    return true;
+}
+
+static void header_copy(char *out, const char *value, size_t len) {
+    while (len > 0 && isspace((unsigned char)value[len - 1])) len--;
+    if (len >= CACHE_FIELD_LEN) len = CACHE_FIELD_LEN - 1;
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+static size_t header_callback(char *data, size_t size, size_t nitems, void *userp) {
+    CacheHeaders *h = (CacheHeaders*)userp;
+    size_t total = size * nitems;
+
+    char line[1024];
+    size_t len = total < sizeof(line) - 1 ? total : sizeof(line) - 1;
+    memcpy(line, data, len);
+    line[len] = '\0';
+
+    const char *value;
+    if (strncmp(line, "HTTP/", 5) == 0) {
+        // A new response (after a redirect) replaces what came before.
+        memset(h, 0, sizeof(*h));
+        h->max_age = -1;
+    } else if (header_is(line, "ETag", &value)) {
+        header_copy(h->etag, value, strlen(value));
+    } else if (header_is(line, "Last-Modified", &value)) {
+        header_copy(h->last_modified, value, strlen(value));
+    } else if (header_is(line, "Cache-Control", &value)) {
+        for (char *p = line; *p; p++) *p = (char)tolower((unsigned char)*p);
+        if (strstr(value, "no-store")) h->no_store = true;
+        if (strstr(value, "no-cache")) h->max_age = 0;
+        const char *max_age = strstr(value, "max-age=");
+        if (max_age && h->max_age != 0) h->max_age = strtol(max_age + 8, NULL, 10);
+    }
+    return total;
+}
+
+static struct curl_slist *add_header(struct curl_slist *list, const char *name, const char *value) {
+    char line[CACHE_FIELD_LEN + 32];
+    snprintf(line, sizeof(line), "%s: %s", name, value);
+    return curl_slist_append(list, line);
+}
+
+// A GET through the cache. Returns the body (caller frees), or NULL with an
+// error reported if the request failed.
+char *http_cache_get(const char *url) {
+    long now = (long)time(NULL);
+
+    char dir[1024];
+    bool enabled = current_dir(dir, sizeof(dir)) && strlen(url) <= CACHE_URL_MAX;
+    CacheEntry cached;
+    bool have = enabled && entry_load(dir, url, &cached);
+
+    if (have && cached.max_age > 0 && now - cached.stored_at < cached.max_age) {
+        char *body = object_read(dir, cached.object);
+        if (body) {
+            atomic_fetch_add(&stat_hits, 1);
+            return body;
+        }
+    }
+    if (have) {
+        char path[1100];
+        object_path(dir, cached.object, path, sizeof(path));
+        have = access(path, R_OK) == 0;
+    }
+
+    HttpBuffer buffer = {0};
+    struct curl_slist *headers = NULL;
+    CURL *curl = http_curl_prepare("GET", url, NULL, &buffer, &headers);
+    if (!curl) return NULL;
+
+    if (have && cached.etag[0]) {
+        headers = add_header(headers, "If-None-Match", cached.etag);
+    }
+    if (have && cached.last_modified[0]) {
+        headers = add_header(headers, "If-Modified-Since", cached.last_modified);
+    }
+    if (headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    CacheHeaders response;
+    memset(&response, 0, sizeof(response));
+    response.max_age = -1;
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+
+    CURLcode res = http_perform(curl, &buffer, false);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (headers) {
+        curl_slist_free_all(headers);
+    }
+    http_curl_release(curl);
+
+    if (res != CURLE_OK) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "HTTP: %s", curl_easy_strerror(res));
+        report_error(error_msg);
+        free(buffer.data);
+        return NULL;
+    }
+
+    char *body = buffer.data ? buffer.data : strdup("");
+
+    if (status == 304 && have) {
+        char *stored = object_read(dir, cached.object);
+        if (stored) {
+            free(body);
+            body = stored;
+            cached.stored_at = now;
+            if (response.max_age >= 0) cached.max_age = response.max_age;
+            if (response.etag[0]) strcpy(cached.etag, response.etag);
+            if (response.last_modified[0]) strcpy(cached.last_modified, response.last_modified);
+            entry_store(dir, url, &cached);
+            atomic_fetch_add(&stat_revalidated, 1);
+            return body;
+        }
+    }
+
+    atomic_fetch_add(&stat_misses, 1);
+
+    bool cacheable = enabled && status == 200 && !response.no_store &&
+                     (response.max_age > 0 || response.etag[0] || response.last_modified[0]);
+    if (!cacheable) return body;
+
+    CacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    object_write(dir, body, buffer.data ? buffer.len : 0, entry.object, sizeof(entry.object));
+    if (entry.object[0]) {
+        entry.stored_at = now;
+        entry.max_age = response.max_age;
+        strcpy(entry.etag, response.etag);
+        strcpy(entry.last_modified, response.last_modified);
+        entry_store(dir, url, &entry);
+        atomic_fetch_add(&stat_stored, 1);
+    }
+    return body;
+}
+
+// Entries are counted on disk, so they include other processes' entries.
+static int count_entries(const char *dir) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/entries", dir);
+    DIR *d = opendir(path);
+    if (!d) return 0;
+
+    int count = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.' && !strchr(e->d_name, '.')) count++;
+    }
+    closedir(d);
+    return count;
+}
+
+Value http_cache_stats(void) {
+    char dir[1024];
+    int entries = current_dir(dir, sizeof(dir)) ? count_entries(dir) : 0;
+
+    Value stats = make_map();
+    map_set(&stats, "hits", make_int(atomic_load(&stat_hits)));
+    map_set(&stats, "revalidated", make_int(atomic_load(&stat_revalidated)));
+    map_set(&stats, "misses", make_int(atomic_load(&stat_misses)));
+    map_set(&stats, "stored", make_int(atomic_load(&stat_stored)));
+    map_set(&stats, "entries", make_int(entries));
+    return stats;
+}
+
+#else
+
+bool http_cache_open(const char *dir) {
+    (void)dir;
+    report_error("httpCache() is not supported on Windows");
+    return false;
+}
+
+bool http_cache_enabled(void) {
+    return false;
+}
+
+char *http_cache_get(const char *url) {
+    (void)url;
+    return NULL;
+}
+
+Value http_cache_stats(void) {
+    return make_map();
+}
+
+#endif
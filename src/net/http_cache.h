@@ -0,0 +1,13 @@
+#ifndef NAC_HTTP_CACHE_H
+#define NAC_HTTP_CACHE_H
+
+#include <stdbool.h>
+
+#include "../runtime/value.h"
+
+bool http_cache_open(const char *dir);
+bool http_cache_enabled(void);
+char *http_cache_get(const char *url);
+Value http_cache_stats(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef NAC_HTTP_CURL_H
+#define NAC_HTTP_CURL_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} HttpBuffer;
+
+CURL *http_curl_acquire(const char *url);
+void http_curl_release(CURL *curl);
+
+CURL *http_curl_prepare(const char *method, const char *url, const char *body, HttpBuffer *buffer,
+                        struct curl_slist **headers);
+
+void http_curl_apply_timeouts(CURL *curl);
+CURLcode http_perform(CURL *curl, HttpBuffer *buffer, bool hedge);
+void http_record(CURLcode code, double elapsed_ms);
+
+#endif
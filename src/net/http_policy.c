@@ -0,0 +1,238 @@
+#include "http_policy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "http.h"
+#include "http_curl.h"
+
+// Process-wide request policy: the timeouts every transfer gets, and
+// hedging. A hedged GET that has no response after the configured
+// percentile of recent latencies gets a duplicate; whichever finishes
+// first is used and the other is cancelled.
+#define LATENCY_SAMPLES 128
+#define HEDGE_MIN_SAMPLES 10
+
+static atomic_int connect_timeout_ms = HTTP_DEFAULT_CONNECT_TIMEOUT_MS;
+static atomic_int total_timeout_ms = 0;
+
+static pthread_mutex_t hedge_lock = PTHREAD_MUTEX_INITIALIZER;
+static double hedge_percentile = 0;
+static int hedge_min_delay_ms = 0;
+static double latencies[LATENCY_SAMPLES];
+static int latency_count = 0;
+static int latency_next = 0;
+
+static atomic_int stat_requests = 0;
+static atomic_int stat_timeouts = 0;
+static atomic_int stat_hedges_fired = 0;
+static atomic_int stat_hedges_won = 0;
+static atomic_int stat_hedges_cancelled = 0;
+
+// Hedged transfers run on a multi handle that stays with the thread, so its
+// connections are kept between requests.
+static _Thread_local CURLM *hedge_multi = NULL;
+
+void http_set_timeouts(int connect_ms, int total_ms) {
+    atomic_store(&connect_timeout_ms, connect_ms > 0 ? connect_ms : 0);
+    atomic_store(&total_timeout_ms, total_ms > 0 ? total_ms : 0);
+}
+
+// A percentile of 0 turns hedging off. Until enough latencies have been
+// seen, min_delay_ms alone is used, or no hedging if it is 0.
+void http_set_hedge(double percentile, int min_delay_ms) {
+    pthread_mutex_lock(&hedge_lock);
+    hedge_percentile = percentile > 0 && percentile < 100 ? percentile : 0;
+    hedge_min_delay_ms = min_delay_ms > 0 ? min_delay_ms : 0;
+    pthread_mutex_unlock(&hedge_lock);
+}
+
+bool http_hedging(void) {
+    pthread_mutex_lock(&hedge_lock);
+    bool on = hedge_percentile > 0;
+    pthread_mutex_unlock(&hedge_lock);
+    return on;
+}
+
+void http_curl_apply_timeouts(CURL *curl) {
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)atomic_load(&connect_timeout_ms));
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)atomic_load(&total_timeout_ms));
+    // Without a total timeout a stalled server would otherwise hang forever.
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Milliseconds to wait before hedging, or -1 for no hedge.
+static long hedge_delay(void) {
+    double sorted[LATENCY_SAMPLES];
+    pthread_mutex_lock(&hedge_lock);
+    double percentile = hedge_percentile;
+    long delay = hedge_min_delay_ms;
+    int count = latency_count;
+    memcpy(sorted, latencies, sizeof(double) * count);
+    pthread_mutex_unlock(&hedge_lock);
+
+    if (percentile <= 0) return -1;
+    if (count < HEDGE_MIN_SAMPLES) return delay > 0 ? delay : -1;
+
+    qsort(sorted, count, sizeof(double), compare_double);
+    int index = (int)(percentile / 100.0 * count);
+    if (index >= count) index = count - 1;
+    long observed = (long)(sorted[index] + 0.5);
+    return observed > delay ? observed : delay;
+}
+
+void http_record(CURLcode code, double elapsed_ms) {
+    atomic_fetch_add(&stat_requests, 1);
+    if (code == CURLE_OPERATION_TIMEDOUT) {
+        atomic_fetch_add(&stat_timeouts, 1);
+    }
+    if (code != CURLE_OK) return;
+
+    pthread_mutex_lock(&hedge_lock);
+    latencies[latency_next] = elapsed_ms;
+    latency_next = (latency_next + 1) % LATENCY_SAMPLES;
+    if (latency_count < LATENCY_SAMPLES) latency_count++;
+    pthread_mutex_unlock(&hedge_lock);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static CURLcode perform_hedged(CURL *curl, HttpBuffer *buffer, long delay, double start) {
+    if (!hedge_multi) {
+        hedge_multi = curl_multi_init();
+    }
+    CURLM *multi = hedge_multi;
+    curl_multi_add_handle(multi, curl);
+
+    CURL *hedge = NULL;
+    HttpBuffer hedge_buffer = {0};
+    CURL *winner = NULL;
+    CURLcode result = CURLE_OK;
+    int active = 1;
+
+    while (!winner && active > 0) {
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while (!winner && (msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *done = msg->easy_handle;
+            result = msg->data.result;
+            curl_multi_remove_handle(multi, done);
+            active--;
+            // A failed attempt only decides the outcome if it was the last one.
+            if (result == CURLE_OK || active == 0) {
+                winner = done;
+            }
+        }
+        if (winner || active == 0) break;
+
+        double elapsed = now_ms() - start;
+        if (!hedge && elapsed >= delay) {
+            hedge = curl_easy_duphandle(curl);
+            if (hedge) {
+                curl_easy_setopt(hedge, CURLOPT_WRITEDATA, buffer ? &hedge_buffer : NULL);
+                curl_multi_add_handle(multi, hedge);
+                active++;
+                atomic_fetch_add(&stat_hedges_fired, 1);
+            }
+        }
+
+        int wait = hedge ? 1000 : (int)(delay - elapsed) + 1;
+        curl_multi_poll(multi, NULL, 0, wait, NULL);
+    }
+
+    if (hedge) {
+        if (winner == hedge && result == CURLE_OK) {
+            atomic_fetch_add(&stat_hedges_won, 1);
+            if (buffer) {
+                free(buffer->data);
+                *buffer = hedge_buffer;
+                hedge_buffer.data = NULL;
+            }
+        }
+        if (active > 0) {
+            atomic_fetch_add(&stat_hedges_cancelled, 1);
+        }
+        curl_multi_remove_handle(multi, hedge);
+        curl_easy_cleanup(hedge);
+        free(hedge_buffer.data);
+    }
+    curl_multi_remove_handle(multi, curl);
+    return result;
+}
+
+// Runs a prepared transfer. With hedge set (only for idempotent requests)
+// and a hedging policy in place it may race a duplicate; the body of the
+// winner ends up in buffer.
+CURLcode http_perform(CURL *curl, HttpBuffer *buffer, bool hedge) {
+    double start = now_ms();
+    long delay = hedge ? hedge_delay() : -1;
+
+    CURLcode result = delay >= 0 ? perform_hedged(curl, buffer, delay, start) : curl_easy_perform(curl);
+    http_record(result, now_ms() - start);
+    return result;
+}
+
+void http_policy_after_fork(void) {
+    hedge_multi = NULL;
+}
+
+Value http_stats(void) {
+    Value stats = make_map();
+    map_set(&stats, "requests", make_int(atomic_load(&stat_requests)));
+    map_set(&stats, "timeouts", make_int(atomic_load(&stat_timeouts)));
+    map_set(&stats, "hedgesFired", make_int(atomic_load(&stat_hedges_fired)));
+    map_set(&stats, "hedgesWon", make_int(atomic_load(&stat_hedges_won)));
+    map_set(&stats, "hedgesCancelled", make_int(atomic_load(&stat_hedges_cancelled)));
+    map_set(&stats, "hedgeDelay", make_int((int)hedge_delay()));
+    return stats;
+}
+
+#else
+
+#include "../util/error.h"
+
+void http_set_timeouts(int connect_ms, int total_ms) {
+    (void)connect_ms;
+    (void)total_ms;
+    report_error("httpTimeout() is not supported on Windows");
+}
+
+void http_set_hedge(double percentile, int min_delay_ms) {
+    (void)percentile;
+    (void)min_delay_ms;
+    report_error("httpHedge() is not supported on Windows");
+}
+
+bool http_hedging(void) {
+    return false;
+}
+
+Value http_stats(void) {
+    return make_map();
+}
+
+void http_policy_after_fork(void) {
+}
+
+#endif
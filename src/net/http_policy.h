@@ -0,0 +1,15 @@
+#ifndef NAC_HTTP_POLICY_H
+#define NAC_HTTP_POLICY_H
+
+#include <stdbool.h>
+
+#include "../runtime/value.h"
+
+#define HTTP_DEFAULT_CONNECT_TIMEOUT_MS 10000
+
+void http_set_timeouts(int connect_ms, int total_ms);
+void http_set_hedge(double percentile, int min_delay_ms);
+bool http_hedging(void);
+Value http_stats(void);
+
+#endif
@@ -0,0 +1,146 @@
+#include "http.h"
+
+#ifndef _WIN32
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_curl.h"
+
+// Finished easy handles are kept per host instead of being cleaned up. A
+// reused handle keeps its open connection, so the next request to that host
+// skips the TCP and TLS handshakes. All handles also share one CURLSH for
+// the DNS cache, TLS sessions and cookies. Connections themselves are not
+// put in the share: libcurl does not support using a shared connection
+// cache from several threads at once.
+#define POOL_SIZE 64
+#define HOST_KEY_LEN 256
+
+typedef struct {
+    char host[HOST_KEY_LEN];
+    CURL *curl;
+} PooledHandle;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static CURLSH *share = NULL;
+static PooledHandle idle[POOL_SIZE];
+static int idle_count = 0;
+
+static void share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userp) {
+    (void)curl;
+    (void)access;
+    (void)userp;
+    pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *curl, curl_lock_data data, void *userp) {
+    (void)curl;
+    (void)userp;
+    pthread_mutex_unlock(&share_locks[data]);
+}
+
+static void share_create(void) {
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share_locks[i], NULL);
+    }
+    share = curl_share_init();
+    if (!share) return;
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+}
+
+static void pool_init(void) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    share_create();
+}
+
+// "scheme://host:port" of url; requests with the same key can reuse a connection.
+static void host_key(const char *url, char *key) {
+    const char *start = strstr(url, "://");
+    start = start ? start + 3 : url;
+    size_t len = (size_t)(start - url) + strcspn(start, "/?#");
+    if (len >= HOST_KEY_LEN) len = HOST_KEY_LEN - 1;
+    memcpy(key, url, len);
+    key[len] = '\0';
+}
+
+CURL *http_curl_acquire(const char *url) {
+    pthread_once(&pool_once, pool_init);
+
+    char key[HOST_KEY_LEN];
+    host_key(url, key);
+
+    CURL *curl = NULL;
+    pthread_mutex_lock(&pool_lock);
+    for (int i = idle_count - 1; i >= 0; i--) {
+        if (strcmp(idle[i].host, key) == 0) {
+            curl = idle[i].curl;
+            idle[i] = idle[--idle_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (curl) {
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) return NULL;
+    }
+
+    if (share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    }
+    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, "");
+    return curl;
+}
+
+// The handle is keyed by where it last connected, after redirects. When the
+// pool is full the oldest idle handle is closed.
+void http_curl_release(CURL *curl) {
+    if (!curl) return;
+
+    char *effective = NULL;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective);
+    char key[HOST_KEY_LEN];
+    host_key(effective ? effective : "", key);
+
+    CURL *evicted = NULL;
+    pthread_mutex_lock(&pool_lock);
+    if (idle_count == POOL_SIZE) {
+        evicted = idle[0].curl;
+        memmove(idle, idle + 1, sizeof(PooledHandle) * (POOL_SIZE - 1));
+        idle_count--;
+    }
+    strcpy(idle[idle_count].host, key);
+    idle[idle_count].curl = curl;
+    idle_count++;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (evicted) {
+        curl_easy_cleanup(evicted);
+    }
+}
+
+// A forked child must not reuse connections or TLS state it shares with its
+// parent. The inherited handles are forgotten, not cleaned up, since closing
+// them would also shut down the parent's TLS sessions.
+void http_pool_after_fork(void) {
+    if (!share) return;
+    pthread_mutex_init(&pool_lock, NULL);
+    idle_count = 0;
+    share_create();
+}
+
+#else
+
+void http_pool_after_fork(void) {
+}
+
+#endif
@@ -3,18 +3,19 @@
 
 #ifndef _WIN32
 
-#include <curl/curl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "http_cache.h"
+#include "http_curl.h"
+#include "http_policy.h"
+#include "../core/interpreter.h"
+#include "../runtime/eval.h"
+#include "../runtime/json.h"
 #include "../util/error.h"
-
-typedef struct {
-    char *data;
-    size_t len;
-    size_t cap;
-} HttpBuffer;
+#include "../util/memory.h"
 
 static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t total_size = size * nmemb;
@@ -29,6 +30,10 @@ static size_t write_callback(void *contents, size_t size, size_t nmemb, void *us
         while (buffer->len + total_size + 1 > new_cap) {
             new_cap *= 2;
         }
+        // The body counts against --max-memory; returning short aborts the transfer.
+        if (!memory_fits(new_cap)) {
+            return 0;
+        }
         buffer->data = (char*)realloc(buffer->data, new_cap);
         buffer->cap = new_cap;
     }
@@ -40,14 +45,17 @@ static size_t write_callback(void *contents, size_t size, size_t nmemb, void *us
     return total_size;
 }
 
-char *http_request_unix_response(const char *method, const char *url, const char *body) {
-    CURL *curl = curl_easy_init();
+// Sets up a pooled easy handle that writes the response body into buffer.
+// The caller frees *headers and hands the handle back with
+// http_curl_release() after the transfer.
+CURL *http_curl_prepare(const char *method, const char *url, const char *body, HttpBuffer *buffer,
+                        struct curl_slist **headers_out) {
+    CURL *curl = http_curl_acquire(url);
     if (!curl) {
         report_error("HTTP: Failed to initialize curl");
         return NULL;
     }
 
-    HttpBuffer buffer = {0};
     struct curl_slist *headers = NULL;
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
@@ -55,7 +63,7 @@ char *http_request_unix_response(const char *method, const char *url, const char
     if (strcmp(method, "POST") == 0) {
         curl_easy_setopt(curl, CURLOPT_POST, 1L);
         if (body) {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+            curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, body);
             headers = curl_slist_append(headers, "Content-Type: application/json");
         }
     } else if (strcmp(method, "GET") == 0) {
@@ -63,7 +71,7 @@ char *http_request_unix_response(const char *method, const char *url, const char
     } else if (strcmp(method, "PUT") == 0) {
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
         if (body) {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+            curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, body);
             headers = curl_slist_append(headers, "Content-Type: application/json");
         }
     } else if (strcmp(method, "DELETE") == 0) {
@@ -77,9 +85,26 @@ char *http_request_unix_response(const char *method, const char *url, const char
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "NaC/1.0");
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
+    http_curl_apply_timeouts(curl);
+
+    *headers_out = headers;
+    return curl;
+}
+
+char *http_request_unix_response(const char *method, const char *url, const char *body) {
+    if (strcmp(method, "GET") == 0 && http_cache_enabled()) {
+        return http_cache_get(url);
+    }
+
+    HttpBuffer buffer = {0};
+    struct curl_slist *headers = NULL;
+    CURL *curl = http_curl_prepare(method, url, body, &buffer, &headers);
+    if (!curl) {
+        return NULL;
+    }
 
-    CURLcode res = curl_easy_perform(curl);
+    CURLcode res = http_perform(curl, &buffer, strcmp(method, "GET") == 0);
     if (res != CURLE_OK) {
         char error_msg[256];
         snprintf(error_msg, sizeof(error_msg), "HTTP: %s", curl_easy_strerror(res));
@@ -91,7 +116,7 @@ char *http_request_unix_response(const char *method, const char *url, const char
     if (headers) {
         curl_slist_free_all(headers);
     }
-    curl_easy_cleanup(curl);
+    http_curl_release(curl);
 
     if (!buffer.data) {
         return NULL;
@@ -100,6 +125,69 @@ char *http_request_unix_response(const char *method, const char *url, const char
     return buffer.data;
 }
 
+static size_t json_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t total = size * nmemb;
+    return json_stream_feed((JsonStream*)userp, (const char*)contents, total) ? total : 0;
+}
+
+// Feeds the body to an incremental parser as it arrives, so parsing overlaps
+// the transfer. With a path ("data.items.0") only that value is returned and
+// the transfer stops as soon as it is complete. Gives "" if the request
+// failed and 0 if the body is not valid JSON, like the buffered httpJson.
+void http_json_unix(const char *method, const char *url, const char *body, const char *path, Value *out) {
+    // Cached and hedged bodies come whole, so they are parsed in one go.
+    bool is_get = strcmp(method, "GET") == 0;
+    if (is_get && (http_cache_enabled() || http_hedging())) {
+        char *text = http_request_unix_response(method, url, body);
+        if (!text) {
+            *out = make_string("");
+            return;
+        }
+        JsonStream *stream = json_stream_create(path);
+        json_stream_feed(stream, text, strlen(text));
+        if (!json_stream_finish(stream, out)) {
+            if (!nac_ctx->halted) {
+                report_error("httpJson() response is not valid JSON");
+            }
+            *out = make_int(0);
+        }
+        json_stream_free(stream);
+        free(text);
+        return;
+    }
+
+    struct curl_slist *headers = NULL;
+    CURL *curl = http_curl_prepare(method, url, body, NULL, &headers);
+    if (!curl) {
+        *out = make_string("");
+        return;
+    }
+
+    JsonStream *stream = json_stream_create(path);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, json_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, stream);
+
+    // A write error means the parser stopped: bad JSON or the path was found.
+    CURLcode res = http_perform(curl, NULL, false);
+    if (res != CURLE_OK && res != CURLE_WRITE_ERROR) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "HTTP: %s", curl_easy_strerror(res));
+        report_error(error_msg);
+        *out = make_string("");
+    } else if (!json_stream_finish(stream, out)) {
+        if (!nac_ctx->halted) {
+            report_error("httpJson() response is not valid JSON");
+        }
+        *out = make_int(0);
+    }
+
+    json_stream_free(stream);
+    if (headers) {
+        curl_slist_free_all(headers);
+    }
+    http_curl_release(curl);
+}
+
 void http_request_unix(const char *method, const char *url, const char *body) {
     char *response = http_request_unix_response(method, url, body);
     if (response) {
@@ -108,8 +196,155 @@ void http_request_unix(const char *method, const char *url, const char *body) {
     }
 }
 
+static bool perform(CURL *curl, const char *op) {
+    CURLcode res = http_perform(curl, NULL, false);
+    if (res != CURLE_OK) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", op, curl_easy_strerror(res));
+        report_error(error_msg);
+        return false;
+    }
+    return true;
+}
+
+static size_t file_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    return fwrite(contents, size, nmemb, (FILE*)userp);
+}
+
+// Writes the body to path as it arrives. Returns the bytes written, or -1
+// if the transfer failed or the server answered with an error status.
+// The body goes to a temporary file that is renamed into place only once
+// the whole transfer has succeeded, so a failed download leaves an existing
+// file untouched.
+long http_download(const char *method, const char *url, const char *body, const char *path) {
+    char msg[MAX_STRING_LEN + 64];
+    char tmp_path[MAX_STRING_LEN + 32];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE *f = (n > 0 && (size_t)n < sizeof(tmp_path)) ? fopen(tmp_path, "wb") : NULL;
+    if (!f) {
+        snprintf(msg, sizeof(msg), "httpDownload: cannot open %s", path);
+        report_error(msg);
+        return -1;
+    }
+
+    struct curl_slist *headers = NULL;
+    CURL *curl = http_curl_prepare(method, url, body, NULL, &headers);
+    if (!curl) {
+        fclose(f);
+        remove(tmp_path);
+        return -1;
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, file_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+
+    long written = -1;
+    if (perform(curl, "httpDownload")) {
+        written = ftell(f);
+    }
+
+    if (headers) {
+        curl_slist_free_all(headers);
+    }
+    http_curl_release(curl);
+    if (fclose(f) != 0) {
+        written = -1;
+    }
+    if (written >= 0 && rename(tmp_path, path) != 0) {
+        snprintf(msg, sizeof(msg), "httpDownload: cannot write %s", path);
+        report_error(msg);
+        written = -1;
+    }
+    if (written < 0) {
+        remove(tmp_path);
+    }
+    return written;
+}
+
+// Cuts the body into lines for httpStream. A line longer than a string is
+// passed on in string-sized pieces.
+typedef struct {
+    Function *func;
+    char line[MAX_STRING_LEN];
+    size_t len;
+    int error_count;
+} LineStream;
+
+static bool stream_emit(LineStream *stream) {
+    if (stream->len > 0 && stream->line[stream->len - 1] == '\r') {
+        stream->len--;
+    }
+    stream->line[stream->len] = '\0';
+    stream->len = 0;
+
+    Value arg = make_string(stream->line);
+    Value result = call_function(stream->func, &arg, 1);
+    nac_ctx->return_value = make_int(0);
+    free_value(&result);
+    return nac_ctx->error_count == stream->error_count;
+}
+
+static size_t line_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    LineStream *stream = (LineStream*)userp;
+    const char *data = (const char*)contents;
+    size_t total = size * nmemb;
+
+    for (size_t i = 0; i < total; i++) {
+        if (data[i] == '\n') {
+            if (!stream_emit(stream)) return 0;
+            continue;
+        }
+        stream->line[stream->len++] = data[i];
+        if (stream->len == MAX_STRING_LEN - 1 && !stream_emit(stream)) return 0;
+    }
+    return total;
+}
+
+// Calls func_name(line) for each line of the body while it downloads.
+// Returns the HTTP status, or 0 if the transfer failed. An error in the
+// callback stops the transfer.
+int http_stream(const char *method, const char *url, const char *body, const char *func_name) {
+    LineStream *stream = (LineStream*)calloc(1, sizeof(LineStream));
+    stream->func = find_function(func_name);
+    if (!stream->func) {
+        char msg[MAX_TOKEN_LEN + 32];
+        snprintf(msg, sizeof(msg), "Undefined function: %s", func_name);
+        report_error(msg);
+        free(stream);
+        return 0;
+    }
+    stream->error_count = nac_ctx->error_count;
+
+    struct curl_slist *headers = NULL;
+    CURL *curl = http_curl_prepare(method, url, body, NULL, &headers);
+    if (!curl) {
+        free(stream);
+        return 0;
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, line_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, stream);
+
+    long status = 0;
+    bool ok = perform(curl, "httpStream");
+    if (ok && stream->len > 0) {
+        stream_emit(stream);
+    }
+    if (ok) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    }
+
+    if (headers) {
+        curl_slist_free_all(headers);
+    }
+    http_curl_release(curl);
+    free(stream);
+    return (int)status;
+}
+
 #else
 
+#include "../util/error.h"
+
 char *http_request_unix_response(const char *method, const char *url, const char *body) {
     (void)method;
     (void)url;
@@ -123,6 +358,24 @@ void http_request_unix(const char *method, const char *url, const char *body) {
     (void)body;
 }
 
+long http_download(const char *method, const char *url, const char *body, const char *path) {
+    (void)method;
+    (void)url;
+    (void)body;
+    (void)path;
+    report_error("httpDownload() is not supported on Windows");
+    return -1;
+}
+
+int http_stream(const char *method, const char *url, const char *body, const char *func_name) {
+    (void)method;
+    (void)url;
+    (void)body;
+    (void)func_name;
+    report_error("httpStream() is not supported on Windows");
+    return 0;
+}
+
 #endif
 
 
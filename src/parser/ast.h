@@ -1,8 +1,13 @@
 #ifndef NAC_AST_H
 #define NAC_AST_H
 
+#include <stdatomic.h>
+
 #include "../lexer/token.h"
 
+// Sized so an import node is no larger than a string literal node.
+#define MAX_IMPORT_PATH (MAX_STRING_LEN - MAX_TOKEN_LEN)
+
 typedef enum {
     AST_INT_LITERAL,
     AST_FLOAT_LITERAL,
@@ -26,11 +31,16 @@ typedef enum {
     AST_DECREMENT,
     AST_ARRAY_LITERAL,
     AST_WHILE,
-    AST_HTTP
+    AST_HTTP,
+    AST_IMPORT,
+    AST_YIELD,
+    AST_FOR_IN
 } ASTNodeType;
 
 typedef struct ASTNode {
     ASTNodeType type;
+    int line;
+    int col;
     union {
         int int_val;
         double float_val;
@@ -62,6 +72,9 @@ typedef struct ASTNode {
             char func_name[MAX_TOKEN_LEN];
             struct ASTNode **args;
             int arg_count;
+            // Built-in target, resolved on first call; bodies can be shared
+            // by worker threads, hence atomic.
+            _Atomic(const struct NativeDef *) native;
         } call;
         struct {
             struct ASTNode **statements;
@@ -84,6 +97,9 @@ typedef struct ASTNode {
         struct {
             struct ASTNode *value;
         } out_stmt;
+        struct {
+            struct ASTNode *value;
+        } yield_stmt;
         struct {
             char var_name[MAX_TOKEN_LEN];
         } in_stmt;
@@ -98,11 +114,20 @@ typedef struct ASTNode {
             struct ASTNode *condition;
             struct ASTNode *body;
         } while_stmt;
+        struct {
+            char var_name[MAX_TOKEN_LEN];
+            struct ASTNode *iterable;
+            struct ASTNode *body;
+        } for_in;
         struct {
             struct ASTNode *method;
             struct ASTNode *url;
             struct ASTNode *body;
         } http_stmt;
+        struct {
+            char path[MAX_IMPORT_PATH];
+            char alias[MAX_TOKEN_LEN];
+        } import_stmt;
     };
 } ASTNode;
 
@@ -0,0 +1,305 @@
+#include "ast_io.h"
+
+#include <string.h>
+
+#include "../util/memory.h"
+
+#define AST_NULL_TAG 0xFF
+#define AST_MAX_DEPTH 10000
+
+static void write_list(ByteBuf *buf, ASTNode **nodes, int count) {
+    bytebuf_put_varint(buf, (uint64_t)count);
+    for (int i = 0; i < count; i++) {
+        ast_write(buf, nodes[i]);
+    }
+}
+
+void ast_write(ByteBuf *buf, const ASTNode *node) {
+    if (!node) {
+        bytebuf_put_u8(buf, AST_NULL_TAG);
+        return;
+    }
+
+    bytebuf_put_u8(buf, (unsigned char)node->type);
+    bytebuf_put_varint(buf, (uint64_t)(node->line > 0 ? node->line : 0));
+    bytebuf_put_varint(buf, (uint64_t)(node->col > 0 ? node->col : 0));
+
+    switch (node->type) {
+        case AST_INT_LITERAL:
+            bytebuf_put_int(buf, node->int_val);
+            break;
+        case AST_FLOAT_LITERAL:
+            bytebuf_put_double(buf, node->float_val);
+            break;
+        case AST_STRING_LITERAL:
+            bytebuf_put_str(buf, node->str_val);
+            break;
+        case AST_VARIABLE:
+            bytebuf_put_str(buf, node->var_name);
+            break;
+        case AST_ARRAY_ACCESS:
+            bytebuf_put_str(buf, node->array_access.var_name);
+            ast_write(buf, node->array_access.index);
+            break;
+        case AST_BINARY_OP:
+            bytebuf_put_varint(buf, (uint64_t)node->binary.op);
+            ast_write(buf, node->binary.left);
+            ast_write(buf, node->binary.right);
+            break;
+        case AST_UNARY_OP:
+            bytebuf_put_varint(buf, (uint64_t)node->unary.op);
+            ast_write(buf, node->unary.operand);
+            break;
+        case AST_ASSIGN:
+            bytebuf_put_str(buf, node->assign.var_name);
+            ast_write(buf, node->assign.value);
+            break;
+        case AST_ARRAY_ASSIGN:
+            bytebuf_put_str(buf, node->array_assign.var_name);
+            ast_write(buf, node->array_assign.index);
+            ast_write(buf, node->array_assign.value);
+            break;
+        case AST_CALL:
+            bytebuf_put_str(buf, node->call.func_name);
+            write_list(buf, node->call.args, node->call.arg_count);
+            break;
+        case AST_BLOCK:
+            write_list(buf, node->block.statements, node->block.count);
+            break;
+        case AST_IF:
+            ast_write(buf, node->if_stmt.condition);
+            ast_write(buf, node->if_stmt.then_block);
+            ast_write(buf, node->if_stmt.else_block);
+            break;
+        case AST_FOR:
+            ast_write(buf, node->for_stmt.init);
+            ast_write(buf, node->for_stmt.condition);
+            ast_write(buf, node->for_stmt.increment);
+            ast_write(buf, node->for_stmt.body);
+            break;
+        case AST_WHILE:
+            ast_write(buf, node->while_stmt.condition);
+            ast_write(buf, node->while_stmt.body);
+            break;
+        case AST_RETURN:
+            ast_write(buf, node->return_stmt.value);
+            break;
+        case AST_OUT:
+            ast_write(buf, node->out_stmt.value);
+            break;
+        case AST_YIELD:
+            ast_write(buf, node->yield_stmt.value);
+            break;
+        case AST_FOR_IN:
+            bytebuf_put_str(buf, node->for_in.var_name);
+            ast_write(buf, node->for_in.iterable);
+            ast_write(buf, node->for_in.body);
+            break;
+        case AST_IN:
+            bytebuf_put_str(buf, node->in_stmt.var_name);
+            break;
+        case AST_INCREMENT:
+        case AST_DECREMENT:
+            bytebuf_put_str(buf, node->inc_dec.var_name);
+            break;
+        case AST_ARRAY_LITERAL:
+            write_list(buf, node->array_literal.elements, node->array_literal.count);
+            break;
+        case AST_HTTP:
+            ast_write(buf, node->http_stmt.method);
+            ast_write(buf, node->http_stmt.url);
+            ast_write(buf, node->http_stmt.body);
+            break;
+        case AST_IMPORT:
+            bytebuf_put_str(buf, node->import_stmt.path);
+            bytebuf_put_str(buf, node->import_stmt.alias);
+            break;
+        case AST_BREAK:
+        case AST_CONTINUE:
+            break;
+    }
+}
+
+static ASTNode *read_node(ByteReader *r, int depth);
+
+static ASTNode **read_list(ByteReader *r, int *count, int depth) {
+    uint64_t n = reader_varint(r);
+    if (r->failed || n > r->len - r->pos) {
+        r->failed = true;
+        *count = 0;
+        return NULL;
+    }
+
+    ASTNode **nodes = (ASTNode**)nac_alloc(MEM_AST, sizeof(ASTNode*) * (n > 0 ? n : 1));
+    *count = 0;
+    for (uint64_t i = 0; i < n && !r->failed; i++) {
+        nodes[(*count)++] = read_node(r, depth + 1);
+    }
+    return nodes;
+}
+
+static ASTNode *read_node(ByteReader *r, int depth) {
+    unsigned char tag = reader_u8(r);
+    if (r->failed || tag == AST_NULL_TAG) {
+        return NULL;
+    }
+    if (depth > AST_MAX_DEPTH || tag > AST_FOR_IN) {
+        r->failed = true;
+        return NULL;
+    }
+
+    ASTNode *node = (ASTNode*)nac_calloc(MEM_AST, 1, sizeof(ASTNode));
+    node->type = (ASTNodeType)tag;
+    node->line = (int)reader_varint(r);
+    node->col = (int)reader_varint(r);
+
+    switch (node->type) {
+        case AST_INT_LITERAL:
+            node->int_val = (int)reader_int(r);
+            break;
+        case AST_FLOAT_LITERAL:
+            node->float_val = reader_double(r);
+            break;
+        case AST_STRING_LITERAL:
+            reader_str(r, node->str_val, sizeof(node->str_val));
+            break;
+        case AST_VARIABLE:
+            reader_str(r, node->var_name, sizeof(node->var_name));
+            break;
+        case AST_ARRAY_ACCESS:
+            reader_str(r, node->array_access.var_name, sizeof(node->array_access.var_name));
+            node->array_access.index = read_node(r, depth + 1);
+            break;
+        case AST_BINARY_OP:
+            node->binary.op = (NaCTokenType)reader_varint(r);
+            node->binary.left = read_node(r, depth + 1);
+            node->binary.right = read_node(r, depth + 1);
+            break;
+        case AST_UNARY_OP:
+            node->unary.op = (NaCTokenType)reader_varint(r);
+            node->unary.operand = read_node(r, depth + 1);
+            break;
+        case AST_ASSIGN:
+            reader_str(r, node->assign.var_name, sizeof(node->assign.var_name));
+            node->assign.value = read_node(r, depth + 1);
+            break;
+        case AST_ARRAY_ASSIGN:
+            reader_str(r, node->array_assign.var_name, sizeof(node->array_assign.var_name));
+            node->array_assign.index = read_node(r, depth + 1);
+            node->array_assign.value = read_node(r, depth + 1);
+            break;
+        case AST_CALL:
+            reader_str(r, node->call.func_name, sizeof(node->call.func_name));
+            node->call.args = read_list(r, &node->call.arg_count, depth);
+            break;
+        case AST_BLOCK:
+            node->block.statements = read_list(r, &node->block.count, depth);
+            break;
+        case AST_IF:
+            node->if_stmt.condition = read_node(r, depth + 1);
+            node->if_stmt.then_block = read_node(r, depth + 1);
+            node->if_stmt.else_block = read_node(r, depth + 1);
+            break;
+        case AST_FOR:
+            node->for_stmt.init = read_node(r, depth + 1);
+            node->for_stmt.condition = read_node(r, depth + 1);
+            node->for_stmt.increment = read_node(r, depth + 1);
+            node->for_stmt.body = read_node(r, depth + 1);
+            break;
+        case AST_WHILE:
+            node->while_stmt.condition = read_node(r, depth + 1);
+            node->while_stmt.body = read_node(r, depth + 1);
+            break;
+        case AST_RETURN:
+            node->return_stmt.value = read_node(r, depth + 1);
+            break;
+        case AST_OUT:
+            node->out_stmt.value = read_node(r, depth + 1);
+            break;
+        case AST_YIELD:
+            node->yield_stmt.value = read_node(r, depth + 1);
+            break;
+        case AST_FOR_IN:
+            reader_str(r, node->for_in.var_name, sizeof(node->for_in.var_name));
+            node->for_in.iterable = read_node(r, depth + 1);
+            node->for_in.body = read_node(r, depth + 1);
+            break;
+        case AST_IN:
+            reader_str(r, node->in_stmt.var_name, sizeof(node->in_stmt.var_name));
+            break;
+        case AST_INCREMENT:
+        case AST_DECREMENT:
+            reader_str(r, node->inc_dec.var_name, sizeof(node->inc_dec.var_name));
+            break;
+        case AST_ARRAY_LITERAL:
+            node->array_literal.elements = read_list(r, &node->array_literal.count, depth);
+            break;
+        case AST_HTTP:
+            node->http_stmt.method = read_node(r, depth + 1);
+            node->http_stmt.url = read_node(r, depth + 1);
+            node->http_stmt.body = read_node(r, depth + 1);
+            break;
+        case AST_IMPORT:
+            reader_str(r, node->import_stmt.path, sizeof(node->import_stmt.path));
+            reader_str(r, node->import_stmt.alias, sizeof(node->import_stmt.alias));
+            break;
+        case AST_BREAK:
+        case AST_CONTINUE:
+            break;
+    }
+
+    return node;
+}
+
+ASTNode *ast_read(ByteReader *r) {
+    ASTNode *node = read_node(r, 0);
+    if (r->failed) {
+        free_ast(node);
+        return NULL;
+    }
+    return node;
+}
+
+void function_write(ByteBuf *buf, const Function *func) {
+    bytebuf_put_str(buf, func->name);
+    bytebuf_put_varint(buf, (uint64_t)func->param_count);
+    for (int i = 0; i < func->param_count; i++) {
+        bytebuf_put_str(buf, func->params[i]);
+    }
+    bytebuf_put_varint(buf, (func->is_async ? 1 : 0) | (func->is_generator ? 2 : 0));
+
+    // Length-prefixed so readers can skip the body and decode it on first call.
+    ByteBuf body;
+    bytebuf_init(&body);
+    ast_write(&body, func->body);
+    bytebuf_put_varint(buf, (uint64_t)body.len);
+    bytebuf_put(buf, body.data, body.len);
+    bytebuf_free(&body);
+}
+
+// The body is left encoded in func->body_blob, which points into the reader's
+// buffer; parse_function_body() decodes it on first call.
+bool function_read(ByteReader *r, Function *func) {
+    memset(func, 0, sizeof(Function));
+    func->body_start = -1;
+
+    reader_str(r, func->name, sizeof(func->name));
+    uint64_t param_count = reader_varint(r);
+    if (param_count > MAX_PARAMS) {
+        r->failed = true;
+        return false;
+    }
+
+    func->param_count = (int)param_count;
+    for (int i = 0; i < func->param_count; i++) {
+        reader_str(r, func->params[i], sizeof(func->params[i]));
+    }
+    uint64_t flags = reader_varint(r);
+    func->is_async = (flags & 1) != 0;
+    func->is_generator = (flags & 2) != 0;
+
+    uint64_t body_len = reader_varint(r);
+    func->body_blob = (const unsigned char*)reader_take(r, (size_t)body_len);
+    func->body_blob_len = (size_t)body_len;
+    return !r->failed;
+}
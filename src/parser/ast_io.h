@@ -0,0 +1,15 @@
+#ifndef NAC_AST_IO_H
+#define NAC_AST_IO_H
+
+#include <stdbool.h>
+
+#include "../util/bytebuf.h"
+#include "parser.h"
+
+void ast_write(ByteBuf *buf, const ASTNode *node);
+ASTNode *ast_read(ByteReader *r);
+
+void function_write(ByteBuf *buf, const Function *func);
+bool function_read(ByteReader *r, Function *func);
+
+#endif
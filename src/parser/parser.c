@@ -3,15 +3,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include "../core/interpreter.h"
 #include "../lexer/lexer.h"
+#include "../module/source_module.h"
+#include "ast_io.h"
 #include "../util/error.h"
+#include "../util/memory.h"
 
 static ASTNode *create_node(ASTNodeType type) {
-    ASTNode *node = (ASTNode*)calloc(1, sizeof(ASTNode));
+    ASTNode *node = (ASTNode*)nac_calloc(MEM_AST, 1, sizeof(ASTNode));
     node->type = type;
+    node->line = nac_ctx->current_token.line;
+    node->col = nac_ctx->current_token.col;
     return node;
 }
 
@@ -40,13 +44,13 @@ void free_ast(ASTNode *node) {
             for (int i = 0; i < node->call.arg_count; i++) {
                 free_ast(node->call.args[i]);
             }
-            free(node->call.args);
+            nac_free(node->call.args);
             break;
         case AST_BLOCK:
             for (int i = 0; i < node->block.count; i++) {
                 free_ast(node->block.statements[i]);
             }
-            free(node->block.statements);
+            nac_free(node->block.statements);
             break;
         case AST_IF:
             free_ast(node->if_stmt.condition);
@@ -63,12 +67,19 @@ void free_ast(ASTNode *node) {
             free_ast(node->while_stmt.condition);
             free_ast(node->while_stmt.body);
             break;
+        case AST_FOR_IN:
+            free_ast(node->for_in.iterable);
+            free_ast(node->for_in.body);
+            break;
         case AST_RETURN:
             free_ast(node->return_stmt.value);
             break;
         case AST_OUT:
             free_ast(node->out_stmt.value);
             break;
+        case AST_YIELD:
+            free_ast(node->yield_stmt.value);
+            break;
         case AST_HTTP:
             free_ast(node->http_stmt.method);
             free_ast(node->http_stmt.url);
@@ -78,19 +89,19 @@ void free_ast(ASTNode *node) {
             for (int i = 0; i < node->array_literal.count; i++) {
                 free_ast(node->array_literal.elements[i]);
             }
-            free(node->array_literal.elements);
+            nac_free(node->array_literal.elements);
             break;
         default:
             break;
     }
 
-    free(node);
+    nac_free(node);
 }
 
 static void expect(NaCTokenType type) {
-    if (current_token.type != type) {
+    if (nac_ctx->current_token.type != type) {
         char msg[256];
-        snprintf(msg, sizeof(msg), "Expected token type %d, got %d", type, current_token.type);
+        snprintf(msg, sizeof(msg), "Expected token type %d, got %d", type, nac_ctx->current_token.type);
         report_error(msg);
         next_token();
     } else {
@@ -101,33 +112,33 @@ static void expect(NaCTokenType type) {
 static ASTNode *parse_primary(void) {
     ASTNode *node = NULL;
 
-    if (current_token.type == TOK_INT) {
+    if (nac_ctx->current_token.type == TOK_INT) {
         node = create_node(AST_INT_LITERAL);
-        node->int_val = current_token.int_val;
+        node->int_val = nac_ctx->current_token.int_val;
         next_token();
         return node;
     }
 
-    if (current_token.type == TOK_FLOAT) {
+    if (nac_ctx->current_token.type == TOK_FLOAT) {
         node = create_node(AST_FLOAT_LITERAL);
-        node->float_val = current_token.float_val;
+        node->float_val = nac_ctx->current_token.float_val;
         next_token();
         return node;
     }
 
-    if (current_token.type == TOK_STRING) {
+    if (nac_ctx->current_token.type == TOK_STRING) {
         node = create_node(AST_STRING_LITERAL);
-        strncpy(node->str_val, current_token.str_val, MAX_STRING_LEN - 1);
+        strncpy(node->str_val, nac_ctx->current_token.str_val, MAX_STRING_LEN - 1);
         next_token();
         return node;
     }
 
-    if (current_token.type == TOK_IDENT) {
+    if (nac_ctx->current_token.type == TOK_IDENT) {
         char name[MAX_TOKEN_LEN];
-        strncpy(name, current_token.ident, MAX_TOKEN_LEN - 1);
+        strncpy(name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
         next_token();
 
-        if (current_token.type == TOK_LBRACKET) {
+        if (nac_ctx->current_token.type == TOK_LBRACKET) {
             next_token();
             ASTNode *index = parse_expression();
             expect(TOK_RBRACKET);
@@ -137,28 +148,28 @@ static ASTNode *parse_primary(void) {
             return node;
         }
 
-        if (current_token.type == TOK_LPAREN) {
+        if (nac_ctx->current_token.type == TOK_LPAREN) {
             next_token();
             node = create_node(AST_CALL);
             strncpy(node->call.func_name, name, MAX_TOKEN_LEN - 1);
 
             int capacity = 4;
-            node->call.args = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+            node->call.args = (ASTNode**)nac_alloc(MEM_AST, sizeof(ASTNode*) * capacity);
             node->call.arg_count = 0;
 
-            if (current_token.type != TOK_RPAREN) {
+            if (nac_ctx->current_token.type != TOK_RPAREN) {
                 do {
                     if (node->call.arg_count >= capacity) {
                         capacity *= 2;
-                        node->call.args = (ASTNode**)realloc(node->call.args, sizeof(ASTNode*) * capacity);
+                        node->call.args = (ASTNode**)nac_realloc(MEM_AST, node->call.args, sizeof(ASTNode*) * capacity);
                     }
                     node->call.args[node->call.arg_count++] = parse_expression();
-                    if (current_token.type == TOK_COMMA) {
+                    if (nac_ctx->current_token.type == TOK_COMMA) {
                         next_token();
                     } else {
                         break;
                     }
-                } while (current_token.type != TOK_RPAREN && current_token.type != TOK_EOF);
+                } while (nac_ctx->current_token.type != TOK_RPAREN && nac_ctx->current_token.type != TOK_EOF);
             }
             expect(TOK_RPAREN);
             return node;
@@ -169,16 +180,18 @@ static ASTNode *parse_primary(void) {
         return node;
     }
 
-    if (current_token.type == TOK_TIME) {
+    if (nac_ctx->current_token.type == TOK_TIME) {
         next_token();
         expect(TOK_LPAREN);
         expect(TOK_RPAREN);
-        node = create_node(AST_INT_LITERAL);
-        node->int_val = (int)time(NULL);
+        node = create_node(AST_CALL);
+        strncpy(node->call.func_name, "time", MAX_TOKEN_LEN - 1);
+        node->call.args = NULL;
+        node->call.arg_count = 0;
         return node;
     }
 
-    if (current_token.type == TOK_ARRAY) {
+    if (nac_ctx->current_token.type == TOK_ARRAY) {
         next_token();
         expect(TOK_LPAREN);
         ASTNode *size_expr = parse_expression();
@@ -186,27 +199,27 @@ static ASTNode *parse_primary(void) {
 
         node = create_node(AST_ARRAY_LITERAL);
         node->array_literal.count = 1;
-        node->array_literal.elements = (ASTNode**)malloc(sizeof(ASTNode*));
+        node->array_literal.elements = (ASTNode**)nac_alloc(MEM_AST, sizeof(ASTNode*));
         node->array_literal.elements[0] = size_expr;
         return node;
     }
 
-    if (current_token.type == TOK_LBRACKET) {
+    if (nac_ctx->current_token.type == TOK_LBRACKET) {
         next_token();
         node = create_node(AST_ARRAY_LITERAL);
 
         int capacity = 4;
-        node->array_literal.elements = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+        node->array_literal.elements = (ASTNode**)nac_alloc(MEM_AST, sizeof(ASTNode*) * capacity);
         node->array_literal.count = 0;
 
-        if (current_token.type != TOK_RBRACKET) {
+        if (nac_ctx->current_token.type != TOK_RBRACKET) {
             do {
                 if (node->array_literal.count >= capacity) {
                     capacity *= 2;
-                    node->array_literal.elements = (ASTNode**)realloc(node->array_literal.elements, sizeof(ASTNode*) * capacity);
+                    node->array_literal.elements = (ASTNode**)nac_realloc(MEM_AST, node->array_literal.elements, sizeof(ASTNode*) * capacity);
                 }
                 node->array_literal.elements[node->array_literal.count++] = parse_expression();
-                if (current_token.type == TOK_COMMA) {
+                if (nac_ctx->current_token.type == TOK_COMMA) {
                     next_token();
                 } else {
                     break;
@@ -217,14 +230,14 @@ static ASTNode *parse_primary(void) {
         return node;
     }
 
-    if (current_token.type == TOK_LPAREN) {
+    if (nac_ctx->current_token.type == TOK_LPAREN) {
         next_token();
         node = parse_expression();
         expect(TOK_RPAREN);
         return node;
     }
 
-    if (current_token.type == TOK_MINUS) {
+    if (nac_ctx->current_token.type == TOK_MINUS) {
         next_token();
         node = create_node(AST_UNARY_OP);
         node->unary.op = TOK_MINUS;
@@ -232,7 +245,7 @@ static ASTNode *parse_primary(void) {
         return node;
     }
 
-    if (current_token.type == TOK_NOT) {
+    if (nac_ctx->current_token.type == TOK_NOT) {
         next_token();
         node = create_node(AST_UNARY_OP);
         node->unary.op = TOK_NOT;
@@ -240,6 +253,14 @@ static ASTNode *parse_primary(void) {
         return node;
     }
 
+    if (nac_ctx->current_token.type == TOK_AWAIT) {
+        next_token();
+        node = create_node(AST_UNARY_OP);
+        node->unary.op = TOK_AWAIT;
+        node->unary.operand = parse_primary();
+        return node;
+    }
+
     report_error("Expected expression");
     return create_node(AST_INT_LITERAL);
 }
@@ -247,10 +268,10 @@ static ASTNode *parse_primary(void) {
 static ASTNode *parse_multiplicative(void) {
     ASTNode *left = parse_primary();
 
-    while (current_token.type == TOK_STAR ||
-           current_token.type == TOK_SLASH ||
-           current_token.type == TOK_PERCENT) {
-        NaCTokenType op = current_token.type;
+    while (nac_ctx->current_token.type == TOK_STAR ||
+           nac_ctx->current_token.type == TOK_SLASH ||
+           nac_ctx->current_token.type == TOK_PERCENT) {
+        NaCTokenType op = nac_ctx->current_token.type;
         next_token();
         ASTNode *right = parse_primary();
 
@@ -267,8 +288,8 @@ static ASTNode *parse_multiplicative(void) {
 static ASTNode *parse_additive(void) {
     ASTNode *left = parse_multiplicative();
 
-    while (current_token.type == TOK_PLUS || current_token.type == TOK_MINUS) {
-        NaCTokenType op = current_token.type;
+    while (nac_ctx->current_token.type == TOK_PLUS || nac_ctx->current_token.type == TOK_MINUS) {
+        NaCTokenType op = nac_ctx->current_token.type;
         next_token();
         ASTNode *right = parse_multiplicative();
 
@@ -285,10 +306,10 @@ static ASTNode *parse_additive(void) {
 static ASTNode *parse_comparison(void) {
     ASTNode *left = parse_additive();
 
-    while (current_token.type == TOK_LT || current_token.type == TOK_GT ||
-           current_token.type == TOK_LTE || current_token.type == TOK_GTE ||
-           current_token.type == TOK_EQ || current_token.type == TOK_NEQ) {
-        NaCTokenType op = current_token.type;
+    while (nac_ctx->current_token.type == TOK_LT || nac_ctx->current_token.type == TOK_GT ||
+           nac_ctx->current_token.type == TOK_LTE || nac_ctx->current_token.type == TOK_GTE ||
+           nac_ctx->current_token.type == TOK_EQ || nac_ctx->current_token.type == TOK_NEQ) {
+        NaCTokenType op = nac_ctx->current_token.type;
         next_token();
         ASTNode *right = parse_additive();
 
@@ -305,8 +326,8 @@ static ASTNode *parse_comparison(void) {
 static ASTNode *parse_logical(void) {
     ASTNode *left = parse_comparison();
 
-    while (current_token.type == TOK_AND || current_token.type == TOK_OR) {
-        NaCTokenType op = current_token.type;
+    while (nac_ctx->current_token.type == TOK_AND || nac_ctx->current_token.type == TOK_OR) {
+        NaCTokenType op = nac_ctx->current_token.type;
         next_token();
         ASTNode *right = parse_comparison();
 
@@ -329,15 +350,15 @@ static ASTNode *parse_block(void) {
 
     ASTNode *block = create_node(AST_BLOCK);
     int capacity = 8;
-    block->block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+    block->block.statements = (ASTNode**)nac_alloc(MEM_AST, sizeof(ASTNode*) * capacity);
     block->block.count = 0;
 
-    while (current_token.type != TOK_RBRACE && current_token.type != TOK_EOF) {
-        if (should_break || should_continue || should_return) break;
+    while (nac_ctx->current_token.type != TOK_RBRACE && nac_ctx->current_token.type != TOK_EOF) {
+        if (nac_ctx->should_break || nac_ctx->should_continue || nac_ctx->should_return) break;
 
         if (block->block.count >= capacity) {
             capacity *= 2;
-            block->block.statements = (ASTNode**)realloc(block->block.statements, sizeof(ASTNode*) * capacity);
+            block->block.statements = (ASTNode**)nac_realloc(MEM_AST, block->block.statements, sizeof(ASTNode*) * capacity);
         }
 
         ASTNode *stmt = parse_statement();
@@ -350,47 +371,86 @@ static ASTNode *parse_block(void) {
     return block;
 }
 
+static ASTNode *parse_statement_inner(void);
+
+// While parsing, errors point at the lexer's token rather than at the
+// statement being run.
 ASTNode *parse_statement(void) {
-    if (current_token.type == TOK_FN) {
+    nac_ctx->parse_depth++;
+    ASTNode *stmt = parse_statement_inner();
+    nac_ctx->parse_depth--;
+    return stmt;
+}
+
+static ASTNode *parse_statement_inner(void) {
+    bool is_async = false;
+    if (nac_ctx->current_token.type == TOK_ASYNC) {
+        next_token();
+        if (nac_ctx->current_token.type != TOK_FN) {
+            report_error("Expected fn after async");
+            return NULL;
+        }
+        is_async = true;
+    }
+
+    if (nac_ctx->current_token.type == TOK_FN) {
         next_token();
 
-        if (current_token.type != TOK_IDENT) {
+        if (nac_ctx->current_token.type != TOK_IDENT) {
             report_error("Expected function name");
             return NULL;
         }
 
-        Function *func = &functions[func_count++];
-        strncpy(func->name, current_token.ident, MAX_TOKEN_LEN - 1);
+        Function func;
+        memset(&func, 0, sizeof(func));
+        strncpy(func.name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
+        func.is_async = is_async;
         next_token();
 
         expect(TOK_LPAREN);
-        func->param_count = 0;
+        func.param_count = 0;
 
-        if (current_token.type != TOK_RPAREN) {
+        if (nac_ctx->current_token.type != TOK_RPAREN) {
             do {
-                if (current_token.type != TOK_IDENT) {
+                if (nac_ctx->current_token.type != TOK_IDENT) {
                     report_error("Expected parameter name");
                     break;
                 }
-                strncpy(func->params[func->param_count++], current_token.ident, MAX_TOKEN_LEN - 1);
+                strncpy(func.params[func.param_count++], nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
                 next_token();
 
-                if (current_token.type == TOK_COMMA) {
+                if (nac_ctx->current_token.type == TOK_COMMA) {
                     next_token();
                 } else {
                     break;
                 }
-            } while (func->param_count < MAX_PARAMS);
+            } while (func.param_count < MAX_PARAMS);
         }
 
         expect(TOK_RPAREN);
-        func->body = parse_block();
+        func.body = NULL;
+        func.body_start = -1;
+        func.body_blob = NULL;
+        func.body_blob_len = 0;
+
+        // Only the token range is recorded here; the body is parsed on first call.
+        if (nac_ctx->eager_parsing || nac_ctx->current_token.type != TOK_LBRACE || nac_ctx->current_token.match < 0) {
+            bool outer_yield = nac_ctx->saw_yield;
+            nac_ctx->saw_yield = false;
+            func.body = parse_block();
+            func.is_generator = nac_ctx->saw_yield;
+            nac_ctx->saw_yield = outer_yield;
+        } else {
+            func.body_start = lexer_position();
+            lexer_seek(nac_ctx->current_token.match + 1);
+        }
         expect(TOK_SEMI);
 
+        define_function(&func);
         return NULL;
     }
 
-    if (current_token.type == TOK_RN) {
+    if (nac_ctx->current_token.type == TOK_RN) {
         next_token();
         ASTNode *node = create_node(AST_RETURN);
         node->return_stmt.value = parse_expression();
@@ -398,19 +458,28 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_BREAK) {
+    if (nac_ctx->current_token.type == TOK_YIELD) {
+        next_token();
+        ASTNode *node = create_node(AST_YIELD);
+        node->yield_stmt.value = parse_expression();
+        nac_ctx->saw_yield = true;
+        expect(TOK_SEMI);
+        return node;
+    }
+
+    if (nac_ctx->current_token.type == TOK_BREAK) {
         next_token();
         expect(TOK_SEMI);
         return create_node(AST_BREAK);
     }
 
-    if (current_token.type == TOK_CONTINUE) {
+    if (nac_ctx->current_token.type == TOK_CONTINUE) {
         next_token();
         expect(TOK_SEMI);
         return create_node(AST_CONTINUE);
     }
 
-    if (current_token.type == TOK_OUT) {
+    if (nac_ctx->current_token.type == TOK_OUT) {
         next_token();
         expect(TOK_LPAREN);
         ASTNode *node = create_node(AST_OUT);
@@ -420,20 +489,20 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_IN) {
+    if (nac_ctx->current_token.type == TOK_IN) {
         next_token();
         expect(TOK_LPAREN);
 
-        if (current_token.type != TOK_IDENT) {
+        if (nac_ctx->current_token.type != TOK_IDENT) {
             report_error("Expected variable name for input");
             return NULL;
         }
 
         char var_name[MAX_TOKEN_LEN];
-        strncpy(var_name, current_token.ident, MAX_TOKEN_LEN - 1);
+        strncpy(var_name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
         next_token();
 
-        if (current_token.type == TOK_LBRACKET) {
+        if (nac_ctx->current_token.type == TOK_LBRACKET) {
             next_token();
             ASTNode *index = parse_expression();
             expect(TOK_RBRACKET);
@@ -458,7 +527,7 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_IF) {
+    if (nac_ctx->current_token.type == TOK_IF) {
         next_token();
         expect(TOK_LPAREN);
 
@@ -468,7 +537,7 @@ ASTNode *parse_statement(void) {
 
         node->if_stmt.then_block = parse_block();
 
-        if (current_token.type == TOK_COLON) {
+        if (nac_ctx->current_token.type == TOK_COLON) {
             next_token();
             node->if_stmt.else_block = parse_block();
         } else {
@@ -479,18 +548,29 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_FOR) {
+    if (nac_ctx->current_token.type == TOK_FOR) {
         next_token();
         expect(TOK_LPAREN);
 
         ASTNode *node = create_node(AST_FOR);
 
-        if (current_token.type == TOK_IDENT) {
+        if (nac_ctx->current_token.type == TOK_IDENT) {
             char var_name[MAX_TOKEN_LEN];
-            strncpy(var_name, current_token.ident, MAX_TOKEN_LEN - 1);
+            strncpy(var_name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
             next_token();
 
-            if (current_token.type == TOK_ASSIGN) {
+            if (nac_ctx->current_token.type == TOK_IN) {
+                next_token();
+                node->type = AST_FOR_IN;
+                strncpy(node->for_in.var_name, var_name, MAX_TOKEN_LEN - 1);
+                node->for_in.iterable = parse_expression();
+                expect(TOK_RPAREN);
+                node->for_in.body = parse_block();
+                expect(TOK_SEMI);
+                return node;
+            }
+
+            if (nac_ctx->current_token.type == TOK_ASSIGN) {
                 next_token();
                 ASTNode *assign = create_node(AST_ASSIGN);
                 strncpy(assign->assign.var_name, var_name, MAX_TOKEN_LEN - 1);
@@ -508,22 +588,22 @@ ASTNode *parse_statement(void) {
         node->for_stmt.condition = parse_expression();
         expect(TOK_SEMI);
 
-        if (current_token.type == TOK_IDENT) {
+        if (nac_ctx->current_token.type == TOK_IDENT) {
             char var_name[MAX_TOKEN_LEN];
-            strncpy(var_name, current_token.ident, MAX_TOKEN_LEN - 1);
+            strncpy(var_name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
             next_token();
 
-            if (current_token.type == TOK_PLUSPLUS) {
+            if (nac_ctx->current_token.type == TOK_PLUSPLUS) {
                 next_token();
                 ASTNode *inc = create_node(AST_INCREMENT);
                 strncpy(inc->inc_dec.var_name, var_name, MAX_TOKEN_LEN - 1);
                 node->for_stmt.increment = inc;
-            } else if (current_token.type == TOK_MINUSMINUS) {
+            } else if (nac_ctx->current_token.type == TOK_MINUSMINUS) {
                 next_token();
                 ASTNode *dec = create_node(AST_DECREMENT);
                 strncpy(dec->inc_dec.var_name, var_name, MAX_TOKEN_LEN - 1);
                 node->for_stmt.increment = dec;
-            } else if (current_token.type == TOK_ASSIGN) {
+            } else if (nac_ctx->current_token.type == TOK_ASSIGN) {
                 next_token();
                 ASTNode *assign = create_node(AST_ASSIGN);
                 strncpy(assign->assign.var_name, var_name, MAX_TOKEN_LEN - 1);
@@ -544,7 +624,7 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_WHILE) {
+    if (nac_ctx->current_token.type == TOK_WHILE) {
         next_token();
         expect(TOK_LPAREN);
 
@@ -557,7 +637,35 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_HTTP) {
+    if (nac_ctx->current_token.type == TOK_IMPORT) {
+        next_token();
+        if (nac_ctx->current_token.type != TOK_STRING) {
+            report_error("Expected module path after import");
+            return NULL;
+        }
+
+        ASTNode *node = create_node(AST_IMPORT);
+        source_module_resolve(nac_ctx->script_name, nac_ctx->current_token.str_val,
+                              node->import_stmt.path, sizeof(node->import_stmt.path));
+        source_module_default_alias(nac_ctx->current_token.str_val,
+                                    node->import_stmt.alias, sizeof(node->import_stmt.alias));
+        next_token();
+
+        if (nac_ctx->current_token.type == TOK_IDENT && strcmp(nac_ctx->current_token.ident, "as") == 0) {
+            next_token();
+            if (nac_ctx->current_token.type != TOK_IDENT || strchr(nac_ctx->current_token.ident, '.')) {
+                report_error("Expected module name after as");
+            } else {
+                strncpy(node->import_stmt.alias, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
+                next_token();
+            }
+        }
+        expect(TOK_SEMI);
+
+        return node;
+    }
+
+    if (nac_ctx->current_token.type == TOK_HTTP) {
         next_token();
         expect(TOK_LPAREN);
 
@@ -568,7 +676,7 @@ ASTNode *parse_statement(void) {
 
         node->http_stmt.url = parse_expression();
 
-        if (current_token.type == TOK_COMMA) {
+        if (nac_ctx->current_token.type == TOK_COMMA) {
             next_token();
             node->http_stmt.body = parse_expression();
         } else {
@@ -581,12 +689,12 @@ ASTNode *parse_statement(void) {
         return node;
     }
 
-    if (current_token.type == TOK_IDENT) {
+    if (nac_ctx->current_token.type == TOK_IDENT) {
         char var_name[MAX_TOKEN_LEN];
-        strncpy(var_name, current_token.ident, MAX_TOKEN_LEN - 1);
+        strncpy(var_name, nac_ctx->current_token.ident, MAX_TOKEN_LEN - 1);
         next_token();
 
-        if (current_token.type == TOK_LBRACKET) {
+        if (nac_ctx->current_token.type == TOK_LBRACKET) {
             next_token();
             ASTNode *index = parse_expression();
             expect(TOK_RBRACKET);
@@ -600,7 +708,7 @@ ASTNode *parse_statement(void) {
             return node;
         }
 
-        if (current_token.type == TOK_PLUSPLUS) {
+        if (nac_ctx->current_token.type == TOK_PLUSPLUS) {
             next_token();
             expect(TOK_SEMI);
             ASTNode *node = create_node(AST_INCREMENT);
@@ -608,7 +716,7 @@ ASTNode *parse_statement(void) {
             return node;
         }
 
-        if (current_token.type == TOK_MINUSMINUS) {
+        if (nac_ctx->current_token.type == TOK_MINUSMINUS) {
             next_token();
             expect(TOK_SEMI);
             ASTNode *node = create_node(AST_DECREMENT);
@@ -616,7 +724,7 @@ ASTNode *parse_statement(void) {
             return node;
         }
 
-        if (current_token.type == TOK_ASSIGN) {
+        if (nac_ctx->current_token.type == TOK_ASSIGN) {
             next_token();
             ASTNode *node = create_node(AST_ASSIGN);
             strncpy(node->assign.var_name, var_name, MAX_TOKEN_LEN - 1);
@@ -626,7 +734,7 @@ ASTNode *parse_statement(void) {
         }
     }
 
-    if (current_token.type == TOK_SEMI) {
+    if (nac_ctx->current_token.type == TOK_SEMI) {
         next_token();
         return NULL;
     }
@@ -635,3 +743,45 @@ ASTNode *parse_statement(void) {
     next_token();
     return NULL;
 }
+
+void set_eager_parsing(bool eager) {
+    nac_ctx->eager_parsing = eager;
+}
+
+bool parse_function_body(Function *func) {
+    if (func->body) return true;
+
+    if (func->body_blob) {
+        ByteReader r;
+        reader_init(&r, func->body_blob, func->body_blob_len);
+        func->body = ast_read(&r);
+        func->body_blob = NULL;
+        if (!func->body) {
+            report_error("Corrupt compiled function body");
+        }
+        return func->body != NULL;
+    }
+
+    if (func->body_start < 0) return false;
+
+    bool saved_break = nac_ctx->should_break;
+    bool saved_continue = nac_ctx->should_continue;
+    bool saved_return = nac_ctx->should_return;
+    nac_ctx->should_break = nac_ctx->should_continue = nac_ctx->should_return = false;
+
+    bool saved_yield = nac_ctx->saw_yield;
+    nac_ctx->saw_yield = false;
+
+    int resume = lexer_position();
+    lexer_seek(func->body_start);
+    func->body = parse_block();
+    lexer_seek(resume);
+
+    func->is_generator = nac_ctx->saw_yield;
+    nac_ctx->saw_yield = saved_yield;
+
+    nac_ctx->should_break = saved_break;
+    nac_ctx->should_continue = saved_continue;
+    nac_ctx->should_return = saved_return;
+    return func->body != NULL;
+}
@@ -1,9 +1,11 @@
 #ifndef NAC_PARSER_H
 #define NAC_PARSER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "ast.h"
 
-#define MAX_FUNCS 100
 #define MAX_PARAMS 10
 
 typedef struct {
@@ -11,10 +13,18 @@ typedef struct {
     char params[MAX_PARAMS][MAX_TOKEN_LEN];
     int param_count;
     ASTNode *body;
+    int body_start;
+    const unsigned char *body_blob;
+    size_t body_blob_len;
+    bool shared_body;  // body belongs to an imported module, not to this function
+    bool is_async;     // calls return a promise; see runtime/async.c
+    bool is_generator; // body yields; calls return a generator, see runtime/generator.c
 } Function;
 
 ASTNode *parse_expression(void);
 ASTNode *parse_statement(void);
 void free_ast(ASTNode *node);
+void set_eager_parsing(bool eager);
+bool parse_function_body(Function *func);
 
 #endif
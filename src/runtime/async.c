@@ -0,0 +1,300 @@
+#include "async.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "coroutine.h"
+#include "eval.h"
+#include "event_loop.h"
+#include "../util/error.h"
+
+enum { PROMISE_PENDING, PROMISE_RESOLVED, PROMISE_REJECTED };
+
+// Promises are per context and addressed by handle. Each one is awaited (or
+// passed to all()) once; whoever claims it is told when it settles.
+typedef struct Promise {
+    int id;
+    int state;
+    bool claimed;
+    Value value;
+    char error[256];
+    void (*on_settle)(struct Promise *promise, void *data);
+    void *data;
+} Promise;
+
+typedef struct AsyncState {
+    Promise **promises;  // indexed by handle
+    int capacity;
+    int next_id;
+} AsyncState;
+
+static AsyncState *async_state(void) {
+    if (!nac_ctx->async) {
+        nac_ctx->async = (AsyncState*)calloc(1, sizeof(AsyncState));
+        nac_ctx->async->next_id = 1;
+    }
+    return nac_ctx->async;
+}
+
+int promise_create(void) {
+    AsyncState *state = async_state();
+    if (state->next_id >= state->capacity) {
+        int capacity = state->capacity ? state->capacity * 2 : 64;
+        state->promises = (Promise**)realloc(state->promises, sizeof(Promise*) * capacity);
+        memset(state->promises + state->capacity, 0, sizeof(Promise*) * (capacity - state->capacity));
+        state->capacity = capacity;
+    }
+
+    Promise *promise = (Promise*)calloc(1, sizeof(Promise));
+    promise->id = state->next_id++;
+    promise->value = make_int(0);
+    state->promises[promise->id] = promise;
+    return promise->id;
+}
+
+static Promise *promise_find(int id) {
+    AsyncState *state = nac_ctx->async;
+    if (!state || id <= 0 || id >= state->next_id) return NULL;
+    return state->promises[id];
+}
+
+static void promise_release(Promise *promise) {
+    nac_ctx->async->promises[promise->id] = NULL;
+    free_value(&promise->value);
+    free(promise);
+}
+
+static void promise_settle(Promise *promise, int state) {
+    promise->state = state;
+    if (promise->on_settle) {
+        promise->on_settle(promise, promise->data);
+    }
+}
+
+// Takes ownership of value.
+void promise_resolve(int id, Value value) {
+    Promise *promise = promise_find(id);
+    if (!promise || promise->state != PROMISE_PENDING) {
+        free_value(&value);
+        return;
+    }
+    promise->value = value;
+    promise_settle(promise, PROMISE_RESOLVED);
+}
+
+void promise_reject(int id, const char *message) {
+    Promise *promise = promise_find(id);
+    if (!promise || promise->state != PROMISE_PENDING) return;
+    snprintf(promise->error, sizeof(promise->error), "%s", message);
+    promise_settle(promise, PROMISE_REJECTED);
+}
+
+static Promise *promise_claim(Value handle, const char *op) {
+    Promise *promise = (handle.type == TYPE_INT) ? promise_find(handle.int_val) : NULL;
+    if (!promise || promise->claimed) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%s: unknown or already awaited promise", op);
+        report_error(msg);
+        return NULL;
+    }
+    promise->claimed = true;
+    return promise;
+}
+
+// Hands the settled value to the caller and frees the promise. A rejection
+// is reported as an error in the awaiting code.
+static Value promise_take(Promise *promise) {
+    Value result = promise->value;
+    promise->value = make_int(0);
+    if (promise->state == PROMISE_REJECTED) {
+        report_error(promise->error);
+    }
+    promise_release(promise);
+    return result;
+}
+
+static void resume_coroutine(void *data) {
+    coroutine_resume((Coroutine*)data);
+}
+
+static void wake_coroutine(Promise *promise, void *data) {
+    (void)promise;
+    EventLoop *loop = event_loop_get();
+    if (loop) {
+        event_loop_timer(loop, 0, 0, resume_coroutine, data, NULL, true);
+    }
+}
+
+static void async_done(Coroutine *co, Value result, void *data) {
+    (void)co;
+    promise_resolve((int)(size_t)data, result);
+}
+
+Value async_call(Function *func, Value *args, int arg_count) {
+    int promise = promise_create();
+    Coroutine *co = coroutine_create(COROUTINE_ASYNC, func, args, arg_count, async_done, (void*)(size_t)promise);
+    if (!co) {
+        // Without coroutines the call runs to completion here.
+        promise_resolve(promise, invoke_function(func, args, arg_count));
+        nac_ctx->return_value = make_int(0);
+        return make_int(promise);
+    }
+
+    // Like a plain call, the body runs right away, up to its first await
+    // on something pending.
+    coroutine_resume(co);
+    return make_int(promise);
+}
+
+Value async_await(Value handle) {
+    Promise *promise = promise_claim(handle, "await");
+    if (!promise) return make_int(0);
+
+    Coroutine *co = coroutine_current();
+    if (promise->state == PROMISE_PENDING && co && coroutine_kind(co) == COROUTINE_ASYNC) {
+        promise->on_settle = wake_coroutine;
+        promise->data = co;
+        coroutine_suspend();
+    }
+
+    // Outside an async call (including inside a generator), await drives
+    // the event loop itself.
+    EventLoop *loop = event_loop_get();
+    while (promise->state == PROMISE_PENDING) {
+        if (!loop || !event_loop_run_once(loop)) {
+            report_error("await: promise can never settle");
+            promise_release(promise);
+            return make_int(0);
+        }
+    }
+
+    return promise_take(promise);
+}
+
+typedef struct {
+    int promise;
+    int remaining;
+    bool rejected;
+    Value results;
+    int *indexes;
+} AllState;
+
+typedef struct {
+    AllState *all;
+    int index;
+} AllPart;
+
+static void all_part_settled(Promise *promise, void *data) {
+    AllPart *part = (AllPart*)data;
+    AllState *all = part->all;
+
+    if (promise->state == PROMISE_RESOLVED) {
+        all->results.array_val.elements[part->index] = promise->value;
+        promise->value = make_int(0);
+    } else if (!all->rejected) {
+        all->rejected = true;
+        promise_reject(all->promise, promise->error);
+    }
+    promise_release(promise);
+    free(part);
+
+    if (--all->remaining == 0) {
+        if (all->rejected) {
+            free_value(&all->results);
+        } else {
+            promise_resolve(all->promise, all->results);
+        }
+        free(all);
+    }
+}
+
+// Settles with an array of results, in order, once every input has. The
+// first rejection rejects it, though the rest are still waited for.
+Value async_all(Value handles) {
+    if (handles.type != TYPE_ARRAY) {
+        report_error("all() requires an array of promises");
+        return make_int(0);
+    }
+
+    int count = handles.array_val.size;
+    Value results = make_array(count);
+    if (results.array_val.size < count) {
+        return make_int(0);
+    }
+    Promise **inputs = (Promise**)malloc(sizeof(Promise*) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        inputs[i] = promise_claim(handles.array_val.elements[i], "all()");
+        if (!inputs[i]) {
+            for (int j = 0; j < i; j++) inputs[j]->claimed = false;
+            free(inputs);
+            free_value(&results);
+            return make_int(0);
+        }
+    }
+
+    AllState *all = (AllState*)calloc(1, sizeof(AllState));
+    all->promise = promise_create();
+    all->remaining = count;
+    all->results = results;
+    int id = all->promise;
+
+    if (count == 0) {
+        promise_resolve(id, all->results);
+        free(all);
+    }
+    for (int i = 0; i < count; i++) {
+        AllPart *part = (AllPart*)malloc(sizeof(AllPart));
+        part->all = all;
+        part->index = i;
+        if (inputs[i]->state == PROMISE_PENDING) {
+            inputs[i]->on_settle = all_part_settled;
+            inputs[i]->data = part;
+        } else {
+            all_part_settled(inputs[i], part);
+        }
+    }
+    free(inputs);
+    return make_int(id);
+}
+
+static void resolve_delay(void *data) {
+    promise_resolve((int)(size_t)data, make_int(0));
+}
+
+Value async_delay(Value ms) {
+    EventLoop *loop = event_loop_get();
+    if (!loop) return make_int(0);
+
+    int promise = promise_create();
+    event_loop_timer(loop, to_float(ms), 0, resolve_delay, (void*)(size_t)promise, NULL, true);
+    return make_int(promise);
+}
+
+void async_free(NacContext *ctx) {
+    AsyncState *state = ctx->async;
+    if (!state) return;
+
+    NacContext *previous = context_enter(ctx);
+    for (int i = 1; i < state->next_id; i++) {
+        Promise *promise = state->promises[i];
+        if (promise) {
+            if (promise->on_settle == all_part_settled) {
+                // Unsettled parts of an all(); the last one frees the shared state.
+                AllPart *part = (AllPart*)promise->data;
+                if (--part->all->remaining == 0) {
+                    free_value(&part->all->results);
+                    free(part->all);
+                }
+                free(part);
+            }
+            free_value(&promise->value);
+            free(promise);
+        }
+    }
+    free(state->promises);
+    free(state);
+    ctx->async = NULL;
+    context_enter(previous);
+}
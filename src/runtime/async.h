@@ -0,0 +1,20 @@
+#ifndef NAC_ASYNC_H
+#define NAC_ASYNC_H
+
+#include "../parser/parser.h"
+#include "value.h"
+
+struct NacContext;
+
+Value async_call(Function *func, Value *args, int arg_count);
+Value async_await(Value handle);
+Value async_all(Value handles);
+Value async_delay(Value ms);
+
+int promise_create(void);
+void promise_resolve(int id, Value value);
+void promise_reject(int id, const char *message);
+
+void async_free(struct NacContext *ctx);
+
+#endif
@@ -0,0 +1,311 @@
+#include "channel.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "../util/error.h"
+#include "../util/thread_pool.h"
+
+#define CHANNEL_MAX_CAPACITY (1 << 24)
+#define CHANNEL_RECHECK_MS 50
+
+// Bounded MPMC ring (Vyukov). A cell is free for send position pos when its
+// seq is 2*pos and holds a value for receive position pos at 2*pos + 1; the
+// doubling keeps the two states apart for a one-slot channel. The ring
+// itself never locks; the mutex only parks threads that must wait.
+typedef struct {
+    atomic_size_t seq;
+    Value value;
+} ChannelCell;
+
+typedef struct {
+    ChannelCell *cells;
+    size_t capacity;
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_bool closed;
+    atomic_int waiters;
+#ifndef _WIN32
+    int parked_workers;
+    unsigned long wakeups;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif
+} Channel;
+
+static Channel **channels = NULL;
+static int channel_capacity = 0;
+static int next_channel_id = 1;
+static atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+
+static void lock_registry(void) {
+    while (atomic_flag_test_and_set_explicit(&registry_lock, memory_order_acquire)) {}
+}
+
+static void unlock_registry(void) {
+    atomic_flag_clear_explicit(&registry_lock, memory_order_release);
+}
+
+static bool ring_push(Channel *ch, Value value) {
+    size_t pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    for (;;) {
+        ChannelCell *cell = &ch->cells[pos % ch->capacity];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(2 * pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->value = value;
+                atomic_store_explicit(&cell->seq, 2 * pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static bool ring_pop(Channel *ch, Value *out) {
+    size_t pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    for (;;) {
+        ChannelCell *cell = &ch->cells[pos % ch->capacity];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(2 * pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *out = cell->value;
+                atomic_store_explicit(&cell->seq, 2 * (pos + ch->capacity), memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+        }
+    }
+}
+
+static bool ring_full(Channel *ch) {
+    size_t pos = atomic_load(&ch->tail);
+    return atomic_load(&ch->cells[pos % ch->capacity].seq) != 2 * pos;
+}
+
+static bool ring_empty(Channel *ch) {
+    size_t pos = atomic_load(&ch->head);
+    return atomic_load(&ch->cells[pos % ch->capacity].seq) != 2 * pos + 1;
+}
+
+#ifndef _WIN32
+// Called with the lock held. Parked workers stop counting as blocked here,
+// not when they get to run, so the pool never looks stalled in between.
+static void broadcast(Channel *ch) {
+    ch->wakeups++;
+    thread_pool_add_blocked(-ch->parked_workers);
+    ch->parked_workers = 0;
+    pthread_cond_broadcast(&ch->changed);
+}
+#endif
+
+static void wake(Channel *ch) {
+#ifndef _WIN32
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ch->waiters) > 0) {
+        pthread_mutex_lock(&ch->lock);
+        broadcast(ch);
+        pthread_mutex_unlock(&ch->lock);
+    }
+#else
+    (void)ch;
+#endif
+}
+
+// Parks until the ring may have changed. Returns false where nothing else
+// can run to change it. Unlike joinTask(), this never runs a queued task inline:
+// that stage could be waiting on the caller itself. A parked worker has the
+// pool start a spare instead. Threads outside the pool wake up now and then
+// to check whether every worker has parked too.
+static bool wait_change(Channel *ch, bool (*blocked)(Channel*)) {
+#ifdef _WIN32
+    (void)ch;
+    (void)blocked;
+    return false;
+#else
+    bool progress = true;
+    pthread_mutex_lock(&ch->lock);
+    atomic_fetch_add(&ch->waiters, 1);
+    if (blocked(ch) && !atomic_load(&ch->closed)) {
+        if (thread_pool_in_worker()) {
+            unsigned long seen = ch->wakeups;
+            ch->parked_workers++;
+            thread_pool_add_blocked(1);
+            pthread_cond_wait(&ch->changed, &ch->lock);
+            if (ch->wakeups == seen) {
+                ch->parked_workers--;
+                thread_pool_add_blocked(-1);
+            }
+        } else if (thread_pool_stalled()) {
+            progress = false;
+        } else {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += CHANNEL_RECHECK_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&ch->changed, &ch->lock, &until);
+        }
+    }
+    atomic_fetch_sub(&ch->waiters, 1);
+    pthread_mutex_unlock(&ch->lock);
+    return progress;
+#endif
+}
+
+static Channel *lookup(Value handle, const char *op) {
+    Channel *ch = NULL;
+    if (handle.type == TYPE_INT) {
+        lock_registry();
+        if (handle.int_val > 0 && handle.int_val < next_channel_id) {
+            ch = channels[handle.int_val];
+        }
+        unlock_registry();
+    }
+    if (!ch) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%s(): unknown channel", op);
+        report_error(msg);
+    }
+    return ch;
+}
+
+Value channel_create(Value capacity) {
+    if (capacity.type != TYPE_INT || capacity.int_val < 1 || capacity.int_val > CHANNEL_MAX_CAPACITY) {
+        report_error("channel() capacity must be between 1 and 16777216");
+        return make_int(0);
+    }
+
+    Channel *ch = (Channel*)calloc(1, sizeof(Channel));
+    ch->capacity = (size_t)capacity.int_val;
+    ch->cells = (ChannelCell*)calloc(ch->capacity, sizeof(ChannelCell));
+    for (size_t i = 0; i < ch->capacity; i++) {
+        atomic_init(&ch->cells[i].seq, 2 * i);
+    }
+#ifndef _WIN32
+    pthread_mutex_init(&ch->lock, NULL);
+    pthread_cond_init(&ch->changed, NULL);
+#endif
+
+    lock_registry();
+    if (next_channel_id >= channel_capacity) {
+        channel_capacity = (channel_capacity == 0) ? 16 : channel_capacity * 2;
+        channels = (Channel**)realloc(channels, sizeof(Channel*) * channel_capacity);
+    }
+    int id = next_channel_id++;
+    channels[id] = ch;
+    unlock_registry();
+    return make_int(id);
+}
+
+void channel_send(Value handle, Value value, bool wait, bool *sent) {
+    *sent = false;
+    Channel *ch = lookup(handle, wait ? "send" : "trySend");
+    if (!ch) return;
+
+    Value owned = copy_value(value);
+    for (;;) {
+        if (atomic_load(&ch->closed)) {
+            report_error("send() on a closed channel");
+            break;
+        }
+        if (ring_push(ch, owned)) {
+            wake(ch);
+            *sent = true;
+            return;
+        }
+        if (!wait) break;
+        if (!wait_change(ch, ring_full)) {
+            report_error("send() would block: channel is full");
+            break;
+        }
+    }
+    free_value(&owned);
+}
+
+// Once the channel is closed and drained, returns a copy of done.
+Value channel_recv(Value handle, Value done, bool wait) {
+    Channel *ch = lookup(handle, wait ? "recv" : "tryRecv");
+    if (!ch) return make_int(0);
+
+    Value value;
+    for (;;) {
+        if (ring_pop(ch, &value)) {
+            wake(ch);
+            return value;
+        }
+        // A send may have landed between the failed pop and the close.
+        if (atomic_load(&ch->closed)) {
+            if (ring_pop(ch, &value)) return value;
+            break;
+        }
+        if (!wait) break;
+        if (!wait_change(ch, ring_empty)) {
+            report_error("recv() would block: channel is empty");
+            break;
+        }
+    }
+    return copy_value(done);
+}
+
+void channel_close(Value handle) {
+    Channel *ch = lookup(handle, "close");
+    if (!ch) return;
+
+    atomic_store(&ch->closed, true);
+#ifndef _WIN32
+    pthread_mutex_lock(&ch->lock);
+    broadcast(ch);
+    pthread_mutex_unlock(&ch->lock);
+#endif
+}
+
+// Wakes tasks still parked on a channel so the pool can stop.
+void channels_close_all(void) {
+    lock_registry();
+    int count = next_channel_id;
+    unlock_registry();
+    for (int i = 1; i < count; i++) {
+        channel_close(make_int(i));
+    }
+}
+
+// Called once no thread can touch a channel any more.
+void channels_shutdown(void) {
+    for (int i = 1; i < next_channel_id; i++) {
+        Channel *ch = channels[i];
+        Value value;
+        while (ring_pop(ch, &value)) {
+            free_value(&value);
+        }
+#ifndef _WIN32
+        pthread_mutex_destroy(&ch->lock);
+        pthread_cond_destroy(&ch->changed);
+#endif
+        free(ch->cells);
+        free(ch);
+    }
+    free(channels);
+    channels = NULL;
+    channel_capacity = 0;
+    next_channel_id = 1;
+}
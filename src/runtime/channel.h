@@ -0,0 +1,15 @@
+#ifndef NAC_CHANNEL_H
+#define NAC_CHANNEL_H
+
+#include <stdbool.h>
+
+#include "value.h"
+
+Value channel_create(Value capacity);
+void channel_send(Value handle, Value value, bool wait, bool *sent);
+Value channel_recv(Value handle, Value done, bool wait);
+void channel_close(Value handle);
+void channels_close_all(void);
+void channels_shutdown(void);
+
+#endif
@@ -0,0 +1,341 @@
+#include "coroutine.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "eval.h"
+#include "../util/error.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+// Room for MAX_CALL_DEPTH nested calls, like a pool thread; MAP_NORESERVE
+// means only the pages a coroutine touches cost memory.
+#define COROUTINE_STACK_SIZE (8u << 20)
+
+// Stacks are carved from arenas so that live coroutines do not each cost
+// separate mappings, which the kernel caps (vm.max_map_count). Only the
+// bottom of an arena has a guard page; between stacks, eval_node() stops
+// at STACK_RESERVE bytes from the end instead.
+#define STACKS_PER_ARENA 64
+#define STACK_RESERVE (512u << 10)
+#define GUARD_SIZE 4096u
+
+// Async calls and generators run as coroutines on their own stacks. The
+// interpreter's frame stack lives in the context, so each coroutine keeps
+// its own copy and swaps it in while it runs.
+typedef struct {
+    VarTable *vars[MAX_CALL_DEPTH];
+    const char *names[MAX_CALL_DEPTH];
+    int depth;
+    bool should_break;
+    bool should_continue;
+    bool should_return;
+    Value return_value;
+    const char *scope;
+    int scope_len;
+    int exec_line;
+    int exec_col;
+} FrameState;
+
+struct Coroutine {
+    ucontext_t context;
+    ucontext_t *resumer;
+    void *stack;
+    FrameState frames;
+    CoroutineKind kind;
+    Function *func;
+    Value *args;  // owned until the function has copied them into its frame
+    int arg_count;
+    CoroutineDone done;
+    void *data;
+    bool finished;
+    Coroutine *prev;
+    Coroutine *next;
+};
+
+static _Thread_local Coroutine *current = NULL;
+static _Thread_local uintptr_t stack_floor = 0;
+
+// Stacks are shared by all contexts. A released stack goes back to the
+// free list with its pages dropped; arenas are never unmapped.
+typedef struct FreeStack {
+    struct FreeStack *next;
+} FreeStack;
+
+static pthread_mutex_t stacks_lock = PTHREAD_MUTEX_INITIALIZER;
+static FreeStack *free_stacks = NULL;
+static char *arena_next = NULL;
+static int arena_left = 0;
+
+static void *stack_alloc(void) {
+    void *stack = NULL;
+    pthread_mutex_lock(&stacks_lock);
+    if (free_stacks) {
+        stack = free_stacks;
+        free_stacks = free_stacks->next;
+    } else {
+        if (arena_left == 0) {
+            size_t size = (size_t)COROUTINE_STACK_SIZE * STACKS_PER_ARENA + GUARD_SIZE;
+            char *arena = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+            if (arena != MAP_FAILED && mprotect(arena, GUARD_SIZE, PROT_NONE) != 0) {
+                munmap(arena, size);
+                arena = (char*)MAP_FAILED;
+            }
+            if (arena != MAP_FAILED) {
+                arena_next = arena + GUARD_SIZE;
+                arena_left = STACKS_PER_ARENA;
+            }
+        }
+        if (arena_left > 0) {
+            stack = arena_next;
+            arena_next += COROUTINE_STACK_SIZE;
+            arena_left--;
+        }
+    }
+    pthread_mutex_unlock(&stacks_lock);
+    return stack;
+}
+
+static void stack_release(void *stack) {
+    madvise(stack, COROUTINE_STACK_SIZE, MADV_DONTNEED);
+    FreeStack *entry = (FreeStack*)stack;
+    pthread_mutex_lock(&stacks_lock);
+    entry->next = free_stacks;
+    free_stacks = entry;
+    pthread_mutex_unlock(&stacks_lock);
+}
+
+static uintptr_t floor_of(const Coroutine *co) {
+    return co ? (uintptr_t)co->stack + STACK_RESERVE : 0;
+}
+
+static void save_frames(FrameState *out) {
+    out->depth = nac_ctx->call_depth;
+    memcpy(out->vars, nac_ctx->call_stack_vars, sizeof(VarTable*) * out->depth);
+    memcpy(out->names, nac_ctx->call_stack_names, sizeof(char*) * out->depth);
+    out->should_break = nac_ctx->should_break;
+    out->should_continue = nac_ctx->should_continue;
+    out->should_return = nac_ctx->should_return;
+    out->return_value = nac_ctx->return_value;
+    out->scope = nac_ctx->scope;
+    out->scope_len = nac_ctx->scope_len;
+    out->exec_line = nac_ctx->exec_line;
+    out->exec_col = nac_ctx->exec_col;
+}
+
+static void load_frames(const FrameState *in) {
+    nac_ctx->call_depth = in->depth;
+    memcpy(nac_ctx->call_stack_vars, in->vars, sizeof(VarTable*) * in->depth);
+    memcpy(nac_ctx->call_stack_names, in->names, sizeof(char*) * in->depth);
+    nac_ctx->should_break = in->should_break;
+    nac_ctx->should_continue = in->should_continue;
+    nac_ctx->should_return = in->should_return;
+    nac_ctx->return_value = in->return_value;
+    nac_ctx->scope = in->scope;
+    nac_ctx->scope_len = in->scope_len;
+    nac_ctx->exec_line = in->exec_line;
+    nac_ctx->exec_col = in->exec_col;
+}
+
+static void free_args(Coroutine *co) {
+    for (int i = 0; i < co->arg_count; i++) {
+        free_value(&co->args[i]);
+    }
+    free(co->args);
+    co->args = NULL;
+    co->arg_count = 0;
+}
+
+static void coroutine_free(Coroutine *co) {
+    if (co->prev) co->prev->next = co->next;
+    else nac_ctx->coroutines = co->next;
+    if (co->next) co->next->prev = co->prev;
+
+    free_args(co);
+    stack_release(co->stack);
+    free(co);
+}
+
+static void coroutine_main(void) {
+    Coroutine *co = current;
+    Value result = invoke_function(co->func, co->args, co->arg_count);
+    nac_ctx->return_value = make_int(0);
+    free_args(co);
+
+    co->finished = true;
+    co->done(co, result, co->data);
+    swapcontext(&co->context, co->resumer);
+}
+
+// Kept apart from coroutine_create() so getcontext() returning twice cannot
+// clobber its locals.
+static void prepare_context(Coroutine *co) {
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = co->stack;
+    co->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, coroutine_main, 0);
+}
+
+// The coroutine does not start until the first coroutine_resume(). NULL if
+// no stack could be allocated.
+Coroutine *coroutine_create(CoroutineKind kind, Function *func, Value *args, int arg_count,
+                            CoroutineDone done, void *data) {
+    void *stack = stack_alloc();
+    if (!stack) return NULL;
+
+    Coroutine *co = (Coroutine*)calloc(1, sizeof(Coroutine));
+    Value *copies = (Value*)malloc(sizeof(Value) * (arg_count > 0 ? arg_count : 1));
+    if (!co || !copies) {
+        free(co);
+        free(copies);
+        stack_release(stack);
+        return NULL;
+    }
+    co->stack = stack;
+    co->kind = kind;
+    co->func = func;
+    co->args = copies;
+    for (int i = 0; i < arg_count; i++) {
+        co->args[i] = copy_value(args[i]);
+    }
+    co->arg_count = arg_count;
+    co->done = done;
+    co->data = data;
+    co->frames.return_value = make_int(0);
+
+    prepare_context(co);
+
+    co->next = nac_ctx->coroutines;
+    if (nac_ctx->coroutines) nac_ctx->coroutines->prev = co;
+    nac_ctx->coroutines = co;
+    return co;
+}
+
+// Runs co until it suspends or returns. A finished coroutine is freed.
+void coroutine_resume(Coroutine *co) {
+    ucontext_t here;
+    FrameState outer_frames;
+    Coroutine *outer = current;
+
+    save_frames(&outer_frames);
+    load_frames(&co->frames);
+    co->resumer = &here;
+    current = co;
+    stack_floor = floor_of(co);
+
+    swapcontext(&here, &co->context);
+
+    current = outer;
+    stack_floor = floor_of(outer);
+    save_frames(&co->frames);
+    load_frames(&outer_frames);
+    if (co->finished) {
+        coroutine_free(co);
+    }
+}
+
+void coroutine_suspend(void) {
+    Coroutine *co = current;
+    if (co) {
+        swapcontext(&co->context, co->resumer);
+    }
+}
+
+// For a coroutine that is suspended and will never be resumed. Values held
+// by the evaluator on its stack are not reclaimed.
+void coroutine_destroy(Coroutine *co) {
+    for (int i = 0; i < co->frames.depth; i++) {
+        free_var_table(co->frames.vars[i]);
+    }
+    coroutine_free(co);
+}
+
+Coroutine *coroutine_current(void) {
+    return current;
+}
+
+bool coroutines_available(void) {
+    return true;
+}
+
+// True when the running coroutine is within STACK_RESERVE of the end of
+// its stack.
+bool coroutine_stack_exhausted(void) {
+    char probe;
+    return (uintptr_t)&probe < stack_floor;
+}
+
+CoroutineKind coroutine_kind(const Coroutine *co) {
+    return co->kind;
+}
+
+void *coroutine_data(const Coroutine *co) {
+    return co->data;
+}
+
+void coroutines_free(NacContext *ctx) {
+    NacContext *previous = context_enter(ctx);
+    while (ctx->coroutines) {
+        coroutine_destroy(ctx->coroutines);
+    }
+    context_enter(previous);
+}
+
+#else
+
+Coroutine *coroutine_create(CoroutineKind kind, Function *func, Value *args, int arg_count,
+                            CoroutineDone done, void *data) {
+    (void)kind;
+    (void)func;
+    (void)args;
+    (void)arg_count;
+    (void)done;
+    (void)data;
+    return NULL;
+}
+
+void coroutine_resume(Coroutine *co) {
+    (void)co;
+}
+
+void coroutine_suspend(void) {
+}
+
+void coroutine_destroy(Coroutine *co) {
+    (void)co;
+}
+
+Coroutine *coroutine_current(void) {
+    return NULL;
+}
+
+bool coroutines_available(void) {
+    return false;
+}
+
+bool coroutine_stack_exhausted(void) {
+    return false;
+}
+
+CoroutineKind coroutine_kind(const Coroutine *co) {
+    (void)co;
+    return COROUTINE_ASYNC;
+}
+
+void *coroutine_data(const Coroutine *co) {
+    (void)co;
+    return NULL;
+}
+
+void coroutines_free(NacContext *ctx) {
+    (void)ctx;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NAC_COROUTINE_H
+#define NAC_COROUTINE_H
+
+#include <stdbool.h>
+
+#include "../parser/parser.h"
+#include "value.h"
+
+struct NacContext;
+typedef struct Coroutine Coroutine;
+
+typedef enum {
+    COROUTINE_ASYNC,
+    COROUTINE_GENERATOR
+} CoroutineKind;
+
+// Called on the coroutine's own stack when its function returns; result
+// is handed over.
+typedef void (*CoroutineDone)(Coroutine *co, Value result, void *data);
+
+Coroutine *coroutine_create(CoroutineKind kind, Function *func, Value *args, int arg_count,
+                            CoroutineDone done, void *data);
+void coroutine_resume(Coroutine *co);
+void coroutine_suspend(void);
+void coroutine_destroy(Coroutine *co);
+Coroutine *coroutine_current(void);
+bool coroutines_available(void);
+bool coroutine_stack_exhausted(void);
+CoroutineKind coroutine_kind(const Coroutine *co);
+void *coroutine_data(const Coroutine *co);
+void coroutines_free(struct NacContext *ctx);
+
+#endif
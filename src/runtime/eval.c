@@ -4,36 +4,124 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../builtin/builtin.h"
-#include "../builtin/extended_builtin.h"
+#include "../builtin/dispatch.h"
 #include "../core/interpreter.h"
+#include "../module/source_module.h"
 #include "../net/http.h"
 #include "../parser/parser.h"
 #include "../util/error.h"
+#include "../util/heap_profile.h"
+#include "async.h"
+#include "coroutine.h"
+#include "generator.h"
 #include "vartable.h"
 
-static int key_from_value(Value key_val, char *buffer, size_t buffer_size) {
-    if (key_val.type == TYPE_STRING) {
-        strncpy(buffer, key_val.str_val, buffer_size - 1);
-        buffer[buffer_size - 1] = '\0';
-        return 1;
+Function *find_function(const char *name) {
+    return function_table_find(&nac_ctx->functions, name);
+}
+
+// Unqualified calls from module code try the module's own namespace first.
+static Function *resolve_function(const char *name) {
+    if (nac_ctx->scope_len > 0 && !strchr(name, '.')) {
+        char qualified[MAX_TOKEN_LEN * 2];
+        snprintf(qualified, sizeof(qualified), "%.*s.%s", nac_ctx->scope_len, nac_ctx->scope, name);
+        Function *func = find_function(qualified);
+        if (func) return func;
+    }
+    return find_function(name);
+}
+
+// Arguments are copied into the callee's frame; the caller keeps ownership.
+// An async function returns a promise instead of its result.
+Value call_function(Function *func, Value *args, int arg_count) {
+    if (!func->body) {
+        parse_function_body(func);
+    }
+
+    if (arg_count != func->param_count) {
+        report_error("Argument count mismatch");
+        return make_int(0);
+    }
+
+    if (func->is_generator) {
+        return generator_call(func, args, arg_count);
+    }
+    if (func->is_async) {
+        return async_call(func, args, arg_count);
+    }
+    return invoke_function(func, args, arg_count);
+}
+
+Value invoke_function(Function *func, Value *args, int arg_count) {
+    (void)arg_count;
+    if (nac_ctx->halted) {
+        return make_int(0);
+    }
+    if (nac_ctx->call_depth >= MAX_CALL_DEPTH) {
+        report_error("Stack overflow");
+        return make_int(0);
     }
 
-    if (key_val.type == TYPE_INT) {
-        snprintf(buffer, buffer_size, "%d", key_val.int_val);
-        return 1;
+    int caller_line = nac_ctx->exec_line;
+    int caller_col = nac_ctx->exec_col;
+    const char *caller_scope = nac_ctx->scope;
+    int caller_scope_len = nac_ctx->scope_len;
+    const char *dot = strrchr(func->name, '.');
+    nac_ctx->scope = func->name;
+    nac_ctx->scope_len = dot ? (int)(dot - func->name) : 0;
+
+    nac_ctx->call_stack_vars[nac_ctx->call_depth] = create_var_table();
+    nac_ctx->call_stack_names[nac_ctx->call_depth] = func->name;
+    nac_ctx->call_depth++;
+
+    for (int i = 0; i < func->param_count; i++) {
+        set_var(func->params[i], args[i]);
     }
 
-    if (key_val.type == TYPE_FLOAT) {
-        snprintf(buffer, buffer_size, "%g", key_val.float_val);
-        return 1;
+    nac_ctx->should_return = false;
+    eval_node(func->body);
+
+    Value result = nac_ctx->return_value;
+    nac_ctx->should_return = false;
+
+    nac_ctx->call_depth--;
+    free_var_table(nac_ctx->call_stack_vars[nac_ctx->call_depth]);
+    nac_ctx->call_stack_vars[nac_ctx->call_depth] = NULL;
+    nac_ctx->call_stack_names[nac_ctx->call_depth] = NULL;
+    nac_ctx->exec_line = caller_line;
+    nac_ctx->exec_col = caller_col;
+    nac_ctx->scope = caller_scope;
+    nac_ctx->scope_len = caller_scope_len;
+
+    return result;
+}
+
+// Runs one iteration of a for-in body; false when the loop should stop.
+static bool loop_body(ASTNode *body) {
+    nac_ctx->should_continue = false;
+    eval_node(body);
+
+    if (nac_ctx->should_break) {
+        nac_ctx->should_break = false;
+        return false;
     }
+    if (nac_ctx->should_return || nac_ctx->halted) return false;
 
-    return 0;
+    heap_profile_poll();
+    return true;
 }
 
 Value eval_node(ASTNode *node) {
     if (!node) return make_int(0);
+    if (coroutine_stack_exhausted()) {
+        report_error("Stack overflow");
+        return make_int(0);
+    }
+
+    if (node->line > 0) {
+        nac_ctx->exec_line = node->line;
+        nac_ctx->exec_col = node->col;
+    }
 
     switch (node->type) {
         case AST_INT_LITERAL:
@@ -78,7 +166,7 @@ Value eval_node(ASTNode *node) {
 
             if (arr->type == TYPE_MAP) {
                 char key[MAX_STRING_LEN];
-                if (!key_from_value(idx_val, key, sizeof(key))) {
+                if (!map_key_from_value(idx_val, key, sizeof(key))) {
                     report_error("Map key must be int, float, or string");
                     return make_int(0);
                 }
@@ -186,6 +274,8 @@ Value eval_node(ASTNode *node) {
                     return make_int(-to_int(operand));
                 case TOK_NOT:
                     return make_int(!to_bool(operand));
+                case TOK_AWAIT:
+                    return async_await(operand);
                 default:
                     return make_int(0);
             }
@@ -198,7 +288,7 @@ Value eval_node(ASTNode *node) {
         }
 
         case AST_ARRAY_ASSIGN: {
-            Value *arr = get_var(node->array_assign.var_name);
+            Value *arr = get_var_for_update(node->array_assign.var_name);
             if (!arr) {
                 report_error("Undefined indexed variable");
                 return make_int(0);
@@ -222,7 +312,7 @@ Value eval_node(ASTNode *node) {
 
             if (arr->type == TYPE_MAP) {
                 char key[MAX_STRING_LEN];
-                if (!key_from_value(idx_val, key, sizeof(key))) {
+                if (!map_key_from_value(idx_val, key, sizeof(key))) {
                     report_error("Map key must be int, float, or string");
                     return make_int(0);
                 }
@@ -241,26 +331,18 @@ Value eval_node(ASTNode *node) {
                 arg_values[i] = eval_node(node->call.args[i]);
             }
 
-            if (is_builtin_function(node->call.func_name)) {
-                Value result = call_builtin_function(node->call.func_name, arg_values, node->call.arg_count);
-                free(arg_values);
-                return result;
+            const NativeDef *native = atomic_load_explicit(&node->call.native, memory_order_relaxed);
+            if (!native) {
+                native = native_lookup(node->call.func_name);
+                atomic_store_explicit(&node->call.native, native, memory_order_relaxed);
             }
-
-            if (is_extended_builtin(node->call.func_name)) {
-                Value result = call_extended_builtin(node->call.func_name, arg_values, node->call.arg_count);
+            Function *func = (!native || !native->reserved) ? resolve_function(node->call.func_name) : NULL;
+            if (native && !func) {
+                Value result = native_call(native, arg_values, node->call.arg_count);
                 free(arg_values);
                 return result;
             }
 
-            Function *func = NULL;
-            for (int i = 0; i < func_count; i++) {
-                if (strcmp(functions[i].name, node->call.func_name) == 0) {
-                    func = &functions[i];
-                    break;
-                }
-            }
-
             if (!func) {
                 char msg[256];
                 snprintf(msg, sizeof(msg), "Undefined function: %s", node->call.func_name);
@@ -269,42 +351,15 @@ Value eval_node(ASTNode *node) {
                 return make_int(0);
             }
 
-            if (node->call.arg_count != func->param_count) {
-                report_error("Argument count mismatch");
-                free(arg_values);
-                return make_int(0);
-            }
-
-            if (call_depth >= MAX_CALL_DEPTH) {
-                free(arg_values);
-                report_error("Stack overflow");
-                return make_int(0);
-            }
-
-            call_stack_vars[call_depth] = create_var_table();
-            call_depth++;
-
-            for (int i = 0; i < func->param_count; i++) {
-                set_var(func->params[i], arg_values[i]);
-            }
+            Value result = call_function(func, arg_values, node->call.arg_count);
             free(arg_values);
-
-            should_return = false;
-            eval_node(func->body);
-
-            Value result = return_value;
-            should_return = false;
-
-            call_depth--;
-            free_var_table(call_stack_vars[call_depth]);
-            call_stack_vars[call_depth] = NULL;
-
             return result;
         }
 
         case AST_BLOCK: {
             for (int i = 0; i < node->block.count; i++) {
-                if (should_break || should_continue || should_return) break;
+                if (nac_ctx->should_break || nac_ctx->should_continue || nac_ctx->should_return) break;
+                if (nac_ctx->halted) break;
                 eval_node(node->block.statements[i]);
             }
             return make_int(0);
@@ -329,21 +384,23 @@ Value eval_node(ASTNode *node) {
                 Value condition = eval_node(node->for_stmt.condition);
                 if (!to_bool(condition)) break;
 
-                should_continue = false;
+                nac_ctx->should_continue = false;
                 eval_node(node->for_stmt.body);
 
-                if (should_break) {
-                    should_break = false;
+                if (nac_ctx->should_break) {
+                    nac_ctx->should_break = false;
                     break;
                 }
-                if (should_return) break;
+                if (nac_ctx->should_return || nac_ctx->halted) break;
+
+                heap_profile_poll();
 
                 if (node->for_stmt.increment) {
                     eval_node(node->for_stmt.increment);
                 }
             }
 
-            should_continue = false;
+            nac_ctx->should_continue = false;
             return make_int(0);
         }
 
@@ -352,20 +409,62 @@ Value eval_node(ASTNode *node) {
                 Value condition = eval_node(node->while_stmt.condition);
                 if (!to_bool(condition)) break;
 
-                should_continue = false;
+                nac_ctx->should_continue = false;
                 eval_node(node->while_stmt.body);
 
-                if (should_break) {
-                    should_break = false;
+                if (nac_ctx->should_break) {
+                    nac_ctx->should_break = false;
                     break;
                 }
-                if (should_return) break;
+                if (nac_ctx->should_return || nac_ctx->halted) break;
+
+                heap_profile_poll();
+            }
+
+            nac_ctx->should_continue = false;
+            return make_int(0);
+        }
+
+        case AST_FOR_IN: {
+            Value iterable = eval_node(node->for_in.iterable);
+
+            // Arrays are iterated over a copy so the body may change them.
+            if (iterable.type == TYPE_ARRAY) {
+                Value items = copy_value(iterable);
+                for (int i = 0; i < items.array_val.size; i++) {
+                    set_var(node->for_in.var_name, items.array_val.elements[i]);
+                    if (!loop_body(node->for_in.body)) break;
+                }
+                free_value(&items);
+                nac_ctx->should_continue = false;
+                return make_int(0);
             }
 
-            should_continue = false;
+            Generator *gen = generator_find(iterable, "for-in");
+            if (!gen) return make_int(0);
+
+            Value item;
+            while (generator_next(gen, &item)) {
+                set_var(node->for_in.var_name, item);
+                free_value(&item);
+                if (!loop_body(node->for_in.body)) break;
+            }
+            generator_close(gen);
+
+            nac_ctx->should_continue = false;
+            return make_int(0);
+        }
+
+        case AST_YIELD: {
+            Value val = eval_node(node->yield_stmt.value);
+            generator_yield(val);
             return make_int(0);
         }
 
+        case AST_IMPORT:
+            source_module_import(node->import_stmt.path, node->import_stmt.alias);
+            return make_int(0);
+
         case AST_HTTP: {
             Value method_val = eval_node(node->http_stmt.method);
             Value url_val = eval_node(node->http_stmt.url);
@@ -394,17 +493,17 @@ Value eval_node(ASTNode *node) {
 
         case AST_RETURN: {
             Value val = eval_node(node->return_stmt.value);
-            return_value = copy_value(val);
-            should_return = true;
-            return return_value;
+            nac_ctx->return_value = copy_value(val);
+            nac_ctx->should_return = true;
+            return nac_ctx->return_value;
         }
 
         case AST_BREAK:
-            should_break = true;
+            nac_ctx->should_break = true;
             return make_int(0);
 
         case AST_CONTINUE:
-            should_continue = true;
+            nac_ctx->should_continue = true;
             return make_int(0);
 
         case AST_OUT: {
@@ -484,7 +583,7 @@ Value eval_node(ASTNode *node) {
                 return make_array(size);
             } else {
                 Value arr = make_array(node->array_literal.count);
-                for (int i = 0; i < node->array_literal.count; i++) {
+                for (int i = 0; i < arr.array_val.size; i++) {
                     arr.array_val.elements[i] = eval_node(node->array_literal.elements[i]);
                 }
                 return arr;
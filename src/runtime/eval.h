@@ -2,8 +2,12 @@
 #define NAC_EVAL_H
 
 #include "../parser/ast.h"
+#include "../parser/parser.h"
 #include "value.h"
 
 Value eval_node(ASTNode *node);
+Function *find_function(const char *name);
+Value call_function(Function *func, Value *args, int arg_count);
+Value invoke_function(Function *func, Value *args, int arg_count);
 
 #endif
@@ -0,0 +1,623 @@
+#include "event_loop.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "eval.h"
+#include "../util/error.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOP_MAX_EVENTS 64
+#define LINE_BUFFER_SIZE MAX_STRING_LEN
+
+typedef struct {
+    bool active;
+    bool keep_alive;
+    bool always_ready;  // regular files cannot be polled; they are always readable
+    int events;
+    LoopIoHandler handler;
+    void *data;
+} Watch;
+
+typedef struct {
+    long id;
+    double due;
+    double interval;
+    bool cancelled;
+    bool keep_alive;
+    LoopTimerHandler handler;
+    void *data;
+    LoopRelease release;
+} Timer;
+
+typedef struct LoopPost {
+    LoopTimerHandler handler;
+    LoopRelease release;
+    void *data;
+    struct LoopPost *next;
+} LoopPost;
+
+struct EventLoop {
+    int epfd;
+    Watch *watches;  // indexed by fd
+    int watch_capacity;
+    int ready_count;
+    Timer **heap;    // min-heap on due time; cancelled timers are dropped when they surface
+    int timer_count;
+    int timer_capacity;
+    long next_timer_id;
+    int alive;       // keep-alive watches, timers and holds
+    bool running;
+    struct LineReader *lines;
+
+    // Completions handed over from other threads, see event_loop_post().
+    int wake_fd;
+    pthread_mutex_t post_lock;
+    LoopPost *posts;
+    atomic_int expected_posts;
+};
+
+typedef struct {
+    char func_name[MAX_TOKEN_LEN];
+    Value *args;
+    int arg_count;
+} ScriptCall;
+
+typedef struct LineReader {
+    char func_name[MAX_TOKEN_LEN];
+    char line[LINE_BUFFER_SIZE];
+    int len;
+} LineReader;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+EventLoop *event_loop_get(void) {
+    if (nac_ctx->loop) {
+        return nac_ctx->loop;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        report_error("Cannot create event loop");
+        return NULL;
+    }
+
+    EventLoop *loop = (EventLoop*)calloc(1, sizeof(EventLoop));
+    loop->epfd = epfd;
+    loop->next_timer_id = 1;
+    loop->wake_fd = -1;
+    pthread_mutex_init(&loop->post_lock, NULL);
+    nac_ctx->loop = loop;
+    return loop;
+}
+
+bool event_loop_watch(EventLoop *loop, int fd, int events, LoopIoHandler handler, void *data, bool keep_alive) {
+    if (fd >= loop->watch_capacity) {
+        int capacity = loop->watch_capacity ? loop->watch_capacity : 64;
+        while (capacity <= fd) capacity *= 2;
+        loop->watches = (Watch*)realloc(loop->watches, sizeof(Watch) * capacity);
+        memset(loop->watches + loop->watch_capacity, 0, sizeof(Watch) * (capacity - loop->watch_capacity));
+        loop->watch_capacity = capacity;
+    }
+
+    Watch *watch = &loop->watches[fd];
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & LOOP_READ) ? EPOLLIN : 0) | ((events & LOOP_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    bool was_active = watch->active;
+    bool always_ready = was_active && watch->always_ready;
+    if (!always_ready && epoll_ctl(loop->epfd, was_active ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno != EPERM || was_active) {
+            return false;
+        }
+        always_ready = true;
+    }
+
+    if (!was_active) {
+        if (keep_alive) loop->alive++;
+        if (always_ready) loop->ready_count++;
+    } else if (watch->keep_alive != keep_alive) {
+        loop->alive += keep_alive ? 1 : -1;
+    }
+
+    watch->active = true;
+    watch->keep_alive = keep_alive;
+    watch->always_ready = always_ready;
+    watch->events = events;
+    watch->handler = handler;
+    watch->data = data;
+    return true;
+}
+
+void event_loop_unwatch(EventLoop *loop, int fd) {
+    if (fd < 0 || fd >= loop->watch_capacity || !loop->watches[fd].active) return;
+
+    Watch *watch = &loop->watches[fd];
+    if (watch->always_ready) {
+        loop->ready_count--;
+    } else {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    if (watch->keep_alive) loop->alive--;
+    memset(watch, 0, sizeof(Watch));
+}
+
+static void heap_swap(EventLoop *loop, int a, int b) {
+    Timer *t = loop->heap[a];
+    loop->heap[a] = loop->heap[b];
+    loop->heap[b] = t;
+}
+
+static void heap_push(EventLoop *loop, Timer *timer) {
+    if (loop->timer_count == loop->timer_capacity) {
+        loop->timer_capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 16;
+        loop->heap = (Timer**)realloc(loop->heap, sizeof(Timer*) * loop->timer_capacity);
+    }
+
+    int i = loop->timer_count++;
+    loop->heap[i] = timer;
+    while (i > 0 && loop->heap[(i - 1) / 2]->due > loop->heap[i]->due) {
+        heap_swap(loop, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static Timer *heap_pop(EventLoop *loop) {
+    Timer *top = loop->heap[0];
+    loop->heap[0] = loop->heap[--loop->timer_count];
+
+    int i = 0;
+    for (;;) {
+        int smallest = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < loop->timer_count && loop->heap[l]->due < loop->heap[smallest]->due) smallest = l;
+        if (r < loop->timer_count && loop->heap[r]->due < loop->heap[smallest]->due) smallest = r;
+        if (smallest == i) break;
+        heap_swap(loop, i, smallest);
+        i = smallest;
+    }
+    return top;
+}
+
+static void timer_free(Timer *timer) {
+    if (timer->release) {
+        timer->release(timer->data);
+    }
+    free(timer);
+}
+
+long event_loop_timer(EventLoop *loop, double delay_ms, double interval_ms, LoopTimerHandler handler,
+                      void *data, LoopRelease release, bool keep_alive) {
+    Timer *timer = (Timer*)calloc(1, sizeof(Timer));
+    timer->id = loop->next_timer_id++;
+    timer->due = now_ms() + (delay_ms > 0 ? delay_ms : 0);
+    timer->interval = interval_ms;
+    timer->keep_alive = keep_alive;
+    timer->handler = handler;
+    timer->data = data;
+    timer->release = release;
+    if (keep_alive) loop->alive++;
+    heap_push(loop, timer);
+    return timer->id;
+}
+
+void event_loop_cancel(EventLoop *loop, long id) {
+    for (int i = 0; i < loop->timer_count; i++) {
+        Timer *timer = loop->heap[i];
+        if (timer->id == id && !timer->cancelled) {
+            timer->cancelled = true;
+            if (timer->keep_alive) loop->alive--;
+            return;
+        }
+    }
+}
+
+void event_loop_hold(EventLoop *loop, int delta) {
+    loop->alive += delta;
+}
+
+static LoopPost *take_posts(EventLoop *loop) {
+    pthread_mutex_lock(&loop->post_lock);
+    LoopPost *list = loop->posts;
+    loop->posts = NULL;
+    pthread_mutex_unlock(&loop->post_lock);
+
+    LoopPost *ordered = NULL;
+    while (list) {
+        LoopPost *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    return ordered;
+}
+
+static void run_posts(int fd, int events, void *data) {
+    (void)events;
+    EventLoop *loop = (EventLoop*)data;
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return;
+    }
+
+    LoopPost *post = take_posts(loop);
+    while (post) {
+        LoopPost *next = post->next;
+        post->handler(post->data);
+        free(post);
+        post = next;
+    }
+}
+
+// Announces, on the loop's thread, that another thread will call
+// event_loop_post() once. The loop stays alive until that post has run.
+void event_loop_expect_post(EventLoop *loop) {
+    if (loop->wake_fd < 0) {
+        loop->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        event_loop_watch(loop, loop->wake_fd, LOOP_READ, run_posts, loop, false);
+    }
+    atomic_fetch_add(&loop->expected_posts, 1);
+    loop->alive++;
+}
+
+// The only loop call that is safe from other threads. handler runs on the
+// loop's thread, and must drop the hold with event_loop_hold(loop, -1).
+void event_loop_post(EventLoop *loop, LoopTimerHandler handler, LoopRelease release, void *data) {
+    LoopPost *post = (LoopPost*)malloc(sizeof(LoopPost));
+    post->handler = handler;
+    post->release = release;
+    post->data = data;
+
+    pthread_mutex_lock(&loop->post_lock);
+    post->next = loop->posts;
+    loop->posts = post;
+    pthread_mutex_unlock(&loop->post_lock);
+
+    uint64_t one = 1;
+    ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+    (void)written;
+    atomic_fetch_sub(&loop->expected_posts, 1);
+}
+
+static void run_timers(EventLoop *loop) {
+    double now = now_ms();
+    while (loop->timer_count > 0 && (loop->heap[0]->cancelled || loop->heap[0]->due <= now)) {
+        Timer *timer = heap_pop(loop);
+        if (timer->cancelled) {
+            timer_free(timer);
+            continue;
+        }
+
+        // Re-arm before running so the handler can cancel its own interval.
+        if (timer->interval > 0) {
+            timer->due = now + timer->interval;
+            heap_push(loop, timer);
+            timer->handler(timer->data);
+            continue;
+        }
+
+        if (timer->keep_alive) loop->alive--;
+        timer->handler(timer->data);
+        timer_free(timer);
+    }
+}
+
+static int next_timeout(EventLoop *loop) {
+    if (loop->ready_count > 0) return 0;
+
+    while (loop->timer_count > 0 && loop->heap[0]->cancelled) {
+        timer_free(heap_pop(loop));
+    }
+    if (loop->timer_count == 0) return -1;
+
+    double wait = loop->heap[0]->due - now_ms();
+    return wait <= 0 ? 0 : (int)(wait + 0.999);
+}
+
+// One wait plus everything that became ready. Returns false once no
+// keep-alive watch, timer or hold is left.
+bool event_loop_run_once(EventLoop *loop) {
+    struct epoll_event events[LOOP_MAX_EVENTS];
+
+    if (loop->alive <= 0) {
+        return false;
+    }
+
+    int n = epoll_wait(loop->epfd, events, LOOP_MAX_EVENTS, next_timeout(loop));
+    if (n < 0) {
+        if (errno == EINTR) return true;
+        report_error("Event loop wait failed");
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd >= loop->watch_capacity || !loop->watches[fd].active) continue;
+
+        int flags = 0;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) flags |= LOOP_READ;
+        if (events[i].events & (EPOLLOUT | EPOLLERR)) flags |= LOOP_WRITE;
+        loop->watches[fd].handler(fd, flags, loop->watches[fd].data);
+    }
+
+    for (int fd = 0; loop->ready_count > 0 && fd < loop->watch_capacity; fd++) {
+        Watch *watch = &loop->watches[fd];
+        if (watch->active && watch->always_ready) {
+            watch->handler(fd, watch->events, watch->data);
+        }
+    }
+
+    run_timers(loop);
+    return true;
+}
+
+void event_loop_run(EventLoop *loop) {
+    if (loop->running) {
+        report_error("runLoop() is already running");
+        return;
+    }
+
+    loop->running = true;
+    while (event_loop_run_once(loop)) {}
+    loop->running = false;
+}
+
+void event_loop_free(NacContext *ctx) {
+    EventLoop *loop = ctx->loop;
+    if (!loop) return;
+
+    // A worker may still be about to post; the loop must outlive that.
+    while (atomic_load(&loop->expected_posts) > 0) {
+        sched_yield();
+    }
+    LoopPost *post = take_posts(loop);
+    while (post) {
+        LoopPost *next = post->next;
+        if (post->release) post->release(post->data);
+        free(post);
+        post = next;
+    }
+
+    while (loop->timer_count > 0) {
+        timer_free(heap_pop(loop));
+    }
+    for (int fd = 0; fd < loop->watch_capacity; fd++) {
+        if (loop->watches[fd].active && loop->watches[fd].handler) {
+            event_loop_unwatch(loop, fd);
+        }
+    }
+    close(loop->epfd);
+    if (loop->wake_fd >= 0) close(loop->wake_fd);
+    pthread_mutex_destroy(&loop->post_lock);
+    free(loop->lines);
+    free(loop->heap);
+    free(loop->watches);
+    free(loop);
+    ctx->loop = NULL;
+}
+
+void loop_call(const char *func_name, Value *args, int arg_count) {
+    Function *func = find_function(func_name);
+    if (!func) {
+        char msg[MAX_TOKEN_LEN + 32];
+        snprintf(msg, sizeof(msg), "Undefined function: %s", func_name);
+        report_error(msg);
+        return;
+    }
+
+    Value result = call_function(func, args, arg_count);
+    nac_ctx->return_value = make_int(0);
+    free_value(&result);
+}
+
+static void run_script_call(void *data) {
+    ScriptCall *call = (ScriptCall*)data;
+    loop_call(call->func_name, call->args, call->arg_count);
+}
+
+static void free_script_call(void *data) {
+    ScriptCall *call = (ScriptCall*)data;
+    for (int i = 0; i < call->arg_count; i++) {
+        free_value(&call->args[i]);
+    }
+    free(call->args);
+    free(call);
+}
+
+Value loop_set_timer(const char *func_name, Value delay, Value *args, int arg_count, bool repeat) {
+    EventLoop *loop = event_loop_get();
+    if (!loop) return make_int(0);
+
+    double ms = to_float(delay);
+    if (repeat && ms <= 0) {
+        report_error("setInterval() needs a positive interval");
+        return make_int(0);
+    }
+
+    ScriptCall *call = (ScriptCall*)calloc(1, sizeof(ScriptCall));
+    strncpy(call->func_name, func_name, MAX_TOKEN_LEN - 1);
+    call->arg_count = arg_count;
+    call->args = (Value*)malloc(sizeof(Value) * (arg_count > 0 ? arg_count : 1));
+    for (int i = 0; i < arg_count; i++) {
+        call->args[i] = copy_value(args[i]);
+    }
+
+    long id = event_loop_timer(loop, ms, repeat ? ms : 0, run_script_call, call, free_script_call, true);
+    return make_int((int)id);
+}
+
+void loop_clear_timer(Value id) {
+    if (!nac_ctx->loop || id.type != TYPE_INT) return;
+    event_loop_cancel(nac_ctx->loop, id.int_val);
+}
+
+static void emit_line(LineReader *reader) {
+    reader->line[reader->len] = '\0';
+    Value line = make_string(reader->line);
+    reader->len = 0;
+    loop_call(reader->func_name, &line, 1);
+}
+
+static void read_lines(int fd, int events, void *data) {
+    (void)events;
+    LineReader *reader = (LineReader*)data;
+    char chunk[4096];
+
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (n <= 0) {
+        if (reader->len > 0) {
+            emit_line(reader);
+        }
+        event_loop_unwatch(nac_ctx->loop, fd);
+        nac_ctx->loop->lines = NULL;
+        free(reader);
+        return;
+    }
+
+    for (ssize_t i = 0; i < n; i++) {
+        if (chunk[i] == '\n') {
+            emit_line(reader);
+        } else if (reader->len < LINE_BUFFER_SIZE - 1) {
+            reader->line[reader->len++] = chunk[i];
+        }
+    }
+}
+
+// stdin is read in chunks as it becomes readable; each complete line goes
+// to func_name. The watch ends at end of input.
+void loop_on_line(const char *func_name) {
+    EventLoop *loop = event_loop_get();
+    if (!loop) return;
+
+    if (loop->lines) {
+        report_error("onLine() is already reading stdin");
+        return;
+    }
+
+    LineReader *reader = (LineReader*)calloc(1, sizeof(LineReader));
+    strncpy(reader->func_name, func_name, MAX_TOKEN_LEN - 1);
+    if (!event_loop_watch(loop, STDIN_FILENO, LOOP_READ, read_lines, reader, true)) {
+        report_error("Cannot watch stdin");
+        free(reader);
+        return;
+    }
+    loop->lines = reader;
+}
+
+#else
+
+EventLoop *event_loop_get(void) {
+    report_error("The event loop is only available on Linux");
+    return NULL;
+}
+
+bool event_loop_watch(EventLoop *loop, int fd, int events, LoopIoHandler handler, void *data, bool keep_alive) {
+    (void)loop;
+    (void)fd;
+    (void)events;
+    (void)handler;
+    (void)data;
+    (void)keep_alive;
+    return false;
+}
+
+void event_loop_unwatch(EventLoop *loop, int fd) {
+    (void)loop;
+    (void)fd;
+}
+
+long event_loop_timer(EventLoop *loop, double delay_ms, double interval_ms, LoopTimerHandler handler,
+                      void *data, LoopRelease release, bool keep_alive) {
+    (void)loop;
+    (void)delay_ms;
+    (void)interval_ms;
+    (void)handler;
+    (void)data;
+    (void)release;
+    (void)keep_alive;
+    return 0;
+}
+
+void event_loop_cancel(EventLoop *loop, long id) {
+    (void)loop;
+    (void)id;
+}
+
+void event_loop_hold(EventLoop *loop, int delta) {
+    (void)loop;
+    (void)delta;
+}
+
+void event_loop_expect_post(EventLoop *loop) {
+    (void)loop;
+}
+
+void event_loop_post(EventLoop *loop, LoopTimerHandler handler, LoopRelease release, void *data) {
+    (void)loop;
+    (void)handler;
+    (void)release;
+    (void)data;
+}
+
+bool event_loop_run_once(EventLoop *loop) {
+    (void)loop;
+    return false;
+}
+
+void event_loop_run(EventLoop *loop) {
+    (void)loop;
+}
+
+void event_loop_free(NacContext *ctx) {
+    (void)ctx;
+}
+
+Value loop_set_timer(const char *func_name, Value delay, Value *args, int arg_count, bool repeat) {
+    (void)func_name;
+    (void)delay;
+    (void)args;
+    (void)arg_count;
+    (void)repeat;
+    event_loop_get();
+    return make_int(0);
+}
+
+void loop_clear_timer(Value id) {
+    (void)id;
+}
+
+void loop_on_line(const char *func_name) {
+    (void)func_name;
+    event_loop_get();
+}
+
+void loop_call(const char *func_name, Value *args, int arg_count) {
+    (void)func_name;
+    (void)args;
+    (void)arg_count;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef NAC_EVENT_LOOP_H
+#define NAC_EVENT_LOOP_H
+
+#include <stdbool.h>
+
+#include "value.h"
+
+#define LOOP_READ 1
+#define LOOP_WRITE 2
+
+struct NacContext;
+typedef struct EventLoop EventLoop;
+
+typedef void (*LoopIoHandler)(int fd, int events, void *data);
+typedef void (*LoopTimerHandler)(void *data);
+typedef void (*LoopRelease)(void *data);
+
+// Watches and timers marked keep_alive hold event_loop_run() open; the
+// others (for example idle pooled connections) only run while it is open.
+EventLoop *event_loop_get(void);
+bool event_loop_watch(EventLoop *loop, int fd, int events, LoopIoHandler handler, void *data, bool keep_alive);
+void event_loop_unwatch(EventLoop *loop, int fd);
+long event_loop_timer(EventLoop *loop, double delay_ms, double interval_ms, LoopTimerHandler handler,
+                      void *data, LoopRelease release, bool keep_alive);
+void event_loop_cancel(EventLoop *loop, long id);
+void event_loop_hold(EventLoop *loop, int delta);
+void event_loop_expect_post(EventLoop *loop);
+void event_loop_post(EventLoop *loop, LoopTimerHandler handler, LoopRelease release, void *data);
+bool event_loop_run_once(EventLoop *loop);
+void event_loop_run(EventLoop *loop);
+void event_loop_free(struct NacContext *ctx);
+
+Value loop_set_timer(const char *func_name, Value delay, Value *args, int arg_count, bool repeat);
+void loop_clear_timer(Value id);
+void loop_on_line(const char *func_name);
+void loop_call(const char *func_name, Value *args, int arg_count);
+
+#endif
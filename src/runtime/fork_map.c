@@ -0,0 +1,250 @@
+#include "fork_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "../net/http.h"
+#include "eval.h"
+#include "value_io.h"
+#include "../util/bytebuf.h"
+#include "../util/error.h"
+#include "../util/thread_pool.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// The callee's return value is handed to the caller, as nac_call() does.
+static Value apply(Function *func, Value *item) {
+    Value result = call_function(func, item, 1);
+    nac_ctx->return_value = make_int(0);
+    return result;
+}
+
+static Value map_inline(Function *func, Value array) {
+    int count = array.array_val.size;
+    Value out = make_array(count);
+    if (out.array_val.size < count) return out;
+    // Stops on errors raised by this call, not on earlier ones.
+    int errors = nac_ctx->error_count;
+    for (int i = 0; i < count && nac_ctx->error_count == errors; i++) {
+        Value item = array.array_val.elements[i];
+        out.array_val.elements[i] = apply(func, &item);
+    }
+    return out;
+}
+
+#ifdef __linux__
+
+// Each worker hands its results back in a memfd: this header, then its
+// chunk's results in value_io encoding. The parent maps it after the
+// worker exits.
+typedef struct {
+    uint64_t len;
+    int32_t errors;
+    char message[512];
+} ForkResult;
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    int begin;
+    int end;
+} ForkWorker;
+
+// The child shares the parent's descriptors, so it must not touch the
+// parent's epoll set, curl handles or io_uring; it starts fresh ones if needed.
+// It reports only its own errors, which collect() adds to the parent's.
+static void detach_child(void) {
+    thread_pool_after_fork();
+    http_pool_after_fork();
+    http_policy_after_fork();
+    nac_ctx->loop = NULL;
+    nac_ctx->http = NULL;
+    nac_ctx->files = NULL;
+    nac_ctx->async = NULL;
+    nac_ctx->error_occurred = false;
+    nac_ctx->error_count = 0;
+    nac_ctx->last_error[0] = '\0';
+}
+
+static void run_child(Function *func, Value array, ForkWorker *worker) {
+    detach_child();
+
+    ByteBuf buf;
+    bytebuf_init(&buf);
+    for (int i = worker->begin; i < worker->end && !nac_ctx->error_occurred; i++) {
+        Value item = array.array_val.elements[i];
+        Value result = apply(func, &item);
+        value_write(&buf, result);
+        free_value(&result);
+    }
+
+    ForkResult header;
+    memset(&header, 0, sizeof(header));
+    header.len = buf.len;
+    header.errors = nac_ctx->error_count;
+    snprintf(header.message, sizeof(header.message), "%s", nac_ctx->last_error);
+
+    size_t size = sizeof(header) + buf.len;
+    int status = 1;
+    if (ftruncate(worker->fd, (off_t)size) == 0) {
+        void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, worker->fd, 0);
+        if (region != MAP_FAILED) {
+            memcpy(region, &header, sizeof(header));
+            if (buf.len > 0) {
+                memcpy((char*)region + sizeof(header), buf.data, buf.len);
+            }
+            munmap(region, size);
+            status = 0;
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+
+// Decodes a finished worker's results into out; false if it did not finish.
+static bool collect(ForkWorker *worker, Value *out) {
+    struct stat st;
+    if (fstat(worker->fd, &st) != 0 || (size_t)st.st_size < sizeof(ForkResult)) {
+        return false;
+    }
+
+    void *region = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, worker->fd, 0);
+    if (region == MAP_FAILED) return false;
+
+    ForkResult header;
+    memcpy(&header, region, sizeof(header));
+    bool ok = sizeof(header) + header.len <= (size_t)st.st_size;
+
+    ByteReader r;
+    reader_init(&r, (const char*)region + sizeof(header), ok ? (size_t)header.len : 0);
+    for (int i = worker->begin; ok && i < worker->end && r.pos < r.len; i++) {
+        Value v;
+        if (!value_read(&r, &v)) {
+            ok = false;
+            break;
+        }
+        out->array_val.elements[i] = v;
+    }
+    munmap(region, (size_t)st.st_size);
+
+    if (header.errors > 0) {
+        nac_ctx->error_occurred = true;
+        nac_ctx->error_count += header.errors;
+        snprintf(nac_ctx->last_error, sizeof(nac_ctx->last_error), "%s", header.message);
+    }
+    return ok;
+}
+
+static Value map_forked(Function *func, Value array, int workers) {
+    int count = array.array_val.size;
+    int chunk = (count + workers - 1) / workers;
+    workers = (count + chunk - 1) / chunk;
+
+    ForkWorker *pool = (ForkWorker*)calloc(workers, sizeof(ForkWorker));
+    for (int w = 0; w < workers; w++) {
+        pool[w].fd = -1;
+        pool[w].pid = -1;
+        pool[w].begin = w * chunk;
+        pool[w].end = (pool[w].begin + chunk < count) ? pool[w].begin + chunk : count;
+    }
+
+    // Buffered output would otherwise be written once by every child too.
+    fflush(stdout);
+    fflush(stderr);
+
+    Value out = make_array(count);
+    if (out.array_val.size < count) {
+        free(pool);
+        return out;
+    }
+    bool failed = false;
+    for (int w = 0; w < workers && !failed; w++) {
+        pool[w].fd = (int)syscall(SYS_memfd_create, "nac-fork-map", MFD_CLOEXEC);
+        if (pool[w].fd < 0) {
+            failed = true;
+            break;
+        }
+        pool[w].pid = fork();
+        if (pool[w].pid == 0) {
+            run_child(func, array, &pool[w]);
+        }
+        if (pool[w].pid < 0) {
+            failed = true;
+        }
+    }
+
+    char msg[128];
+    for (int w = 0; w < workers; w++) {
+        if (pool[w].pid > 0) {
+            // ECHILD here means SIGCHLD is ignored and the exit status is
+            // gone, so the worker cannot be trusted to have finished.
+            int status = 0;
+            pid_t reaped;
+            while ((reaped = waitpid(pool[w].pid, &status, 0)) < 0 && errno == EINTR) {}
+            if (reaped < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !collect(&pool[w], &out)) {
+                snprintf(msg, sizeof(msg), "forkMap(): worker %d did not finish", w);
+                report_error(msg);
+            }
+        }
+        if (pool[w].fd >= 0) {
+            close(pool[w].fd);
+        }
+    }
+    if (failed) {
+        report_error("forkMap(): cannot start worker processes");
+    }
+
+    free(pool);
+    return out;
+}
+
+#endif
+
+// Forks the workers and gives each one a contiguous chunk. They start from
+// a copy-on-write image of this process, so functions and globals are
+// already there; only results travel back. Writes a worker makes to globals
+// stay in that worker.
+Value fork_map(Value array, const char *func_name, int workers) {
+    char msg[256];
+    if (array.type != TYPE_ARRAY) {
+        report_error("forkMap() requires an array");
+        return make_int(0);
+    }
+
+    Function *func = find_function(func_name);
+    if (!func) {
+        snprintf(msg, sizeof(msg), "Undefined function: %s", func_name);
+        report_error(msg);
+        return make_int(0);
+    }
+
+    // Parsed once here rather than separately in every child.
+    for (int i = 0; i < nac_ctx->functions.count; i++) {
+        parse_function_body(nac_ctx->functions.items[i]);
+    }
+
+    if (workers <= 0) {
+        workers = thread_pool_size();
+    }
+    int count = array.array_val.size;
+    if (workers > count) workers = count;
+
+#ifdef __linux__
+    if (workers >= 2) {
+        return map_forked(func, array, workers);
+    }
+#endif
+    return map_inline(func, array);
+}
@@ -0,0 +1,8 @@
+#ifndef NAC_FORK_MAP_H
+#define NAC_FORK_MAP_H
+
+#include "value.h"
+
+Value fork_map(Value array, const char *func_name, int workers);
+
+#endif
@@ -0,0 +1,83 @@
+#include "functable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int name_hash(const char *s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+    return h;
+}
+
+static int find_slot(const FunctionTable *table, const char *name) {
+    int mask = table->index_capacity - 1;
+    int slot = (int)(name_hash(name) & (unsigned int)mask);
+    while (table->index[slot] >= 0 && strcmp(table->items[table->index[slot]]->name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void grow_index(FunctionTable *table) {
+    free(table->index);
+    table->index_capacity *= 2;
+    table->index = (int*)malloc(sizeof(int) * table->index_capacity);
+    memset(table->index, 0xFF, sizeof(int) * table->index_capacity);
+
+    // Re-inserted in definition order so the first definition keeps winning.
+    for (int i = 0; i < table->count; i++) {
+        int slot = find_slot(table, table->items[i]->name);
+        if (table->index[slot] < 0) {
+            table->index[slot] = i;
+        }
+    }
+}
+
+void function_table_init(FunctionTable *table) {
+    table->items = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->index_capacity = 64;
+    table->index = (int*)malloc(sizeof(int) * table->index_capacity);
+    memset(table->index, 0xFF, sizeof(int) * table->index_capacity);
+}
+
+void function_table_free(FunctionTable *table) {
+    for (int i = 0; i < table->count; i++) {
+        if (!table->items[i]->shared_body) {
+            free_ast(table->items[i]->body);
+        }
+        free(table->items[i]);
+    }
+    free(table->items);
+    free(table->index);
+    memset(table, 0, sizeof(FunctionTable));
+}
+
+Function *function_table_add(FunctionTable *table, const Function *func) {
+    if (table->count >= table->capacity) {
+        table->capacity = (table->capacity == 0) ? 64 : table->capacity * 2;
+        table->items = (Function**)realloc(table->items, sizeof(Function*) * table->capacity);
+    }
+    if ((table->count + 1) * 2 > table->index_capacity) {
+        grow_index(table);
+    }
+
+    Function *copy = (Function*)malloc(sizeof(Function));
+    *copy = *func;
+    table->items[table->count] = copy;
+
+    int slot = find_slot(table, copy->name);
+    if (table->index[slot] < 0) {
+        table->index[slot] = table->count;
+    }
+    table->count++;
+    return copy;
+}
+
+Function *function_table_find(const FunctionTable *table, const char *name) {
+    int i = table->index[find_slot(table, name)];
+    return (i >= 0) ? table->items[i] : NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef NAC_FUNCTABLE_H
+#define NAC_FUNCTABLE_H
+
+#include "../parser/parser.h"
+
+// Functions sit behind stable pointers (call frames keep func->name); the
+// name index is open-addressed and grows with the table.
+typedef struct {
+    Function **items;
+    int count;
+    int capacity;
+    int *index;
+    int index_capacity;
+} FunctionTable;
+
+void function_table_init(FunctionTable *table);
+void function_table_free(FunctionTable *table);
+Function *function_table_add(FunctionTable *table, const Function *func);
+Function *function_table_find(const FunctionTable *table, const char *name);
+
+#endif
@@ -0,0 +1,251 @@
+#include "generator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "coroutine.h"
+#include "eval.h"
+#include "../util/error.h"
+
+// Generators are per context and addressed by handle, like promises. A
+// script generator is a coroutine that suspends at every yield; readLines()
+// is a native one over a FILE.
+struct Generator {
+    int id;
+    bool (*next)(Generator *gen, Value *out);
+    Coroutine *co;      // NULL once the body has returned
+    FILE *file;
+    bool running;
+    bool has_value;
+    Value value;
+    Value *buffered;    // values of a body that ran up front
+    int buffered_count;
+    int buffered_pos;
+};
+
+typedef struct GeneratorState {
+    Generator **items;  // indexed by handle
+    int capacity;
+    int next_id;
+} GeneratorState;
+
+// Set while a generator body runs to completion without a coroutine.
+static _Thread_local Generator *collecting = NULL;
+
+// NULL, with the error reported, when out of memory.
+static Generator *generator_new(bool (*next)(Generator*, Value*)) {
+    GeneratorState *state = nac_ctx->generators;
+    if (!state) {
+        state = (GeneratorState*)calloc(1, sizeof(GeneratorState));
+        if (!state) {
+            report_error("Too many live generators");
+            return NULL;
+        }
+        state->next_id = 1;
+        nac_ctx->generators = state;
+    }
+    if (state->next_id >= state->capacity) {
+        int capacity = state->capacity ? state->capacity * 2 : 64;
+        Generator **items = (Generator**)realloc(state->items, sizeof(Generator*) * capacity);
+        if (!items) {
+            report_error("Too many live generators");
+            return NULL;
+        }
+        memset(items + state->capacity, 0, sizeof(Generator*) * (capacity - state->capacity));
+        state->items = items;
+        state->capacity = capacity;
+    }
+
+    Generator *gen = (Generator*)calloc(1, sizeof(Generator));
+    if (!gen) {
+        report_error("Too many live generators");
+        return NULL;
+    }
+    gen->id = state->next_id++;
+    gen->next = next;
+    gen->value = make_int(0);
+    state->items[gen->id] = gen;
+    return gen;
+}
+
+static bool script_next(Generator *gen, Value *out) {
+    if (!gen->co) return false;
+    if (gen->running) {
+        report_error("Generator cannot resume itself");
+        return false;
+    }
+
+    gen->running = true;
+    coroutine_resume(gen->co);
+    gen->running = false;
+
+    if (!gen->has_value) return false;
+    *out = gen->value;
+    gen->value = make_int(0);
+    gen->has_value = false;
+    return true;
+}
+
+static void script_done(Coroutine *co, Value result, void *data) {
+    (void)co;
+    Generator *gen = (Generator*)data;
+    free_value(&result);
+    gen->co = NULL;
+}
+
+static bool buffered_next(Generator *gen, Value *out) {
+    if (gen->buffered_pos >= gen->buffered_count) return false;
+    *out = gen->buffered[gen->buffered_pos];
+    gen->buffered[gen->buffered_pos++] = make_int(0);
+    return true;
+}
+
+// Calling a generator function runs nothing yet; the body starts on the
+// first next(). Without coroutines it runs to completion here instead and
+// its values are buffered.
+Value generator_call(Function *func, Value *args, int arg_count) {
+    Generator *gen = generator_new(script_next);
+    if (!gen) return make_int(0);
+    gen->co = coroutine_create(COROUTINE_GENERATOR, func, args, arg_count, script_done, gen);
+    if (gen->co) {
+        return make_int(gen->id);
+    }
+    if (coroutines_available()) {
+        // Buffering could run an endless body forever.
+        report_error("Too many live generators");
+        generator_close(gen);
+        return make_int(0);
+    }
+
+    gen->next = buffered_next;
+    Generator *outer = collecting;
+    collecting = gen;
+    Value result = invoke_function(func, args, arg_count);
+    nac_ctx->return_value = make_int(0);
+    free_value(&result);
+    collecting = outer;
+    return make_int(gen->id);
+}
+
+void generator_yield(Value value) {
+    Coroutine *co = coroutine_current();
+    if (co && coroutine_kind(co) == COROUTINE_GENERATOR) {
+        Generator *gen = (Generator*)coroutine_data(co);
+        gen->value = copy_value(value);
+        gen->has_value = true;
+        coroutine_suspend();
+        return;
+    }
+
+    if (collecting) {
+        Generator *gen = collecting;
+        Value *buffered = (Value*)realloc(gen->buffered, sizeof(Value) * (gen->buffered_count + 1));
+        if (!buffered) {
+            report_error("Out of memory buffering a generator");
+            return;
+        }
+        gen->buffered = buffered;
+        gen->buffered[gen->buffered_count++] = copy_value(value);
+        return;
+    }
+
+    report_error("yield outside a generator");
+}
+
+// Lines come without their terminator. Lines longer than a string are cut
+// to fit and the rest is skipped.
+static bool lines_next(Generator *gen, Value *out) {
+    char line[MAX_STRING_LEN];
+    if (!gen->file || !fgets(line, sizeof(line), gen->file)) return false;
+
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\n') {
+        line[--len] = '\0';
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+    } else {
+        int c;
+        while ((c = fgetc(gen->file)) != EOF && c != '\n') {}
+    }
+
+    *out = make_string(line);
+    return true;
+}
+
+Value generator_lines(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        char msg[MAX_STRING_LEN + 32];
+        snprintf(msg, sizeof(msg), "Cannot open file: %s", path);
+        report_error(msg);
+        return make_int(0);
+    }
+
+    Generator *gen = generator_new(lines_next);
+    if (!gen) {
+        fclose(f);
+        return make_int(0);
+    }
+    gen->file = f;
+    return make_int(gen->id);
+}
+
+Generator *generator_find(Value handle, const char *op) {
+    GeneratorState *state = nac_ctx->generators;
+    Generator *gen = NULL;
+    if (state && handle.type == TYPE_INT && handle.int_val > 0 && handle.int_val < state->next_id) {
+        gen = state->items[handle.int_val];
+    }
+    if (!gen) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s: not a generator", op);
+        report_error(msg);
+    }
+    return gen;
+}
+
+bool generator_next(Generator *gen, Value *out) {
+    return gen->next(gen, out);
+}
+
+// A generator that has not finished is dropped where it stands.
+void generator_close(Generator *gen) {
+    if (gen->running) {
+        report_error("Generator cannot close itself");
+        return;
+    }
+    if (gen->co) {
+        coroutine_destroy(gen->co);
+    }
+    if (gen->file) {
+        fclose(gen->file);
+    }
+    for (int i = gen->buffered_pos; i < gen->buffered_count; i++) {
+        free_value(&gen->buffered[i]);
+    }
+    free(gen->buffered);
+    free_value(&gen->value);
+
+    nac_ctx->generators->items[gen->id] = NULL;
+    free(gen);
+}
+
+// Runs before coroutines_free(), which would otherwise free the
+// coroutines of unfinished generators under them.
+void generators_free(NacContext *ctx) {
+    GeneratorState *state = ctx->generators;
+    if (!state) return;
+
+    NacContext *previous = context_enter(ctx);
+    for (int i = 1; i < state->next_id; i++) {
+        if (state->items[i]) {
+            state->items[i]->running = false;
+            generator_close(state->items[i]);
+        }
+    }
+    free(state->items);
+    free(state);
+    ctx->generators = NULL;
+    context_enter(previous);
+}
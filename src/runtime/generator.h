@@ -0,0 +1,22 @@
+#ifndef NAC_GENERATOR_H
+#define NAC_GENERATOR_H
+
+#include <stdbool.h>
+
+#include "../parser/parser.h"
+#include "value.h"
+
+struct NacContext;
+typedef struct Generator Generator;
+
+Value generator_call(Function *func, Value *args, int arg_count);
+Value generator_lines(const char *path);
+void generator_yield(Value value);
+
+Generator *generator_find(Value handle, const char *op);
+bool generator_next(Generator *gen, Value *out);
+void generator_close(Generator *gen);
+
+void generators_free(struct NacContext *ctx);
+
+#endif
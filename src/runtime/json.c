@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../core/interpreter.h"
 #include "../util/error.h"
 
 typedef struct {
@@ -181,16 +182,26 @@ static int parse_array(const char **p, Value *out, int depth) {
     }
 
     while (**p) {
+        Value *grown = items;
         if (count >= cap) {
             cap = (cap == 0) ? 4 : cap * 2;
-            items = (Value*)realloc(items, sizeof(Value) * cap);
+            grown = (Value*)value_realloc(items, sizeof(Value) * cap);
         }
 
+        if (!grown) {
+            for (int i = 0; i < count; i++) {
+                free_value(&items[i]);
+            }
+            value_release(items);
+            return 0;
+        }
+        items = grown;
+
         if (!parse_value(p, &items[count], depth + 1)) {
             for (int i = 0; i < count; i++) {
                 free_value(&items[i]);
             }
-            free(items);
+            value_release(items);
             return 0;
         }
         count++;
@@ -206,11 +217,18 @@ static int parse_array(const char **p, Value *out, int depth) {
         if (**p == ']') {
             (*p)++;
             Value arr = make_array(count);
+            if (arr.array_val.size < count) {
+                for (int i = 0; i < count; i++) {
+                    free_value(&items[i]);
+                }
+                value_release(items);
+                return 0;
+            }
             for (int i = 0; i < count; i++) {
                 free_value(&arr.array_val.elements[i]);
                 arr.array_val.elements[i] = items[i];
             }
-            free(items);
+            value_release(items);
             *out = arr;
             return 1;
         }
@@ -221,7 +239,7 @@ static int parse_array(const char **p, Value *out, int depth) {
     for (int i = 0; i < count; i++) {
         free_value(&items[i]);
     }
-    free(items);
+    value_release(items);
     return 0;
 }
 
@@ -287,8 +305,9 @@ static int parse_object(const char **p, Value *out, int depth) {
     return 0;
 }
 
+// Stops as soon as the memory quota halts the script.
 static int parse_value(const char **p, Value *out, int depth) {
-    if (depth > 64) {
+    if (depth > 64 || nac_ctx->halted) {
         return 0;
     }
 
@@ -339,7 +358,9 @@ bool json_parse_value(const char *json, Value *out) {
 
     const char *p = json;
     if (!parse_value(&p, out, 0)) {
-        report_error("Invalid JSON input");
+        if (!nac_ctx->halted) {
+            report_error("Invalid JSON input");
+        }
         return false;
     }
 
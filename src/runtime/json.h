@@ -8,4 +8,12 @@
 bool json_parse_value(const char *json, Value *out);
 char *json_stringify_value(Value value);
 
+// Incremental parsing, see json_stream.c.
+typedef struct JsonStream JsonStream;
+
+JsonStream *json_stream_create(const char *path);
+bool json_stream_feed(JsonStream *s, const char *data, size_t len);
+bool json_stream_finish(JsonStream *s, Value *out);
+void json_stream_free(JsonStream *s);
+
 #endif
@@ -0,0 +1,399 @@
+#include "json.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "../util/error.h"
+
+// A push parser for the same JSON that json_parse_value() accepts. Input
+// arrives in arbitrary chunks, so all state lives in the JsonStream: the
+// containers still open, and the token being read when a chunk ran out.
+#define JSON_STREAM_DEPTH 64
+#define JSON_STREAM_PATH 16
+
+typedef enum {
+    LEX_VALUE,        // before a value
+    LEX_KEY,          // before a key, or '}' right after '{'
+    LEX_COLON,
+    LEX_AFTER_VALUE,  // before ',' or the closing bracket
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_NUMBER,
+    LEX_LITERAL,
+    LEX_END
+} JsonLex;
+
+typedef struct {
+    bool is_object;
+    Value value;       // map for objects
+    Value *items;      // elements so far for arrays
+    int count;
+    int cap;
+    char key[MAX_STRING_LEN];
+} JsonFrame;
+
+struct JsonStream {
+    JsonLex lex;
+    bool in_key;       // the string being read is an object key
+    bool after_first;  // LEX_VALUE right after '[' may also see ']'
+    bool failed;
+
+    JsonFrame *frames;
+    int depth;
+
+    char text[MAX_STRING_LEN];
+    size_t text_len;
+
+    char *path[JSON_STREAM_PATH];
+    int path_len;
+
+    bool done;
+    Value result;
+};
+
+JsonStream *json_stream_create(const char *path) {
+    JsonStream *s = (JsonStream*)calloc(1, sizeof(JsonStream));
+    s->frames = (JsonFrame*)malloc(sizeof(JsonFrame) * JSON_STREAM_DEPTH);
+    s->lex = LEX_VALUE;
+    s->result = make_int(0);
+
+    if (path && path[0]) {
+        char *copy = strdup(path);
+        for (char *seg = strtok(copy, "."); seg && s->path_len < JSON_STREAM_PATH; seg = strtok(NULL, ".")) {
+            s->path[s->path_len++] = strdup(seg);
+        }
+        free(copy);
+    }
+    return s;
+}
+
+static void frame_free(JsonFrame *frame) {
+    if (frame->is_object) {
+        free_value(&frame->value);
+        return;
+    }
+    for (int i = 0; i < frame->count; i++) {
+        free_value(&frame->items[i]);
+    }
+    value_release(frame->items);
+}
+
+void json_stream_free(JsonStream *s) {
+    while (s->depth > 0) {
+        frame_free(&s->frames[--s->depth]);
+    }
+    free(s->frames);
+    for (int i = 0; i < s->path_len; i++) {
+        free(s->path[i]);
+    }
+    free_value(&s->result);
+    free(s);
+}
+
+// Whether the value about to complete sits at the requested path.
+static bool at_path(JsonStream *s) {
+    if (s->path_len == 0 || s->depth != s->path_len) return false;
+
+    char index[16];
+    for (int i = 0; i < s->depth; i++) {
+        JsonFrame *frame = &s->frames[i];
+        const char *segment = frame->key;
+        if (!frame->is_object) {
+            snprintf(index, sizeof(index), "%d", frame->count);
+            segment = index;
+        }
+        if (strcmp(segment, s->path[i]) != 0) return false;
+    }
+    return true;
+}
+
+// Hands a finished value to the enclosing container, taking ownership.
+static void emit(JsonStream *s, Value value) {
+    bool found = at_path(s);
+    if (found || s->depth == 0) {
+        if (found || s->path_len == 0) {
+            s->result = value;
+        } else {
+            free_value(&value);
+        }
+        s->done = true;
+        s->lex = LEX_END;
+        return;
+    }
+
+    // Past the memory quota the containers stop growing and the stream fails.
+    JsonFrame *frame = &s->frames[s->depth - 1];
+    if (frame->is_object) {
+        // Stored in place rather than through a copy.
+        Value placeholder = make_int(0);
+        map_set(&frame->value, frame->key, placeholder);
+        Value *slot = map_get(&frame->value, frame->key);
+        if (!slot) {
+            free_value(&value);
+            s->failed = true;
+            return;
+        }
+        *slot = value;
+    } else {
+        if (frame->count >= frame->cap) {
+            int cap = frame->cap ? frame->cap * 2 : 4;
+            Value *items = (Value*)value_realloc(frame->items, sizeof(Value) * cap);
+            if (!items) {
+                free_value(&value);
+                s->failed = true;
+                return;
+            }
+            frame->items = items;
+            frame->cap = cap;
+        }
+        frame->items[frame->count++] = value;
+    }
+    s->lex = LEX_AFTER_VALUE;
+}
+
+static void open_frame(JsonStream *s, bool is_object) {
+    if (s->depth >= JSON_STREAM_DEPTH) {
+        s->failed = true;
+        return;
+    }
+    JsonFrame *frame = &s->frames[s->depth++];
+    frame->is_object = is_object;
+    frame->items = NULL;
+    frame->count = 0;
+    frame->cap = 0;
+    frame->key[0] = '\0';
+    if (is_object) {
+        frame->value = make_map();
+        s->lex = LEX_KEY;
+    } else {
+        s->lex = LEX_VALUE;
+        s->after_first = true;
+    }
+}
+
+static void close_frame(JsonStream *s) {
+    JsonFrame *frame = &s->frames[--s->depth];
+    Value value;
+    if (frame->is_object) {
+        value = frame->value;
+    } else {
+        value = make_array(frame->count);
+        for (int i = 0; i < frame->count; i++) {
+            if (i < value.array_val.size) {
+                value.array_val.elements[i] = frame->items[i];
+            } else {
+                free_value(&frame->items[i]);
+                s->failed = true;
+            }
+        }
+        value_release(frame->items);
+    }
+    if (s->failed) {
+        free_value(&value);
+        return;
+    }
+    emit(s, value);
+}
+
+static void finish_number(JsonStream *s) {
+    s->text[s->text_len] = '\0';
+    const char *p = s->text;
+    if (*p == '-') p++;
+    if (!isdigit((unsigned char)*p)) {
+        s->failed = true;
+        return;
+    }
+
+    char *end = NULL;
+    bool is_float = strpbrk(s->text, ".eE") != NULL;
+    Value value;
+    if (is_float) {
+        value = make_float(strtod(s->text, &end));
+    } else {
+        value = make_int((int)strtol(s->text, &end, 10));
+    }
+    if (*end != '\0') {
+        s->failed = true;
+        return;
+    }
+    emit(s, value);
+}
+
+static void finish_literal(JsonStream *s) {
+    s->text[s->text_len] = '\0';
+    if (strcmp(s->text, "true") == 0) {
+        emit(s, make_int(1));
+    } else if (strcmp(s->text, "false") == 0 || strcmp(s->text, "null") == 0) {
+        emit(s, make_int(0));
+    } else {
+        s->failed = true;
+    }
+}
+
+static void finish_string(JsonStream *s) {
+    s->text[s->text_len] = '\0';
+    if (s->in_key) {
+        JsonFrame *frame = &s->frames[s->depth - 1];
+        memcpy(frame->key, s->text, s->text_len + 1);
+        s->lex = LEX_COLON;
+    } else {
+        emit(s, make_string(s->text));
+    }
+}
+
+static void start_value(JsonStream *s, char c) {
+    s->text_len = 0;
+    if (c == '{') {
+        open_frame(s, true);
+    } else if (c == '[') {
+        open_frame(s, false);
+    } else if (c == '"') {
+        s->in_key = false;
+        s->lex = LEX_STRING;
+    } else if (c == '-' || isdigit((unsigned char)c)) {
+        s->text[s->text_len++] = c;
+        s->lex = LEX_NUMBER;
+    } else if (c == 't' || c == 'f' || c == 'n') {
+        s->text[s->text_len++] = c;
+        s->lex = LEX_LITERAL;
+    } else {
+        s->failed = true;
+    }
+}
+
+static void feed_char(JsonStream *s, char c) {
+    switch (s->lex) {
+        case LEX_VALUE:
+            if (isspace((unsigned char)c)) return;
+            if (c == ']' && s->after_first) {
+                s->after_first = false;
+                close_frame(s);
+                return;
+            }
+            s->after_first = false;
+            start_value(s, c);
+            return;
+
+        case LEX_KEY:
+            if (isspace((unsigned char)c)) return;
+            if (c == '}' && s->frames[s->depth - 1].value.map_val.size == 0) {
+                close_frame(s);
+            } else if (c == '"') {
+                s->in_key = true;
+                s->text_len = 0;
+                s->lex = LEX_STRING;
+            } else {
+                s->failed = true;
+            }
+            return;
+
+        case LEX_COLON:
+            if (isspace((unsigned char)c)) return;
+            if (c == ':') s->lex = LEX_VALUE;
+            else s->failed = true;
+            return;
+
+        case LEX_AFTER_VALUE: {
+            if (isspace((unsigned char)c)) return;
+            JsonFrame *frame = &s->frames[s->depth - 1];
+            if (c == ',') {
+                s->lex = frame->is_object ? LEX_KEY : LEX_VALUE;
+                if (frame->is_object) frame->key[0] = '\0';
+            } else if (c == (frame->is_object ? '}' : ']')) {
+                close_frame(s);
+            } else {
+                s->failed = true;
+            }
+            return;
+        }
+
+        case LEX_STRING:
+            if (c == '"') {
+                finish_string(s);
+            } else if (c == '\\') {
+                s->lex = LEX_ESCAPE;
+            } else if (s->text_len + 1 < MAX_STRING_LEN) {
+                s->text[s->text_len++] = c;
+            }
+            return;
+
+        case LEX_ESCAPE:
+            switch (c) {
+                case '"': case '\\': case '/': break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                default:
+                    s->failed = true;
+                    return;
+            }
+            if (s->text_len + 1 < MAX_STRING_LEN) {
+                s->text[s->text_len++] = c;
+            }
+            s->lex = LEX_STRING;
+            return;
+
+        case LEX_NUMBER:
+            if (isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                if (s->text_len + 1 >= 128) s->failed = true;
+                else s->text[s->text_len++] = c;
+                return;
+            }
+            finish_number(s);
+            if (!s->failed && !(s->done && s->path_len > 0)) feed_char(s, c);
+            return;
+
+        case LEX_LITERAL:
+            if (isalpha((unsigned char)c)) {
+                if (s->text_len >= 5) s->failed = true;
+                else s->text[s->text_len++] = c;
+                return;
+            }
+            finish_literal(s);
+            if (!s->failed && !(s->done && s->path_len > 0)) feed_char(s, c);
+            return;
+
+        case LEX_END:
+            if (!isspace((unsigned char)c)) s->failed = true;
+            return;
+    }
+}
+
+// Returns false once the stream has failed, or when a path was requested
+// and its value is complete: the rest of the input is not needed.
+bool json_stream_feed(JsonStream *s, const char *data, size_t len) {
+    for (size_t i = 0; i < len && !s->failed; i++) {
+        feed_char(s, data[i]);
+        if (s->done && s->path_len > 0) return false;
+    }
+    return !s->failed;
+}
+
+// Ends the input and takes the parsed value (or the value at the path, or 0
+// if the path never appeared).
+bool json_stream_finish(JsonStream *s, Value *out) {
+    if (!s->failed && !s->done) {
+        if (s->lex == LEX_NUMBER) finish_number(s);
+        else if (s->lex == LEX_LITERAL) finish_literal(s);
+    }
+
+    if (s->failed) {
+        if (!nac_ctx->halted) {
+            report_error(s->lex == LEX_END ? "Invalid JSON: trailing characters" : "Invalid JSON input");
+        }
+        return false;
+    }
+    if (!s->done) {
+        report_error("Invalid JSON input");
+        return false;
+    }
+
+    *out = s->result;
+    s->result = make_int(0);
+    return true;
+}
@@ -0,0 +1,261 @@
+#include "parallel.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "eval.h"
+#include "../util/error.h"
+#include "../util/thread_pool.h"
+
+#define CHUNKS_PER_WORKER 4
+
+// Each pool thread keeps its own context. Function bodies are shared with the
+// owning context, and its globals are visible read-only through
+// shared_globals; anything a worker writes stays in the worker.
+typedef struct {
+    NacContext *ctx;
+    unsigned long source_id;
+    int synced;
+} WorkerState;
+
+typedef struct {
+    NacContext *source;
+    const char *func_name;
+    const Value *items;
+    int count;
+    int chunk_size;
+    int chunk_count;
+    Value *results;
+    Value *partials;
+    atomic_int next_chunk;
+    atomic_bool failed;
+    atomic_int errors;
+    atomic_bool has_message;
+    char message[512];
+} ParallelJob;
+
+static WorkerState worker_states[THREAD_POOL_MAX_THREADS];
+
+static void sync_worker(WorkerState *ws, NacContext *source) {
+    if (ws->ctx && ws->source_id != source->id) {
+        context_destroy(ws->ctx);
+        ws->ctx = NULL;
+    }
+    if (!ws->ctx) {
+        ws->ctx = context_create();
+        ws->source_id = source->id;
+        ws->synced = 0;
+    }
+
+    NacContext *ctx = ws->ctx;
+    // Functions are only ever appended, so only new ones need copying.
+    for (; ws->synced < source->functions.count; ws->synced++) {
+        Function func = *source->functions.items[ws->synced];
+        func.shared_body = true;
+        function_table_add(&ctx->functions, &func);
+    }
+    native_table_inherit(&ctx->natives, &source->natives);
+
+    free_var_table(ctx->global_vars);
+    ctx->global_vars = create_var_table();
+    ctx->shared_globals = source->global_vars;
+    ctx->script_name = source->script_name;
+    ctx->script_argc = source->script_argc;
+    ctx->script_argv = source->script_argv;
+    ctx->current_token = source->current_token;
+}
+
+// The callee's return value is handed to the caller, as nac_call() does.
+static Value apply(Function *func, Value *args, int arg_count) {
+    Value result = call_function(func, args, arg_count);
+    nac_ctx->return_value = make_int(0);
+    return result;
+}
+
+static Value reduce_range(Function *func, const Value *items, int begin, int end) {
+    Value acc = copy_value(items[begin]);
+    for (int i = begin + 1; i < end && !nac_ctx->error_occurred; i++) {
+        Value args[2] = { acc, items[i] };
+        Value next = apply(func, args, 2);
+        free_value(&acc);
+        acc = next;
+    }
+    return acc;
+}
+
+static void run_chunks(int worker, void *arg) {
+    ParallelJob *job = (ParallelJob*)arg;
+    WorkerState *ws = &worker_states[worker];
+    sync_worker(ws, job->source);
+
+    NacContext *previous = context_enter(ws->ctx);
+    Function *func = find_function(job->func_name);
+
+    while (func && !atomic_load_explicit(&job->failed, memory_order_relaxed)) {
+        int chunk = atomic_fetch_add_explicit(&job->next_chunk, 1, memory_order_relaxed);
+        if (chunk >= job->chunk_count) break;
+
+        int begin = chunk * job->chunk_size;
+        int end = begin + job->chunk_size;
+        if (end > job->count) end = job->count;
+
+        if (job->partials) {
+            job->partials[chunk] = reduce_range(func, job->items, begin, end);
+        } else {
+            for (int i = begin; i < end && !nac_ctx->error_occurred; i++) {
+                Value item = job->items[i];
+                job->results[i] = apply(func, &item, 1);
+            }
+        }
+
+        if (nac_ctx->error_occurred) {
+            atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+        }
+    }
+
+    if (nac_ctx->error_count > 0) {
+        atomic_fetch_add(&job->errors, nac_ctx->error_count);
+        if (!atomic_exchange(&job->has_message, true)) {
+            snprintf(job->message, sizeof(job->message), "%s", nac_ctx->last_error);
+        }
+        nac_ctx->error_occurred = false;
+        nac_ctx->error_count = 0;
+        nac_ctx->halted = false;
+    }
+    while (nac_ctx->call_depth > 0) {
+        free_var_table(nac_ctx->call_stack_vars[--nac_ctx->call_depth]);
+    }
+    context_enter(previous);
+}
+
+static Function *prepare(Value array, const char *func_name, const char *builtin) {
+    char msg[256];
+    if (array.type != TYPE_ARRAY) {
+        snprintf(msg, sizeof(msg), "%s() requires an array", builtin);
+        report_error(msg);
+        return NULL;
+    }
+
+    Function *func = find_function(func_name);
+    if (!func) {
+        snprintf(msg, sizeof(msg), "Undefined function: %s", func_name);
+        report_error(msg);
+        return NULL;
+    }
+
+    // Workers cannot parse lazily from this context's tokens, so every body
+    // is ready before they start.
+    for (int i = 0; i < nac_ctx->functions.count; i++) {
+        parse_function_body(nac_ctx->functions.items[i]);
+    }
+    return func;
+}
+
+static bool run_inline(int count) {
+    return count < 2 || thread_pool_size() < 2 || thread_pool_in_worker();
+}
+
+static void run_job(ParallelJob *job, int count) {
+    int chunks = thread_pool_size() * CHUNKS_PER_WORKER;
+    if (chunks > count) chunks = count;
+
+    job->source = nac_ctx;
+    job->count = count;
+    job->chunk_size = (count + chunks - 1) / chunks;
+    job->chunk_count = (count + job->chunk_size - 1) / job->chunk_size;
+    atomic_init(&job->next_chunk, 0);
+    atomic_init(&job->failed, false);
+    atomic_init(&job->errors, 0);
+    atomic_init(&job->has_message, false);
+    job->message[0] = '\0';
+
+    thread_pool_run(run_chunks, job);
+
+    int errors = atomic_load(&job->errors);
+    if (errors > 0) {
+        nac_ctx->error_occurred = true;
+        nac_ctx->error_count += errors;
+        snprintf(nac_ctx->last_error, sizeof(nac_ctx->last_error), "%s", job->message);
+    }
+}
+
+Value parallel_map(Value array, const char *func_name) {
+    Function *func = prepare(array, func_name, "parallelMap");
+    if (!func) return make_int(0);
+
+    int count = array.array_val.size;
+    Value out = make_array(count);
+    if (out.array_val.size < count) return out;
+
+    if (run_inline(count)) {
+        // Stops on errors raised by this call, not on earlier ones.
+        int errors = nac_ctx->error_count;
+        for (int i = 0; i < count && nac_ctx->error_count == errors; i++) {
+            Value item = array.array_val.elements[i];
+            out.array_val.elements[i] = apply(func, &item, 1);
+        }
+        return out;
+    }
+
+    ParallelJob job;
+    job.func_name = func->name;
+    job.items = array.array_val.elements;
+    job.results = out.array_val.elements;
+    job.partials = NULL;
+    run_job(&job, count);
+    return out;
+}
+
+// Chunks are reduced independently and then combined in order, so `fn` must
+// be associative; `initial` is folded in once, ahead of the first chunk.
+Value parallel_reduce(Value array, const char *func_name, Value initial) {
+    Function *func = prepare(array, func_name, "parallelReduce");
+    if (!func) return make_int(0);
+
+    int count = array.array_val.size;
+    Value acc = copy_value(initial);
+    int errors = nac_ctx->error_count;
+
+    if (run_inline(count)) {
+        for (int i = 0; i < count && nac_ctx->error_count == errors; i++) {
+            Value args[2] = { acc, array.array_val.elements[i] };
+            Value next = apply(func, args, 2);
+            free_value(&acc);
+            acc = next;
+        }
+        return acc;
+    }
+
+    ParallelJob job;
+    job.func_name = func->name;
+    job.items = array.array_val.elements;
+    job.results = NULL;
+    job.partials = (Value*)calloc(thread_pool_size() * CHUNKS_PER_WORKER, sizeof(Value));
+    for (int i = 0; i < thread_pool_size() * CHUNKS_PER_WORKER; i++) {
+        job.partials[i] = make_int(0);
+    }
+    run_job(&job, count);
+
+    for (int i = 0; i < job.chunk_count; i++) {
+        if (nac_ctx->error_count == errors) {
+            Value args[2] = { acc, job.partials[i] };
+            Value next = apply(func, args, 2);
+            free_value(&acc);
+            acc = next;
+        }
+        free_value(&job.partials[i]);
+    }
+    free(job.partials);
+    return acc;
+}
+
+// Called after thread_pool_shutdown(), once no worker uses its context.
+void parallel_shutdown(void) {
+    for (int i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        context_destroy(worker_states[i].ctx);
+        worker_states[i].ctx = NULL;
+    }
+}
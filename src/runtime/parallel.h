@@ -0,0 +1,10 @@
+#ifndef NAC_PARALLEL_H
+#define NAC_PARALLEL_H
+
+#include "value.h"
+
+Value parallel_map(Value array, const char *func_name);
+Value parallel_reduce(Value array, const char *func_name, Value initial);
+void parallel_shutdown(void);
+
+#endif
@@ -0,0 +1,334 @@
+#include "shared.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util/error.h"
+
+// Process-wide state that any context or thread can reach by handle. Maps
+// are striped: a key's hash picks one of SHARD_COUNT independently locked
+// tables, so workers aggregating different keys rarely meet.
+#define SHARD_COUNT 64
+#define MAX_SHARED_MAPS 4096
+#define COUNTER_BLOCK 1024
+#define MAX_COUNTER_BLOCKS 1024
+
+typedef struct {
+    char *key;
+    unsigned long hash;
+    Value value;
+} SharedEntry;
+
+typedef struct {
+    atomic_flag lock;
+    SharedEntry *entries;
+    int capacity;
+    int count;
+} Shard;
+
+typedef struct {
+    Shard shards[SHARD_COUNT];
+} SharedMap;
+
+static _Atomic(SharedMap*) maps[MAX_SHARED_MAPS];
+static atomic_int map_count = 0;
+
+static _Atomic(atomic_int*) counter_blocks[MAX_COUNTER_BLOCKS];
+static atomic_int counter_count = 0;
+
+static atomic_flag create_lock = ATOMIC_FLAG_INIT;
+
+static void spin_lock(atomic_flag *lock) {
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire)) {}
+}
+
+static void spin_unlock(atomic_flag *lock) {
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+static unsigned long key_hash(const char *s) {
+    unsigned long h = 1469598103UL;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619UL;
+    }
+    return h;
+}
+
+// Handles start at 1, so 0 (what a failed call returns) is never valid.
+static SharedMap *lookup_map(Value handle) {
+    SharedMap *map = NULL;
+    if (handle.type == TYPE_INT && handle.int_val > 0 && handle.int_val <= atomic_load(&map_count)) {
+        map = atomic_load_explicit(&maps[handle.int_val - 1], memory_order_acquire);
+    }
+    if (!map) {
+        report_error("Unknown shared map");
+    }
+    return map;
+}
+
+static atomic_int *lookup_counter(Value handle) {
+    if (handle.type == TYPE_INT && handle.int_val > 0 && handle.int_val <= atomic_load(&counter_count)) {
+        int index = handle.int_val - 1;
+        atomic_int *block = atomic_load_explicit(&counter_blocks[index / COUNTER_BLOCK], memory_order_acquire);
+        if (block) {
+            return &block[index % COUNTER_BLOCK];
+        }
+    }
+
+    report_error("Unknown counter");
+    return NULL;
+}
+
+static SharedEntry *shard_find(Shard *shard, const char *key, unsigned long hash) {
+    if (shard->capacity == 0) return NULL;
+
+    int mask = shard->capacity - 1;
+    int slot = (int)((hash / SHARD_COUNT) & (unsigned long)mask);
+    while (shard->entries[slot].key) {
+        SharedEntry *entry = &shard->entries[slot];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+static SharedEntry *shard_insert(Shard *shard, const char *key, unsigned long hash) {
+    if ((shard->count + 1) * 2 > shard->capacity) {
+        SharedEntry *old = shard->entries;
+        int old_capacity = shard->capacity;
+
+        shard->capacity = (old_capacity == 0) ? 16 : old_capacity * 2;
+        shard->entries = (SharedEntry*)calloc(shard->capacity, sizeof(SharedEntry));
+        int mask = shard->capacity - 1;
+        for (int i = 0; i < old_capacity; i++) {
+            if (!old[i].key) continue;
+            int slot = (int)((old[i].hash / SHARD_COUNT) & (unsigned long)mask);
+            while (shard->entries[slot].key) {
+                slot = (slot + 1) & mask;
+            }
+            shard->entries[slot] = old[i];
+        }
+        free(old);
+    }
+
+    int mask = shard->capacity - 1;
+    int slot = (int)((hash / SHARD_COUNT) & (unsigned long)mask);
+    while (shard->entries[slot].key) {
+        slot = (slot + 1) & mask;
+    }
+
+    SharedEntry *entry = &shard->entries[slot];
+    entry->key = strdup(key);
+    entry->hash = hash;
+    entry->value = make_int(0);
+    shard->count++;
+    return entry;
+}
+
+static Shard *pick_shard(SharedMap *map, Value key, char *buffer, unsigned long *hash) {
+    if (!map_key_from_value(key, buffer, MAX_STRING_LEN)) {
+        report_error("Map key must be int, float, or string");
+        return NULL;
+    }
+    *hash = key_hash(buffer);
+    return &map->shards[*hash % SHARD_COUNT];
+}
+
+Value shared_map_create(void) {
+    spin_lock(&create_lock);
+    int count = atomic_load(&map_count);
+    if (count >= MAX_SHARED_MAPS) {
+        spin_unlock(&create_lock);
+        report_error("Too many shared maps");
+        return make_int(0);
+    }
+
+    SharedMap *map = (SharedMap*)calloc(1, sizeof(SharedMap));
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        atomic_flag_clear(&map->shards[i].lock);
+    }
+    atomic_store_explicit(&maps[count], map, memory_order_release);
+    atomic_store(&map_count, count + 1);
+    spin_unlock(&create_lock);
+    return make_int(count + 1);
+}
+
+void shared_map_set(Value handle, Value key, Value value) {
+    SharedMap *map = lookup_map(handle);
+    if (!map) return;
+
+    char buffer[MAX_STRING_LEN];
+    unsigned long hash;
+    Shard *shard = pick_shard(map, key, buffer, &hash);
+    if (!shard) return;
+
+    // Copy and free outside the lock; only the swap happens inside.
+    Value owned = copy_value(value);
+    spin_lock(&shard->lock);
+    SharedEntry *entry = shard_find(shard, buffer, hash);
+    if (!entry) {
+        entry = shard_insert(shard, buffer, hash);
+    }
+    Value old = entry->value;
+    entry->value = owned;
+    spin_unlock(&shard->lock);
+    free_value(&old);
+}
+
+Value shared_map_get(Value handle, Value key, Value fallback) {
+    SharedMap *map = lookup_map(handle);
+    if (!map) return make_int(0);
+
+    char buffer[MAX_STRING_LEN];
+    unsigned long hash;
+    Shard *shard = pick_shard(map, key, buffer, &hash);
+    if (!shard) return make_int(0);
+
+    spin_lock(&shard->lock);
+    SharedEntry *entry = shard_find(shard, buffer, hash);
+    Value result = entry ? copy_value(entry->value) : copy_value(fallback);
+    spin_unlock(&shard->lock);
+    return result;
+}
+
+// Adds delta to the number stored under key (0 when missing) and returns
+// the new value, as one step.
+Value shared_map_add(Value handle, Value key, Value delta) {
+    SharedMap *map = lookup_map(handle);
+    if (!map) return make_int(0);
+    if (delta.type != TYPE_INT && delta.type != TYPE_FLOAT) {
+        report_error("sharedAdd() delta must be a number");
+        return make_int(0);
+    }
+
+    char buffer[MAX_STRING_LEN];
+    unsigned long hash;
+    Shard *shard = pick_shard(map, key, buffer, &hash);
+    if (!shard) return make_int(0);
+
+    spin_lock(&shard->lock);
+    SharedEntry *entry = shard_find(shard, buffer, hash);
+    if (!entry) {
+        entry = shard_insert(shard, buffer, hash);
+    }
+
+    Value *current = &entry->value;
+    bool numeric = current->type == TYPE_INT || current->type == TYPE_FLOAT;
+    if (numeric) {
+        if (current->type == TYPE_INT && delta.type == TYPE_INT) {
+            current->int_val += delta.int_val;
+        } else {
+            *current = make_float(to_float(*current) + to_float(delta));
+        }
+    }
+    Value result = *current;
+    spin_unlock(&shard->lock);
+
+    if (!numeric) {
+        report_error("sharedAdd() on a value that is not a number");
+        return make_int(0);
+    }
+    return result;
+}
+
+// A plain map with a copy of every entry. Shards are locked one at a time,
+// so concurrent writers may land on either side of the snapshot.
+Value shared_map_snapshot(Value handle) {
+    SharedMap *map = lookup_map(handle);
+    if (!map) return make_map();
+
+    Value result = make_map();
+    for (int s = 0; s < SHARD_COUNT; s++) {
+        Shard *shard = &map->shards[s];
+        spin_lock(&shard->lock);
+        int needed = result.map_val.size + shard->count;
+        // Past the memory quota the snapshot stops growing.
+        if (needed > result.map_val.capacity) {
+            char **keys = (char**)value_realloc(result.map_val.keys, sizeof(char*) * needed * 2);
+            if (keys) result.map_val.keys = keys;
+            Value *values = keys ? (Value*)value_realloc(result.map_val.values, sizeof(Value) * needed * 2) : NULL;
+            if (!values) {
+                spin_unlock(&shard->lock);
+                break;
+            }
+            result.map_val.values = values;
+            result.map_val.capacity = needed * 2;
+        }
+        for (int i = 0; i < shard->capacity; i++) {
+            SharedEntry *entry = &shard->entries[i];
+            if (!entry->key) continue;
+
+            size_t len = strlen(entry->key);
+            char *key = (char*)value_alloc(len + 1);
+            if (!key) break;
+            memcpy(key, entry->key, len + 1);
+            result.map_val.keys[result.map_val.size] = key;
+            result.map_val.values[result.map_val.size] = copy_value(entry->value);
+            result.map_val.size++;
+        }
+        spin_unlock(&shard->lock);
+    }
+    return result;
+}
+
+Value counter_create(Value initial) {
+    spin_lock(&create_lock);
+    int index = atomic_load(&counter_count);
+    if (index >= COUNTER_BLOCK * MAX_COUNTER_BLOCKS) {
+        spin_unlock(&create_lock);
+        report_error("Too many counters");
+        return make_int(0);
+    }
+
+    atomic_int *block = atomic_load(&counter_blocks[index / COUNTER_BLOCK]);
+    if (!block) {
+        block = (atomic_int*)calloc(COUNTER_BLOCK, sizeof(atomic_int));
+        atomic_store_explicit(&counter_blocks[index / COUNTER_BLOCK], block, memory_order_release);
+    }
+    atomic_store(&block[index % COUNTER_BLOCK], to_int(initial));
+    atomic_store(&counter_count, index + 1);
+    spin_unlock(&create_lock);
+    return make_int(index + 1);
+}
+
+Value counter_add(Value handle, int delta) {
+    atomic_int *counter = lookup_counter(handle);
+    if (!counter) return make_int(0);
+    return make_int(atomic_fetch_add_explicit(counter, delta, memory_order_relaxed) + delta);
+}
+
+Value counter_get(Value handle) {
+    atomic_int *counter = lookup_counter(handle);
+    if (!counter) return make_int(0);
+    return make_int(atomic_load_explicit(counter, memory_order_relaxed));
+}
+
+void shared_shutdown(void) {
+    int count = atomic_load(&map_count);
+    for (int m = 0; m < count; m++) {
+        SharedMap *map = atomic_load(&maps[m]);
+        for (int s = 0; s < SHARD_COUNT; s++) {
+            Shard *shard = &map->shards[s];
+            for (int i = 0; i < shard->capacity; i++) {
+                if (shard->entries[i].key) {
+                    free(shard->entries[i].key);
+                    free_value(&shard->entries[i].value);
+                }
+            }
+            free(shard->entries);
+        }
+        free(map);
+        atomic_store(&maps[m], NULL);
+    }
+    atomic_store(&map_count, 0);
+
+    for (int b = 0; b < MAX_COUNTER_BLOCKS; b++) {
+        free(atomic_load(&counter_blocks[b]));
+        atomic_store(&counter_blocks[b], NULL);
+    }
+    atomic_store(&counter_count, 0);
+}
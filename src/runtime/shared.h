@@ -0,0 +1,18 @@
+#ifndef NAC_SHARED_H
+#define NAC_SHARED_H
+
+#include "value.h"
+
+Value shared_map_create(void);
+void shared_map_set(Value handle, Value key, Value value);
+Value shared_map_get(Value handle, Value key, Value fallback);
+Value shared_map_add(Value handle, Value key, Value delta);
+Value shared_map_snapshot(Value handle);
+
+Value counter_create(Value initial);
+Value counter_add(Value handle, int delta);
+Value counter_get(Value handle);
+
+void shared_shutdown(void);
+
+#endif
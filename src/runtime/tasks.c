@@ -0,0 +1,314 @@
+#include "tasks.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/interpreter.h"
+#include "eval.h"
+#include "../util/error.h"
+#include "../util/thread_pool.h"
+
+enum { TASK_PENDING, TASK_RUNNING, TASK_DONE };
+
+// Immutable view of a context's functions and native extensions, published
+// when it spawns. Tasks sync their own contexts from it, so they never read
+// the owner's tables while the owner keeps running.
+typedef struct TaskExports {
+    unsigned long source_id;
+    int function_count;
+    Function **functions;
+    int native_count;
+    const NativeDef **natives;
+    struct TaskExports *older;
+} TaskExports;
+
+typedef struct {
+    PoolWork work;
+    TaskExports *exports;
+    char func_name[MAX_TOKEN_LEN];
+    Value *args;
+    int arg_count;
+    Value result;
+    atomic_int state;
+    atomic_int refs;
+    int error_count;
+    char error[512];
+} Task;
+
+// One context per (thread, owner). Nested tasks run on the same context as
+// the task that joined them, one call frame deeper.
+typedef struct TaskContext {
+    unsigned long source_id;
+    NacContext *ctx;
+    int synced;
+    struct TaskContext *next;
+    struct TaskContext *all_next;
+} TaskContext;
+
+static _Thread_local TaskContext *thread_contexts = NULL;
+static _Thread_local TaskExports *running_exports = NULL;
+static TaskContext *all_contexts = NULL;
+
+static Task **tasks = NULL;
+static int task_capacity = 0;
+static int next_task_id = 1;
+static atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+
+static void lock_registry(void) {
+    while (atomic_flag_test_and_set_explicit(&registry_lock, memory_order_acquire)) {}
+}
+
+static void unlock_registry(void) {
+    atomic_flag_clear_explicit(&registry_lock, memory_order_release);
+}
+
+static int count_extensions(const NativeTable *table) {
+    int n = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->slots[i] && table->slots[i]->kind == NATIVE_EXTENSION) n++;
+    }
+    return n;
+}
+
+static TaskExports *publish(NacContext *ctx) {
+    TaskExports *current = ctx->exports;
+    int natives = count_extensions(&ctx->natives);
+    if (current && current->function_count == ctx->functions.count && current->native_count == natives) {
+        return current;
+    }
+
+    // Bodies are parsed here, on the owner's thread, before anyone shares them.
+    for (int i = 0; i < ctx->functions.count; i++) {
+        parse_function_body(ctx->functions.items[i]);
+    }
+
+    TaskExports *exports = (TaskExports*)malloc(sizeof(TaskExports));
+    exports->source_id = ctx->id;
+    exports->function_count = ctx->functions.count;
+    exports->functions = (Function**)malloc(sizeof(Function*) * (ctx->functions.count + 1));
+    memcpy(exports->functions, ctx->functions.items, sizeof(Function*) * ctx->functions.count);
+    exports->native_count = 0;
+    exports->natives = (const NativeDef**)malloc(sizeof(NativeDef*) * (natives + 1));
+    for (int i = 0; i < ctx->natives.capacity; i++) {
+        const NativeDef *def = ctx->natives.slots[i];
+        if (def && def->kind == NATIVE_EXTENSION) {
+            exports->natives[exports->native_count++] = def;
+        }
+    }
+    exports->older = current;
+    ctx->exports = exports;
+    return exports;
+}
+
+void task_exports_free(NacContext *ctx) {
+    TaskExports *exports = ctx->exports;
+    while (exports) {
+        TaskExports *older = exports->older;
+        free(exports->functions);
+        free(exports->natives);
+        free(exports);
+        exports = older;
+    }
+    ctx->exports = NULL;
+}
+
+static NacContext *task_context(const TaskExports *exports) {
+    TaskContext *tc = thread_contexts;
+    while (tc && tc->source_id != exports->source_id) {
+        tc = tc->next;
+    }
+
+    if (!tc) {
+        tc = (TaskContext*)calloc(1, sizeof(TaskContext));
+        tc->source_id = exports->source_id;
+        tc->ctx = context_create();
+        tc->next = thread_contexts;
+        thread_contexts = tc;
+
+        lock_registry();
+        tc->all_next = all_contexts;
+        all_contexts = tc;
+        unlock_registry();
+    }
+
+    // Exports only ever grow, so only the newer definitions are copied.
+    for (; tc->synced < exports->function_count; tc->synced++) {
+        Function func = *exports->functions[tc->synced];
+        func.shared_body = true;
+        function_table_add(&tc->ctx->functions, &func);
+    }
+    for (int i = 0; i < exports->native_count; i++) {
+        native_table_add(&tc->ctx->natives, exports->natives[i]);
+    }
+    return tc->ctx;
+}
+
+static void task_release(Task *task) {
+    if (atomic_fetch_sub(&task->refs, 1) != 1) return;
+
+    for (int i = 0; i < task->arg_count; i++) {
+        free_value(&task->args[i]);
+    }
+    free(task->args);
+    free_value(&task->result);
+    free(task);
+}
+
+static bool task_claim(Task *task) {
+    int expected = TASK_PENDING;
+    return atomic_compare_exchange_strong(&task->state, &expected, TASK_RUNNING);
+}
+
+static void task_execute(Task *task) {
+    NacContext *ctx = task_context(task->exports);
+    NacContext *previous = context_enter(ctx);
+    TaskExports *outer_exports = running_exports;
+    running_exports = task->exports;
+
+    bool saved_error = ctx->error_occurred;
+    int saved_count = ctx->error_count;
+    ctx->error_count = 0;
+
+    Function *func = find_function(task->func_name);
+    if (func) {
+        task->result = call_function(func, task->args, task->arg_count);
+        ctx->return_value = make_int(0);
+    }
+    ctx->should_return = ctx->should_break = ctx->should_continue = false;
+
+    // Errors belong to whoever joins the task, not to the task's context.
+    task->error_count = ctx->error_count;
+    if (ctx->error_count > 0) {
+        snprintf(task->error, sizeof(task->error), "%s", ctx->last_error);
+    }
+    ctx->error_count = saved_count;
+    ctx->error_occurred = saved_error;
+    ctx->halted = false;
+
+    for (int i = 0; i < task->arg_count; i++) {
+        free_value(&task->args[i]);
+    }
+    task->arg_count = 0;
+
+    running_exports = outer_exports;
+    context_enter(previous);
+
+    atomic_store(&task->state, TASK_DONE);
+    thread_pool_notify();
+}
+
+static void run_queued(PoolWork *work) {
+    Task *task = (Task*)work;
+    if (task_claim(task)) {
+        task_execute(task);
+    }
+    task_release(task);
+}
+
+Value task_spawn(const char *func_name, Value *args, int arg_count) {
+    char msg[MAX_TOKEN_LEN + 64];
+    Function *func = find_function(func_name);
+    if (!func) {
+        snprintf(msg, sizeof(msg), "Undefined function: %s", func_name);
+        report_error(msg);
+        return make_int(0);
+    }
+    if (func->param_count != arg_count) {
+        snprintf(msg, sizeof(msg), "spawn(): %s() takes %d argument(s)", func_name, func->param_count);
+        report_error(msg);
+        return make_int(0);
+    }
+
+    // Inside a task, nac_ctx is the task's own context; spawn against the
+    // same owner instead of re-publishing the copy.
+    TaskExports *exports = running_exports ? running_exports : publish(nac_ctx);
+
+    Task *task = (Task*)calloc(1, sizeof(Task));
+    task->work.run = run_queued;
+    task->exports = exports;
+    strncpy(task->func_name, func_name, MAX_TOKEN_LEN - 1);
+    task->arg_count = arg_count;
+    task->args = (Value*)malloc(sizeof(Value) * (arg_count > 0 ? arg_count : 1));
+    for (int i = 0; i < arg_count; i++) {
+        task->args[i] = copy_value(args[i]);
+    }
+    task->result = make_int(0);
+    atomic_init(&task->state, TASK_PENDING);
+
+    // Unlike parallelMap, one pool thread is worth using: a task may be a
+    // pipeline stage that the spawning thread waits on through a channel.
+    atomic_init(&task->refs, 2);
+
+    lock_registry();
+    if (next_task_id >= task_capacity) {
+        task_capacity = (task_capacity == 0) ? 256 : task_capacity * 2;
+        tasks = (Task**)realloc(tasks, sizeof(Task*) * task_capacity);
+    }
+    int id = next_task_id++;
+    tasks[id] = task;
+    unlock_registry();
+
+    thread_pool_submit(&task->work);
+    return make_int(id);
+}
+
+// Joining runs the task inline when nobody has started it yet, and otherwise
+// helps with other queued tasks until it finishes.
+Value task_join(Value handle) {
+    Task *task = NULL;
+    if (handle.type == TYPE_INT) {
+        lock_registry();
+        if (handle.int_val > 0 && handle.int_val < next_task_id) {
+            task = tasks[handle.int_val];
+            tasks[handle.int_val] = NULL;
+        }
+        unlock_registry();
+    }
+    if (!task) {
+        report_error("joinTask(): unknown or already joined task");
+        return make_int(0);
+    }
+
+    if (task_claim(task)) {
+        task_execute(task);
+    } else {
+        thread_pool_wait_for(&task->state, TASK_DONE);
+    }
+
+    if (task->error_count > 0) {
+        nac_ctx->error_occurred = true;
+        nac_ctx->error_count += task->error_count;
+        snprintf(nac_ctx->last_error, sizeof(nac_ctx->last_error), "%s", task->error);
+    }
+
+    Value result = task->result;
+    task->result = make_int(0);
+    task_release(task);
+    return result;
+}
+
+// Runs after the pool has stopped, so nothing executes tasks any more.
+void tasks_shutdown(void) {
+    for (int i = 1; i < next_task_id; i++) {
+        if (tasks[i]) {
+            atomic_store(&tasks[i]->refs, 1);
+            task_release(tasks[i]);
+        }
+    }
+    free(tasks);
+    tasks = NULL;
+    task_capacity = 0;
+    next_task_id = 1;
+
+    TaskContext *tc = all_contexts;
+    while (tc) {
+        TaskContext *next = tc->all_next;
+        context_destroy(tc->ctx);
+        free(tc);
+        tc = next;
+    }
+    all_contexts = NULL;
+    thread_contexts = NULL;
+}
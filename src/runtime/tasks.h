@@ -0,0 +1,13 @@
+#ifndef NAC_TASKS_H
+#define NAC_TASKS_H
+
+#include "value.h"
+
+struct NacContext;
+
+Value task_spawn(const char *func_name, Value *args, int arg_count);
+Value task_join(Value handle);
+void task_exports_free(struct NacContext *ctx);
+void tasks_shutdown(void);
+
+#endif
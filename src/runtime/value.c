@@ -4,6 +4,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../util/memory.h"
+
+void *value_alloc(size_t size) {
+    return nac_alloc(memory_value_category(), size);
+}
+
+void *value_calloc(size_t count, size_t size) {
+    return nac_calloc(memory_value_category(), count, size);
+}
+
+void *value_realloc(void *ptr, size_t size) {
+    return nac_realloc(memory_value_category(), ptr, size);
+}
+
+void value_release(void *ptr) {
+    nac_free(ptr);
+}
+
 static int map_find_key(const Value *map, const char *key) {
     if (!map || map->type != TYPE_MAP) {
         return -1;
@@ -40,12 +58,18 @@ Value make_string(const char *s) {
     return val;
 }
 
+// Past the memory quota the value allocators return NULL; the value then
+// comes out empty, so callers fill arrays up to array_val.size, not to the
+// size they asked for.
 Value make_array(int size) {
     Value val;
     val.type = TYPE_ARRAY;
+    val.array_val.elements = (Value*)value_calloc(size, sizeof(Value));
+    if (!val.array_val.elements) {
+        size = 0;
+    }
     val.array_val.size = size;
     val.array_val.capacity = size;
-    val.array_val.elements = (Value*)calloc(size, sizeof(Value));
     for (int i = 0; i < size; i++) {
         val.array_val.elements[i] = make_int(0);
     }
@@ -138,8 +162,12 @@ Value copy_value(Value v) {
         new_val.type = TYPE_ARRAY;
         new_val.array_val.size = v.array_val.size;
         new_val.array_val.capacity = v.array_val.size;
-        new_val.array_val.elements = (Value*)malloc(sizeof(Value) * new_val.array_val.capacity);
-        for (int i = 0; i < v.array_val.size; i++) {
+        new_val.array_val.elements = (Value*)value_alloc(sizeof(Value) * new_val.array_val.capacity);
+        if (!new_val.array_val.elements) {
+            new_val.array_val.size = 0;
+            new_val.array_val.capacity = 0;
+        }
+        for (int i = 0; i < new_val.array_val.size; i++) {
             new_val.array_val.elements[i] = copy_value(v.array_val.elements[i]);
         }
         return new_val;
@@ -150,12 +178,21 @@ Value copy_value(Value v) {
         if (v.map_val.size > 0) {
             new_val.map_val.capacity = v.map_val.size;
             new_val.map_val.size = v.map_val.size;
-            new_val.map_val.keys = (char**)malloc(sizeof(char*) * new_val.map_val.capacity);
-            new_val.map_val.values = (Value*)malloc(sizeof(Value) * new_val.map_val.capacity);
+            new_val.map_val.keys = (char**)value_alloc(sizeof(char*) * new_val.map_val.capacity);
+            new_val.map_val.values = (Value*)value_alloc(sizeof(Value) * new_val.map_val.capacity);
+            if (!new_val.map_val.keys || !new_val.map_val.values) {
+                new_val.map_val.size = 0;
+                free_value(&new_val);
+                return new_val;
+            }
 
-            for (int i = 0; i < v.map_val.size; i++) {
+            for (int i = 0; i < new_val.map_val.size; i++) {
                 size_t len = strlen(v.map_val.keys[i]);
-                new_val.map_val.keys[i] = (char*)malloc(len + 1);
+                new_val.map_val.keys[i] = (char*)value_alloc(len + 1);
+                if (!new_val.map_val.keys[i]) {
+                    new_val.map_val.size = i;
+                    break;
+                }
                 memcpy(new_val.map_val.keys[i], v.map_val.keys[i], len + 1);
                 new_val.map_val.values[i] = copy_value(v.map_val.values[i]);
             }
@@ -171,7 +208,7 @@ void free_value(Value *v) {
         for (int i = 0; i < v->array_val.size; i++) {
             free_value(&v->array_val.elements[i]);
         }
-        free(v->array_val.elements);
+        value_release(v->array_val.elements);
         v->array_val.elements = NULL;
         v->array_val.size = 0;
         v->array_val.capacity = 0;
@@ -180,12 +217,12 @@ void free_value(Value *v) {
 
     if (v->type == TYPE_MAP) {
         for (int i = 0; i < v->map_val.size; i++) {
-            free(v->map_val.keys[i]);
+            value_release(v->map_val.keys[i]);
             free_value(&v->map_val.values[i]);
         }
 
-        free(v->map_val.keys);
-        free(v->map_val.values);
+        value_release(v->map_val.keys);
+        value_release(v->map_val.values);
 
         v->map_val.keys = NULL;
         v->map_val.values = NULL;
@@ -216,14 +253,40 @@ void map_set(Value *map, const char *key, Value value) {
 
     if (map->map_val.size >= map->map_val.capacity) {
         int new_capacity = (map->map_val.capacity == 0) ? 8 : map->map_val.capacity * 2;
-        map->map_val.keys = (char**)realloc(map->map_val.keys, sizeof(char*) * new_capacity);
-        map->map_val.values = (Value*)realloc(map->map_val.values, sizeof(Value) * new_capacity);
+        char **keys = (char**)value_realloc(map->map_val.keys, sizeof(char*) * new_capacity);
+        if (!keys) return;
+        map->map_val.keys = keys;
+        Value *values = (Value*)value_realloc(map->map_val.values, sizeof(Value) * new_capacity);
+        if (!values) return;
+        map->map_val.values = values;
         map->map_val.capacity = new_capacity;
     }
 
     size_t len = strlen(key);
-    map->map_val.keys[map->map_val.size] = (char*)malloc(len + 1);
+    char *stored = (char*)value_alloc(len + 1);
+    if (!stored) return;
+    map->map_val.keys[map->map_val.size] = stored;
     memcpy(map->map_val.keys[map->map_val.size], key, len + 1);
     map->map_val.values[map->map_val.size] = copy_value(value);
     map->map_val.size++;
 }
+
+int map_key_from_value(Value key_val, char *buffer, size_t buffer_size) {
+    if (key_val.type == TYPE_STRING) {
+        strncpy(buffer, key_val.str_val, buffer_size - 1);
+        buffer[buffer_size - 1] = '\0';
+        return 1;
+    }
+
+    if (key_val.type == TYPE_INT) {
+        snprintf(buffer, buffer_size, "%d", key_val.int_val);
+        return 1;
+    }
+
+    if (key_val.type == TYPE_FLOAT) {
+        snprintf(buffer, buffer_size, "%g", key_val.float_val);
+        return 1;
+    }
+
+    return 0;
+}
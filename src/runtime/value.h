@@ -1,6 +1,8 @@
 #ifndef NAC_VALUE_H
 #define NAC_VALUE_H
 
+#include <stddef.h>
+
 #include "../lexer/token.h"
 
 #define MAX_ARRAY_SIZE 10000
@@ -47,7 +49,13 @@ void print_value(Value v);
 Value copy_value(Value v);
 void free_value(Value *v);
 
+void *value_alloc(size_t size);
+void *value_calloc(size_t count, size_t size);
+void *value_realloc(void *ptr, size_t size);
+void value_release(void *ptr);
+
 Value *map_get(Value *map, const char *key);
 void map_set(Value *map, const char *key, Value value);
+int map_key_from_value(Value key_val, char *buffer, size_t buffer_size);
 
 #endif
@@ -0,0 +1,131 @@
+#include "value_io.h"
+
+#include <string.h>
+
+#define VALUE_MAX_DEPTH 64
+
+void value_write(ByteBuf *buf, Value value) {
+    bytebuf_put_u8(buf, (unsigned char)value.type);
+
+    switch (value.type) {
+        case TYPE_INT:
+            bytebuf_put_int(buf, value.int_val);
+            break;
+        case TYPE_FLOAT:
+            bytebuf_put_double(buf, value.float_val);
+            break;
+        case TYPE_STRING:
+            bytebuf_put_str(buf, value.str_val);
+            break;
+        case TYPE_ARRAY:
+            bytebuf_put_varint(buf, (uint64_t)value.array_val.size);
+            for (int i = 0; i < value.array_val.size; i++) {
+                value_write(buf, value.array_val.elements[i]);
+            }
+            break;
+        case TYPE_MAP:
+            bytebuf_put_varint(buf, (uint64_t)value.map_val.size);
+            for (int i = 0; i < value.map_val.size; i++) {
+                bytebuf_put_str(buf, value.map_val.keys[i]);
+                value_write(buf, value.map_val.values[i]);
+            }
+            break;
+    }
+}
+
+static bool read_value(ByteReader *r, Value *out, int depth) {
+    *out = make_int(0);
+    if (depth > VALUE_MAX_DEPTH) {
+        r->failed = true;
+        return false;
+    }
+
+    unsigned char type = reader_u8(r);
+    if (r->failed) return false;
+
+    switch (type) {
+        case TYPE_INT:
+            *out = make_int((int)reader_int(r));
+            break;
+
+        case TYPE_FLOAT:
+            *out = make_float(reader_double(r));
+            break;
+
+        case TYPE_STRING: {
+            char s[MAX_STRING_LEN];
+            reader_str(r, s, sizeof(s));
+            *out = make_string(s);
+            break;
+        }
+
+        case TYPE_ARRAY: {
+            uint64_t n = reader_varint(r);
+            if (n > MAX_ARRAY_SIZE || n > r->len - r->pos) {
+                r->failed = true;
+                return false;
+            }
+
+            *out = make_array((int)n);
+            if ((uint64_t)out->array_val.size < n) {
+                r->failed = true;
+                return false;
+            }
+            for (uint64_t i = 0; i < n && !r->failed; i++) {
+                read_value(r, &out->array_val.elements[i], depth + 1);
+            }
+            break;
+        }
+
+        case TYPE_MAP: {
+            uint64_t n = reader_varint(r);
+            if (n > r->len - r->pos) {
+                r->failed = true;
+                return false;
+            }
+
+            *out = make_map();
+            if (n == 0) break;
+
+            out->map_val.keys = (char**)value_alloc(sizeof(char*) * n);
+            out->map_val.values = (Value*)value_alloc(sizeof(Value) * n);
+            out->map_val.capacity = (int)n;
+            if (!out->map_val.keys || !out->map_val.values) {
+                r->failed = true;
+                return false;
+            }
+
+            for (uint64_t i = 0; i < n && !r->failed; i++) {
+                char key[MAX_STRING_LEN];
+                reader_str(r, key, sizeof(key));
+                size_t len = strlen(key);
+                char *stored = (char*)value_alloc(len + 1);
+                if (!stored) {
+                    r->failed = true;
+                    break;
+                }
+                memcpy(stored, key, len + 1);
+
+                int idx = out->map_val.size++;
+                out->map_val.keys[idx] = stored;
+                read_value(r, &out->map_val.values[idx], depth + 1);
+            }
+            break;
+        }
+
+        default:
+            r->failed = true;
+            return false;
+    }
+
+    return !r->failed;
+}
+
+bool value_read(ByteReader *r, Value *out) {
+    if (!read_value(r, out, 0)) {
+        free_value(out);
+        *out = make_int(0);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,12 @@
+#ifndef NAC_VALUE_IO_H
+#define NAC_VALUE_IO_H
+
+#include <stdbool.h>
+
+#include "../util/bytebuf.h"
+#include "value.h"
+
+void value_write(ByteBuf *buf, Value value);
+bool value_read(ByteReader *r, Value *out);
+
+#endif
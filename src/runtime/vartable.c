@@ -1,9 +1,11 @@
 #include "vartable.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../core/interpreter.h"
+#include "../util/memory.h"
 
 unsigned int hash(const char *str) {
     unsigned int hash_value = 5381;
@@ -15,7 +17,7 @@ unsigned int hash(const char *str) {
 }
 
 VarTable *create_var_table(void) {
-    VarTable *table = (VarTable*)calloc(1, sizeof(VarTable));
+    VarTable *table = (VarTable*)nac_calloc_always(memory_value_category(), sizeof(VarTable));
     return table;
 }
 
@@ -25,40 +27,79 @@ void free_var_table(VarTable *table) {
         while (entry) {
             VarEntry *next = entry->next;
             free_value(&entry->value);
-            free(entry);
+            value_release(entry);
             entry = next;
         }
     }
-    free(table);
+    value_release(table);
 }
 
-Value *get_var(const char *name) {
-    if (call_depth > 0) {
-        VarTable *local = call_stack_vars[call_depth - 1];
-        unsigned int idx = hash(name);
-        VarEntry *entry = local->buckets[idx];
-        while (entry) {
-            if (strcmp(entry->name, name) == 0) {
-                return &entry->value;
-            }
-            entry = entry->next;
-        }
-    }
-
-    unsigned int idx = hash(name);
-    VarEntry *entry = global_vars->buckets[idx];
+static Value *table_lookup(VarTable *table, const char *name) {
+    VarEntry *entry = table->buckets[hash(name)];
     while (entry) {
         if (strcmp(entry->name, name) == 0) {
             return &entry->value;
         }
         entry = entry->next;
     }
-
     return NULL;
 }
 
+// Code of an imported module (its top level and its functions) keeps its
+// globals under `alias.name`, so they never collide with the importer's and
+// are reachable from outside only through the alias.
+static const char *global_name(const char *name, char *buf, size_t size) {
+    if (nac_ctx->scope_len == 0 || strchr(name, '.')) {
+        return name;
+    }
+    snprintf(buf, size, "%.*s.%s", nac_ctx->scope_len, nac_ctx->scope, name);
+    return buf;
+}
+
+Value *get_var(const char *name) {
+    Value *found = NULL;
+    if (nac_ctx->call_depth > 0) {
+        found = table_lookup(nac_ctx->call_stack_vars[nac_ctx->call_depth - 1], name);
+    }
+    if (found) {
+        return found;
+    }
+
+    char qualified[MAX_TOKEN_LEN * 2];
+    name = global_name(name, qualified, sizeof(qualified));
+    found = table_lookup(nac_ctx->global_vars, name);
+    if (!found && nac_ctx->shared_globals) {
+        found = table_lookup(nac_ctx->shared_globals, name);
+    }
+    return found;
+}
+
+// For in-place updates: a shared global is copied into this context's own
+// globals first, so the owner's value is never written.
+Value *get_var_for_update(const char *name) {
+    Value *found = get_var(name);
+    char qualified[MAX_TOKEN_LEN * 2];
+    name = global_name(name, qualified, sizeof(qualified));
+    if (!found || !nac_ctx->shared_globals || found != table_lookup(nac_ctx->shared_globals, name)) {
+        return found;
+    }
+
+    VarEntry *entry = (VarEntry*)nac_calloc_always(memory_value_category(), sizeof(VarEntry));
+    unsigned int idx = hash(name);
+    strncpy(entry->name, name, MAX_TOKEN_LEN - 1);
+    entry->name[MAX_TOKEN_LEN - 1] = '\0';
+    entry->value = copy_value(*found);
+    entry->next = nac_ctx->global_vars->buckets[idx];
+    nac_ctx->global_vars->buckets[idx] = entry;
+    return &entry->value;
+}
+
 void set_var(const char *name, Value value) {
-    VarTable *table = (call_depth > 0) ? call_stack_vars[call_depth - 1] : global_vars;
+    VarTable *table = (nac_ctx->call_depth > 0) ? nac_ctx->call_stack_vars[nac_ctx->call_depth - 1] : nac_ctx->global_vars;
+    char qualified[MAX_TOKEN_LEN * 2];
+    if (nac_ctx->call_depth == 0) {
+        name = global_name(name, qualified, sizeof(qualified));
+    }
     unsigned int idx = hash(name);
 
     VarEntry *entry = table->buckets[idx];
@@ -71,7 +112,7 @@ void set_var(const char *name, Value value) {
         entry = entry->next;
     }
 
-    VarEntry *new_entry = (VarEntry*)malloc(sizeof(VarEntry));
+    VarEntry *new_entry = (VarEntry*)nac_calloc_always(memory_value_category(), sizeof(VarEntry));
     strncpy(new_entry->name, name, MAX_TOKEN_LEN - 1);
     new_entry->name[MAX_TOKEN_LEN - 1] = '\0';
     new_entry->value = copy_value(value);
@@ -20,6 +20,7 @@ unsigned int hash(const char *str);
 VarTable *create_var_table(void);
 void free_var_table(VarTable *table);
 Value *get_var(const char *name);
+Value *get_var_for_update(const char *name);
 void set_var(const char *name, Value value);
 
 #endif
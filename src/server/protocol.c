@@ -0,0 +1,79 @@
+#define _GNU_SOURCE
+
+#include "protocol.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+
+bool serve_default_socket(char *buf, size_t size, bool create) {
+    (void)buf;
+    (void)size;
+    (void)create;
+    return false;
+}
+
+bool serve_peer_trusted(int fd) {
+    (void)fd;
+    return false;
+}
+
+#else
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// $XDG_RUNTIME_DIR is private to the user already. Otherwise the socket
+// goes in /tmp/nac-<uid>, which must be a directory owned by this user that
+// nobody else can enter, or anyone could put their own socket there first.
+bool serve_default_socket(char *buf, size_t size, bool create) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && runtime[0] == '/') {
+        int n = snprintf(buf, size, "%s/nac.sock", runtime);
+        return n > 0 && (size_t)n < size;
+    }
+
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/nac-%u", (unsigned)getuid());
+    if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    struct stat st;
+    if (lstat(dir, &st) == 0) {
+        if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0) {
+            fprintf(stderr, "nac: %s is not a private directory of this user\n", dir);
+            return false;
+        }
+    } else if (create) {
+        return false;
+    }
+
+    int n = snprintf(buf, size, "%s/nac.sock", dir);
+    return n > 0 && (size_t)n < size;
+}
+
+// Client and daemon each make sure the other end runs as the same user.
+bool serve_peer_trusted(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        return false;
+    }
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) {
+        return false;
+    }
+    return uid == getuid();
+#endif
+}
+
+#endif
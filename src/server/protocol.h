@@ -0,0 +1,30 @@
+#ifndef NAC_SERVER_PROTOCOL_H
+#define NAC_SERVER_PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared by `nac --serve` and the nac-client binary.
+//
+// Request:  RequestHeader sent with the client's stdin/stdout/stderr attached
+//           as SCM_RIGHTS, followed by `payload_len` bytes holding the
+//           client's working directory and then argv (script first), each
+//           NUL-terminated.
+// Response: one int32 exit status once the script has finished.
+
+#define NAC_SERVE_MAGIC 0x5243414EU /* "NACR" */
+#define NAC_SERVE_PATH_MAX 256
+#define NAC_SERVE_MAX_PAYLOAD (1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t payload_len;
+} RequestHeader;
+
+// Writes the default socket path into buf. With create, makes the private
+// /tmp directory it lives in when there is no $XDG_RUNTIME_DIR.
+bool serve_default_socket(char *buf, size_t size, bool create);
+bool serve_peer_trusted(int fd);
+
+#endif
@@ -0,0 +1,604 @@
+#include "server.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+
+int serve_forever(const char *socket_path, int workers) {
+    (void)socket_path;
+    (void)workers;
+    fprintf(stderr, "--serve is not supported on Windows\n");
+    return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "../core/interpreter.h"
+#include "../io/io.h"
+#include "../module/source_module.h"
+
+typedef struct {
+    char *path;
+    time_t mtime;
+    off_t size;
+    ino_t inode;
+    Program program;
+} WarmProgram;
+
+typedef struct {
+    pid_t pid;
+    int conn;
+} Worker;
+
+typedef struct {
+    int fds[3];
+    char *payload;
+    const char *cwd;
+    char **argv;
+    int argc;
+} Request;
+
+// A connection whose request is still arriving, or complete and waiting
+// for a free worker.
+typedef struct {
+    int conn;
+    long long deadline;
+    int fds[3];
+    int fd_count;
+    RequestHeader header;
+    size_t received;
+    char *payload;
+    bool complete;
+} Pending;
+
+static WarmProgram *warm = NULL;
+static int warm_count = 0;
+static int warm_capacity = 0;
+
+static Worker *workers = NULL;
+static int worker_count = 0;
+static int worker_limit = SERVE_DEFAULT_WORKERS;
+
+static Pending pending[SERVE_MAX_PENDING];
+static int pending_count = 0;
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};
+static volatile sig_atomic_t stop_requested = 0;
+
+static void wake(void) {
+    int saved = errno;
+    ssize_t ignored = write(wake_pipe[1], "x", 1);
+    (void)ignored;
+    errno = saved;
+}
+
+static void on_child_exit(int sig) {
+    (void)sig;
+    wake();
+}
+
+static void on_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    wake();
+}
+
+static void set_cloexec(int fd) {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+    const char *p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void send_status(int conn, int status) {
+    int32_t code = status;
+    write_full(conn, &code, sizeof(code));
+}
+
+// Requests are read without blocking from the accept loop, so a client that
+// is slow to send (or never does) only delays itself.
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void set_nonblocking(int fd, bool on) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+}
+
+static void pending_add(int conn) {
+    Pending *p = &pending[pending_count++];
+    memset(p, 0, sizeof(*p));
+    p->conn = conn;
+    p->deadline = now_ms() + SERVE_REQUEST_TIMEOUT_MS;
+}
+
+static void pending_drop(int index) {
+    Pending *p = &pending[index];
+    close(p->conn);
+    for (int i = 0; i < p->fd_count; i++) close(p->fds[i]);
+    free(p->payload);
+    pending[index] = pending[--pending_count];
+}
+
+// The client's stdio arrives with the header as SCM_RIGHTS.
+static void take_fds(Pending *p, struct msghdr *msg) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int fds[3 * 2];
+        if (count > 3 * 2) count = 3 * 2;
+        memcpy(fds, CMSG_DATA(c), sizeof(int) * count);
+        for (int i = 0; i < count; i++) {
+            if (p->fd_count < 3) {
+                set_cloexec(fds[i]);
+                p->fds[p->fd_count++] = fds[i];
+            } else {
+                close(fds[i]);
+            }
+        }
+    }
+}
+
+// Reads what has arrived of the header, then the argument payload.
+// Returns 1 once the request is complete, 0 if more is to come and -1 if
+// the connection failed or sent something invalid.
+static int receive_step(Pending *p) {
+    for (;;) {
+        ssize_t n;
+        if (p->received < sizeof(p->header)) {
+            char control[CMSG_SPACE(sizeof(int) * 3 * 2)];
+            struct iovec iov = { (char*)&p->header + p->received, sizeof(p->header) - p->received };
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            n = recvmsg(p->conn, &msg, 0);
+            if (n > 0) take_fds(p, &msg);
+        } else {
+            size_t offset = p->received - sizeof(p->header);
+            n = read(p->conn, p->payload + offset, p->header.payload_len - offset);
+        }
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        p->received += (size_t)n;
+
+        if (p->received == sizeof(p->header)) {
+            if (p->fd_count != 3 || p->header.magic != NAC_SERVE_MAGIC || p->header.payload_len == 0 ||
+                p->header.payload_len > NAC_SERVE_MAX_PAYLOAD) {
+                return -1;
+            }
+            p->payload = (char*)malloc(p->header.payload_len + 1);
+        }
+        if (p->payload && p->received == sizeof(p->header) + p->header.payload_len) {
+            p->payload[p->header.payload_len] = '\0';
+            return 1;
+        }
+    }
+}
+
+// Takes the completed request out of the pending entry.
+static bool parse_request(Pending *p, Request *req) {
+    memcpy(req->fds, p->fds, sizeof(req->fds));
+    req->payload = p->payload;
+    p->fd_count = 0;
+    p->payload = NULL;
+
+    // cwd\0arg0\0arg1\0...
+    size_t len = p->header.payload_len;
+    char *end = req->payload + len;
+    req->cwd = req->payload;
+    char *arg = req->payload + strlen(req->payload) + 1;
+    req->argv = (char**)malloc(sizeof(char*) * (len + 1));
+    req->argc = 0;
+    while (arg < end) {
+        req->argv[req->argc++] = arg;
+        arg += strlen(arg) + 1;
+    }
+    req->argv[req->argc] = NULL;
+    return req->argc > 0;
+}
+
+static void free_request(Request *req) {
+    for (int i = 0; i < 3; i++) close(req->fds[i]);
+    free(req->payload);
+    free(req->argv);
+}
+
+// Compile errors go to the client's stderr, not the daemon's.
+static bool compile_warm(WarmProgram *entry, int err_fd) {
+    char *source = try_read_file(entry->path);
+    if (!source) {
+        dprintf(err_fd, "Cannot open file: %s\n", entry->path);
+        return false;
+    }
+
+    fflush(stderr);
+    int saved_err = dup(2);
+    dup2(err_fd, 2);
+
+    // The entry's path may be freed below, so the name is not kept past the compile.
+    const char *saved_name = nac_ctx->script_name;
+    set_script_name(entry->path);
+    set_source_code(source);
+    program_init(&entry->program);
+    bool ok = compile_program(&entry->program);
+    if (!ok) {
+        fprintf(stderr, "\nCompilation failed with %d error(s).\n", nac_ctx->error_count);
+        program_free(&entry->program);
+    }
+
+    fflush(stderr);
+    dup2(saved_err, 2);
+    close(saved_err);
+
+    set_script_name(saved_name);
+    free(nac_ctx->code);
+    nac_ctx->code = NULL;
+    nac_ctx->code_len = 0;
+    nac_ctx->error_occurred = false;
+    nac_ctx->error_count = 0;
+    nac_ctx->halted = false;
+    return ok;
+}
+
+static WarmProgram *find_program(const char *path, int err_fd) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        dprintf(err_fd, "Cannot open file: %s\n", path);
+        return NULL;
+    }
+
+    WarmProgram *entry = NULL;
+    for (int i = 0; i < warm_count; i++) {
+        if (strcmp(warm[i].path, path) == 0) {
+            entry = &warm[i];
+            break;
+        }
+    }
+
+    if (entry && entry->mtime == st.st_mtime && entry->size == st.st_size && entry->inode == st.st_ino) {
+        return entry;
+    }
+
+    if (entry) {
+        program_free(&entry->program);
+    } else {
+        if (warm_count >= warm_capacity) {
+            warm_capacity = (warm_capacity == 0) ? 16 : warm_capacity * 2;
+            warm = (WarmProgram*)realloc(warm, sizeof(WarmProgram) * warm_capacity);
+        }
+        entry = &warm[warm_count++];
+        entry->path = strdup(path);
+    }
+
+    entry->mtime = st.st_mtime;
+    entry->size = st.st_size;
+    entry->inode = st.st_ino;
+
+    if (!compile_warm(entry, err_fd)) {
+        // Drop the entry so the next request retries the compile.
+        free(entry->path);
+        *entry = warm[--warm_count];
+        return NULL;
+    }
+    return entry;
+}
+
+static void run_worker(Request *req, WarmProgram *entry, int conn) {
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    close(listen_fd);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(conn);
+    for (int i = 0; i < worker_count; i++) {
+        close(workers[i].conn);
+    }
+    for (int i = 0; i < pending_count; i++) {
+        close(pending[i].conn);
+        for (int j = 0; j < pending[i].fd_count; j++) close(pending[i].fds[j]);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        dup2(req->fds[i], i);
+    }
+    for (int i = 0; i < 3; i++) {
+        if (req->fds[i] > 2) close(req->fds[i]);
+    }
+
+    if (chdir(req->cwd) != 0) {
+        fprintf(stderr, "Cannot change directory to %s\n", req->cwd);
+    }
+
+    set_script_name(entry->path);
+    set_script_args(req->argc - 1, req->argv + 1);
+    int exit_code = run_program(&entry->program);
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(exit_code);
+}
+
+static void start_request(int index) {
+    Pending *p = &pending[index];
+    int conn = p->conn;
+    Request req;
+    memset(&req, 0, sizeof(req));
+    bool ok = parse_request(p, &req);
+    pending[index] = pending[--pending_count];
+
+    if (!ok) {
+        close(conn);
+        free_request(&req);
+        return;
+    }
+    set_nonblocking(conn, false);
+
+    char joined[PATH_MAX * 2];
+    const char *script = req.argv[0];
+    bool too_long = false;
+    if (script[0] != '/') {
+        int n = snprintf(joined, sizeof(joined), "%s/%s", req.cwd, script);
+        too_long = n < 0 || (size_t)n >= sizeof(joined);
+        script = joined;
+    }
+
+    char resolved[PATH_MAX];
+    WarmProgram *entry = NULL;
+    if (too_long) {
+        dprintf(req.fds[2], "Script path too long: %s\n", req.argv[0]);
+    } else if (!realpath(script, resolved)) {
+        dprintf(req.fds[2], "Cannot open file: %s\n", req.argv[0]);
+    } else {
+        entry = find_program(resolved, req.fds[2]);
+    }
+
+    if (!entry) {
+        send_status(conn, 1);
+        close(conn);
+        free_request(&req);
+        return;
+    }
+
+    // Workers inherit the compiled import graph; a broken module is reported
+    // again by the worker that imports it.
+    source_module_preload(&entry->program);
+    nac_ctx->error_occurred = false;
+    nac_ctx->error_count = 0;
+    nac_ctx->halted = false;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_worker(&req, entry, conn);
+    }
+
+    if (pid < 0) {
+        dprintf(req.fds[2], "nac --serve: fork failed: %s\n", strerror(errno));
+        send_status(conn, 1);
+        close(conn);
+    } else {
+        workers[worker_count].pid = pid;
+        workers[worker_count].conn = conn;
+        worker_count++;
+    }
+    free_request(&req);
+}
+
+static void reap_workers(int options) {
+    int status;
+    pid_t pid;
+    while (worker_count > 0 && (pid = waitpid(-1, &status, options)) > 0) {
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        for (int i = 0; i < worker_count; i++) {
+            if (workers[i].pid == pid) {
+                send_status(workers[i].conn, code);
+                close(workers[i].conn);
+                workers[i] = workers[--worker_count];
+                break;
+            }
+        }
+    }
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // Refuse to steal the socket from a daemon that is still answering.
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "Another nac server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    // Only the owning user may hand scripts to the daemon.
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    set_cloexec(fd);
+    return fd;
+}
+
+int serve_forever(const char *socket_path, int max_workers) {
+    worker_limit = (max_workers > 0) ? max_workers : SERVE_DEFAULT_WORKERS;
+
+    listen_fd = open_socket(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    if (pipe(wake_pipe) != 0) {
+        perror("pipe");
+        close(listen_fd);
+        return 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+        set_cloexec(wake_pipe[i]);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = on_child_exit;
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    sa.sa_handler = on_stop;
+    sa.sa_flags = 0;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Decode snapshot-restored bodies once here instead of in every worker.
+    for (int i = 0; i < nac_ctx->functions.count; i++) {
+        parse_function_body(nac_ctx->functions.items[i]);
+    }
+
+    workers = (Worker*)malloc(sizeof(Worker) * worker_limit);
+    fprintf(stderr, "nac: serving on %s (%d workers)\n", socket_path, worker_limit);
+
+    while (!stop_requested) {
+        for (int i = pending_count - 1; i >= 0 && worker_count < worker_limit; i--) {
+            if (pending[i].complete) start_request(i);
+        }
+
+        struct pollfd pfds[2 + SERVE_MAX_PENDING];
+        int polled[SERVE_MAX_PENDING];
+        int polled_count = 0;
+        pfds[0].fd = wake_pipe[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = listen_fd;
+        pfds[1].events = (pending_count < SERVE_MAX_PENDING) ? POLLIN : 0;
+
+        long long now = now_ms();
+        int timeout = -1;
+        for (int i = 0; i < pending_count; i++) {
+            if (pending[i].complete) continue;
+            pfds[2 + polled_count].fd = pending[i].conn;
+            pfds[2 + polled_count].events = POLLIN;
+            polled[polled_count++] = i;
+            long long left = pending[i].deadline - now;
+            if (left < 0) left = 0;
+            if (timeout < 0 || left < timeout) timeout = (int)left;
+        }
+
+        if (poll(pfds, 2 + polled_count, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        }
+        reap_workers(WNOHANG);
+
+        // Highest index first, so dropping an entry never moves one still to visit.
+        now = now_ms();
+        for (int j = polled_count - 1; j >= 0; j--) {
+            int i = polled[j];
+            int state = pfds[2 + j].revents ? receive_step(&pending[i]) : 0;
+            if (state > 0) {
+                pending[i].complete = true;
+            } else if (state < 0 || now >= pending[i].deadline) {
+                pending_drop(i);
+            }
+        }
+
+        if ((pfds[1].revents & POLLIN) && !stop_requested) {
+            int conn = accept(listen_fd, NULL, NULL);
+            // Only the owning user's clients are served, whatever the socket mode.
+            if (conn >= 0 && !serve_peer_trusted(conn)) {
+                close(conn);
+            } else if (conn >= 0) {
+                set_cloexec(conn);
+                set_nonblocking(conn, true);
+                pending_add(conn);
+                int state = receive_step(&pending[pending_count - 1]);
+                if (state > 0) {
+                    pending[pending_count - 1].complete = true;
+                } else if (state < 0) {
+                    pending_drop(pending_count - 1);
+                }
+            }
+        }
+    }
+
+    while (pending_count > 0) {
+        pending_drop(pending_count - 1);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    reap_workers(0);
+
+    for (int i = 0; i < warm_count; i++) {
+        program_free(&warm[i].program);
+        free(warm[i].path);
+    }
+    free(warm);
+    free(workers);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef NAC_SERVER_H
+#define NAC_SERVER_H
+
+#define SERVE_DEFAULT_WORKERS 8
+#define SERVE_MAX_PENDING 64
+#define SERVE_REQUEST_TIMEOUT_MS 5000
+
+int serve_forever(const char *socket_path, int workers);
+
+#endif
@@ -0,0 +1,153 @@
+#include "bytebuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void bytebuf_init(ByteBuf *buf) {
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+void bytebuf_free(ByteBuf *buf) {
+    free(buf->data);
+    bytebuf_init(buf);
+}
+
+void bytebuf_put(ByteBuf *buf, const void *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t new_cap = (buf->cap == 0) ? 4096 : buf->cap;
+        while (buf->len + len > new_cap) {
+            new_cap *= 2;
+        }
+        buf->data = (unsigned char*)realloc(buf->data, new_cap);
+        buf->cap = new_cap;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+void bytebuf_put_u8(ByteBuf *buf, unsigned char v) {
+    bytebuf_put(buf, &v, 1);
+}
+
+void bytebuf_put_u64(ByteBuf *buf, uint64_t v) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (unsigned char)(v >> (8 * i));
+    }
+    bytebuf_put(buf, bytes, 8);
+}
+
+void bytebuf_put_varint(ByteBuf *buf, uint64_t v) {
+    unsigned char bytes[10];
+    int n = 0;
+    do {
+        unsigned char b = v & 0x7F;
+        v >>= 7;
+        bytes[n++] = b | (v ? 0x80 : 0);
+    } while (v);
+    bytebuf_put(buf, bytes, n);
+}
+
+void bytebuf_put_int(ByteBuf *buf, int64_t v) {
+    bytebuf_put_varint(buf, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+void bytebuf_put_double(ByteBuf *buf, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bytebuf_put_u64(buf, bits);
+}
+
+void bytebuf_put_str(ByteBuf *buf, const char *s) {
+    size_t len = strlen(s);
+    bytebuf_put_varint(buf, len);
+    bytebuf_put(buf, s, len);
+}
+
+void reader_init(ByteReader *r, const void *data, size_t len) {
+    r->data = (const unsigned char*)data;
+    r->len = len;
+    r->pos = 0;
+    r->failed = false;
+}
+
+const void *reader_take(ByteReader *r, size_t len) {
+    if (r->failed || len > r->len - r->pos) {
+        r->failed = true;
+        return NULL;
+    }
+
+    const void *p = r->data + r->pos;
+    r->pos += len;
+    return p;
+}
+
+unsigned char reader_u8(ByteReader *r) {
+    const unsigned char *p = (const unsigned char*)reader_take(r, 1);
+    return p ? *p : 0;
+}
+
+uint64_t reader_u64(ByteReader *r) {
+    const unsigned char *p = (const unsigned char*)reader_take(r, 8);
+    if (!p) return 0;
+
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+uint64_t reader_varint(ByteReader *r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char b = reader_u8(r);
+        if (r->failed) return 0;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+
+    r->failed = true;
+    return 0;
+}
+
+int64_t reader_int(ByteReader *r) {
+    uint64_t z = reader_varint(r);
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+double reader_double(ByteReader *r) {
+    uint64_t bits = reader_u64(r);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+bool reader_str(ByteReader *r, char *out, size_t out_size) {
+    uint64_t len = reader_varint(r);
+    if (len >= out_size) {
+        r->failed = true;
+    }
+
+    const char *p = (const char*)reader_take(r, (size_t)len);
+    if (!p) {
+        out[0] = '\0';
+        return false;
+    }
+
+    memcpy(out, p, (size_t)len);
+    out[len] = '\0';
+    return true;
+}
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
@@ -0,0 +1,42 @@
+#ifndef NAC_BYTEBUF_H
+#define NAC_BYTEBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} ByteBuf;
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} ByteReader;
+
+void bytebuf_init(ByteBuf *buf);
+void bytebuf_free(ByteBuf *buf);
+void bytebuf_put(ByteBuf *buf, const void *data, size_t len);
+void bytebuf_put_u8(ByteBuf *buf, unsigned char v);
+void bytebuf_put_u64(ByteBuf *buf, uint64_t v);
+void bytebuf_put_varint(ByteBuf *buf, uint64_t v);
+void bytebuf_put_int(ByteBuf *buf, int64_t v);
+void bytebuf_put_double(ByteBuf *buf, double v);
+void bytebuf_put_str(ByteBuf *buf, const char *s);
+
+void reader_init(ByteReader *r, const void *data, size_t len);
+const void *reader_take(ByteReader *r, size_t len);
+unsigned char reader_u8(ByteReader *r);
+uint64_t reader_u64(ByteReader *r);
+uint64_t reader_varint(ByteReader *r);
+int64_t reader_int(ByteReader *r);
+double reader_double(ByteReader *r);
+bool reader_str(ByteReader *r, char *out, size_t out_size);
+
+uint64_t hash_bytes(const void *data, size_t len);
+
+#endif
@@ -6,9 +6,25 @@
 #include "../core/interpreter.h"
 
 void report_error(const char *msg) {
-    fprintf(stderr, "Error (Line %d, Column %d): %s\n", current_token.line, current_token.col, msg);
-    error_occurred = true;
-    error_count++;
+    if (!nac_ctx) {
+        fprintf(stderr, "Error: %s\n", msg);
+        return;
+    }
+
+    // At run time the lexer may be a statement ahead, or unused when the
+    // program came from the cache, so errors point at the node being run.
+    int line = nac_ctx->current_token.line;
+    int col = nac_ctx->current_token.col;
+    if (nac_ctx->parse_depth == 0 && nac_ctx->exec_line > 0) {
+        line = nac_ctx->exec_line;
+        col = nac_ctx->exec_col;
+    }
+
+    fprintf(stderr, "Error (Line %d, Column %d): %s\n", line, col, msg);
+    snprintf(nac_ctx->last_error, sizeof(nac_ctx->last_error), "Line %d, Column %d: %s",
+             line, col, msg);
+    nac_ctx->error_occurred = true;
+    nac_ctx->error_count++;
 }
 
 void error_and_exit(const char *msg) {
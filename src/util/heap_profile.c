@@ -0,0 +1,383 @@
+#include "heap_profile.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "../core/interpreter.h"
+
+#define HEAP_STACK_MAX 4096
+
+// Values are allocated on pool workers and tasks as well, so the tables
+// below are shared under one lock. Windows builds run everything on one
+// thread.
+#ifndef _WIN32
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+#define PROFILE_LOCK() pthread_mutex_lock(&profile_lock)
+#define PROFILE_UNLOCK() pthread_mutex_unlock(&profile_lock)
+#else
+#define PROFILE_LOCK() ((void)0)
+#define PROFILE_UNLOCK() ((void)0)
+#endif
+
+typedef struct {
+    char *stack;
+    unsigned long hash;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t total_bytes;
+    size_t alloc_count;
+    size_t free_count;
+} HeapSite;
+
+typedef struct {
+    void *ptr;
+    size_t size;
+    int site;
+} HeapBlock;
+
+bool heap_profile_active = false;
+
+static char *report_path = NULL;
+
+static HeapSite *sites = NULL;
+static int site_count = 0;
+static int site_capacity = 0;
+static int *site_index = NULL;
+static int site_index_capacity = 0;
+
+static HeapBlock *blocks = NULL;
+static size_t block_count = 0;
+static size_t block_capacity = 0;
+
+static size_t live_total = 0;
+static size_t peak_total = 0;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+#ifdef SIGUSR1
+static void on_dump_signal(int sig) {
+    (void)sig;
+    dump_requested = 1;
+}
+#endif
+
+static unsigned long hash_string(const char *s) {
+    unsigned long h = 1469598103UL;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619UL;
+    }
+    return h;
+}
+
+static size_t hash_pointer(const void *ptr, size_t capacity) {
+    uintptr_t p = (uintptr_t)ptr;
+    p ^= p >> 17;
+    p *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    p ^= p >> 29;
+    return (size_t)p & (capacity - 1);
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *bslash = strrchr(path, '\\');
+    if (bslash && (!slash || bslash > slash)) {
+        slash = bslash;
+    }
+    return slash ? slash + 1 : path;
+}
+
+// Folded stack for the allocation site: script;fn1;fn2;script:line
+static void build_site_stack(char *buf, size_t size) {
+    if (!nac_ctx) {
+        snprintf(buf, size, "<runtime>");
+        return;
+    }
+
+    const char *script = base_name(nac_ctx->script_name ? nac_ctx->script_name : "<script>");
+    size_t len = (size_t)snprintf(buf, size, "%s", script);
+
+    for (int i = 0; i < nac_ctx->call_depth && len < size; i++) {
+        const char *name = nac_ctx->call_stack_names[i] ? nac_ctx->call_stack_names[i] : "?";
+        len += (size_t)snprintf(buf + len, size - len, ";%s", name);
+    }
+
+    if (len < size) {
+        snprintf(buf + len, size - len, ";%s:%d", script, nac_ctx->exec_line);
+    }
+}
+
+static void grow_site_index(void) {
+    int new_capacity = (site_index_capacity == 0) ? 256 : site_index_capacity * 2;
+    int *new_index = (int*)malloc(sizeof(int) * new_capacity);
+    for (int i = 0; i < new_capacity; i++) {
+        new_index[i] = -1;
+    }
+
+    for (int i = 0; i < site_count; i++) {
+        int slot = (int)(sites[i].hash & (unsigned long)(new_capacity - 1));
+        while (new_index[slot] >= 0) {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+        new_index[slot] = i;
+    }
+
+    free(site_index);
+    site_index = new_index;
+    site_index_capacity = new_capacity;
+}
+
+static int find_site(const char *stack) {
+    unsigned long h = hash_string(stack);
+
+    if (site_count * 2 >= site_index_capacity) {
+        grow_site_index();
+    }
+
+    int slot = (int)(h & (unsigned long)(site_index_capacity - 1));
+    while (site_index[slot] >= 0) {
+        HeapSite *site = &sites[site_index[slot]];
+        if (site->hash == h && strcmp(site->stack, stack) == 0) {
+            return site_index[slot];
+        }
+        slot = (slot + 1) & (site_index_capacity - 1);
+    }
+
+    if (site_count >= site_capacity) {
+        site_capacity = (site_capacity == 0) ? 64 : site_capacity * 2;
+        sites = (HeapSite*)realloc(sites, sizeof(HeapSite) * site_capacity);
+    }
+
+    HeapSite *site = &sites[site_count];
+    memset(site, 0, sizeof(HeapSite));
+    site->hash = h;
+    size_t len = strlen(stack);
+    site->stack = (char*)malloc(len + 1);
+    memcpy(site->stack, stack, len + 1);
+
+    site_index[slot] = site_count;
+    return site_count++;
+}
+
+static void grow_blocks(void) {
+    size_t old_capacity = block_capacity;
+    HeapBlock *old_blocks = blocks;
+
+    block_capacity = (old_capacity == 0) ? 1024 : old_capacity * 2;
+    blocks = (HeapBlock*)calloc(block_capacity, sizeof(HeapBlock));
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!old_blocks[i].ptr) continue;
+        size_t slot = hash_pointer(old_blocks[i].ptr, block_capacity);
+        while (blocks[slot].ptr) {
+            slot = (slot + 1) & (block_capacity - 1);
+        }
+        blocks[slot] = old_blocks[i];
+    }
+
+    free(old_blocks);
+}
+
+void heap_profile_track(void *ptr, size_t size) {
+    if (!heap_profile_active || !ptr) {
+        return;
+    }
+
+    // The site comes from this thread's context, so it is built unlocked.
+    char stack[HEAP_STACK_MAX];
+    build_site_stack(stack, sizeof(stack));
+
+    PROFILE_LOCK();
+    if (!heap_profile_active) {
+        PROFILE_UNLOCK();
+        return;
+    }
+    if ((block_count + 1) * 4 >= block_capacity * 3) {
+        grow_blocks();
+    }
+
+    int site_id = find_site(stack);
+    HeapSite *site = &sites[site_id];
+    site->alloc_count++;
+    site->total_bytes += size;
+    site->live_bytes += size;
+    if (site->live_bytes > site->peak_bytes) {
+        site->peak_bytes = site->live_bytes;
+    }
+
+    live_total += size;
+    if (live_total > peak_total) {
+        peak_total = live_total;
+    }
+
+    size_t slot = hash_pointer(ptr, block_capacity);
+    while (blocks[slot].ptr && blocks[slot].ptr != ptr) {
+        slot = (slot + 1) & (block_capacity - 1);
+    }
+    if (!blocks[slot].ptr) {
+        block_count++;
+    }
+    blocks[slot].ptr = ptr;
+    blocks[slot].size = size;
+    blocks[slot].site = site_id;
+    PROFILE_UNLOCK();
+}
+
+void heap_profile_untrack(void *ptr) {
+    if (!heap_profile_active || !ptr) {
+        return;
+    }
+
+    PROFILE_LOCK();
+    if (!heap_profile_active || block_capacity == 0) {
+        PROFILE_UNLOCK();
+        return;
+    }
+    size_t slot = hash_pointer(ptr, block_capacity);
+    while (blocks[slot].ptr && blocks[slot].ptr != ptr) {
+        slot = (slot + 1) & (block_capacity - 1);
+    }
+    if (!blocks[slot].ptr) {
+        // Allocated before profiling started or outside the tracked paths.
+        PROFILE_UNLOCK();
+        return;
+    }
+
+    HeapSite *site = &sites[blocks[slot].site];
+    site->live_bytes -= blocks[slot].size;
+    site->free_count++;
+    live_total -= blocks[slot].size;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones.
+    size_t hole = slot;
+    size_t next = (hole + 1) & (block_capacity - 1);
+    while (blocks[next].ptr) {
+        size_t home = hash_pointer(blocks[next].ptr, block_capacity);
+        if (((next - home) & (block_capacity - 1)) >= ((next - hole) & (block_capacity - 1))) {
+            blocks[hole] = blocks[next];
+            hole = next;
+        }
+        next = (next + 1) & (block_capacity - 1);
+    }
+    blocks[hole].ptr = NULL;
+    block_count--;
+    PROFILE_UNLOCK();
+}
+
+void heap_profile_start(const char *path) {
+    if (heap_profile_active) {
+        return;
+    }
+
+    const char *target = (path && path[0]) ? path : HEAP_PROFILE_DEFAULT_PATH;
+    size_t len = strlen(target);
+    report_path = (char*)malloc(len + 1);
+    memcpy(report_path, target, len + 1);
+
+    heap_profile_active = true;
+
+#ifdef SIGUSR1
+    signal(SIGUSR1, on_dump_signal);
+#endif
+}
+
+static int compare_sites_by_live(const void *a, const void *b) {
+    const HeapSite *sa = (const HeapSite*)a;
+    const HeapSite *sb = (const HeapSite*)b;
+    if (sa->live_bytes != sb->live_bytes) {
+        return (sa->live_bytes < sb->live_bytes) ? 1 : -1;
+    }
+    if (sa->peak_bytes != sb->peak_bytes) {
+        return (sa->peak_bytes < sb->peak_bytes) ? 1 : -1;
+    }
+    return strcmp(sa->stack, sb->stack);
+}
+
+void heap_profile_write_report(void) {
+    if (!heap_profile_active) {
+        return;
+    }
+
+    // Site stacks are only freed by heap_profile_stop(), so a copy of the
+    // table can be written out without holding the lock.
+    PROFILE_LOCK();
+    int count = site_count;
+    size_t live = live_total;
+    size_t peak = peak_total;
+    HeapSite *sorted = (HeapSite*)malloc(sizeof(HeapSite) * (count > 0 ? count : 1));
+    memcpy(sorted, sites, sizeof(HeapSite) * count);
+    PROFILE_UNLOCK();
+    qsort(sorted, count, sizeof(HeapSite), compare_sites_by_live);
+
+    // Folded stacks (flamegraph.pl / inferno / speedscope): "frame;frame;leaf live_bytes"
+    FILE *folded = fopen(report_path, "w");
+    if (!folded) {
+        fprintf(stderr, "Heap profile: cannot write %s\n", report_path);
+        free(sorted);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (sorted[i].live_bytes > 0) {
+            fprintf(folded, "%s %zu\n", sorted[i].stack, sorted[i].live_bytes);
+        }
+    }
+    fclose(folded);
+
+    char table_path[1024];
+    snprintf(table_path, sizeof(table_path), "%s.txt", report_path);
+    FILE *table = fopen(table_path, "w");
+    if (table) {
+        fprintf(table, "# live %zu bytes, peak %zu bytes, %d sites\n", live, peak, count);
+        fprintf(table, "live_bytes\tpeak_bytes\tallocs\tfrees\ttotal_bytes\tsite\n");
+        for (int i = 0; i < count; i++) {
+            fprintf(table, "%zu\t%zu\t%zu\t%zu\t%zu\t%s\n",
+                    sorted[i].live_bytes, sorted[i].peak_bytes, sorted[i].alloc_count,
+                    sorted[i].free_count, sorted[i].total_bytes, sorted[i].stack);
+        }
+        fclose(table);
+    }
+
+    free(sorted);
+    fprintf(stderr, "Heap profile written to %s (live %zu bytes, peak %zu bytes)\n",
+            report_path, live, peak);
+}
+
+void heap_profile_poll(void) {
+    if (dump_requested) {
+        dump_requested = 0;
+        heap_profile_write_report();
+    }
+}
+
+void heap_profile_stop(void) {
+    if (!heap_profile_active) {
+        return;
+    }
+
+    heap_profile_write_report();
+    PROFILE_LOCK();
+    heap_profile_active = false;
+
+    for (int i = 0; i < site_count; i++) {
+        free(sites[i].stack);
+    }
+    free(sites);
+    free(site_index);
+    free(blocks);
+    free(report_path);
+
+    sites = NULL;
+    site_index = NULL;
+    blocks = NULL;
+    report_path = NULL;
+    site_count = site_capacity = site_index_capacity = 0;
+    block_count = block_capacity = 0;
+    live_total = peak_total = 0;
+    PROFILE_UNLOCK();
+}
@@ -0,0 +1,19 @@
+#ifndef NAC_HEAP_PROFILE_H
+#define NAC_HEAP_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HEAP_PROFILE_DEFAULT_PATH "nac-heap.folded"
+
+extern bool heap_profile_active;
+
+void heap_profile_start(const char *path);
+void heap_profile_stop(void);
+void heap_profile_poll(void);
+void heap_profile_write_report(void);
+
+void heap_profile_track(void *ptr, size_t size);
+void heap_profile_untrack(void *ptr);
+
+#endif
@@ -0,0 +1,210 @@
+#include "memory.h"
+
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "../core/interpreter.h"
+#include "heap_profile.h"
+
+typedef union {
+    struct {
+        size_t size;
+        MemCategory category;
+    } info;
+    max_align_t align;
+} MemHeader;
+
+// Shared by every interpreter context in the process, hence atomic.
+static atomic_size_t used[MEM_CATEGORY_COUNT];
+static atomic_size_t used_total = 0;
+static atomic_size_t peak_total = 0;
+static size_t limit_bytes = 0;
+static _Thread_local MemCategory value_category = MEM_VALUE;
+
+static const char *category_names[MEM_CATEGORY_COUNT] = {
+    "values", "ast", "tokens", "modules"
+};
+
+static int is_profiled(MemCategory category) {
+    return category == MEM_VALUE || category == MEM_MODULE;
+}
+
+// Crossing the quota halts the running script, which stops executing and
+// unwinds; an embedding host sees a failed call. Values are refused from
+// then on, so nothing the script does while unwinding grows the heap. The
+// AST and tokens are only charged: they grow with the source, not with what
+// the script does, and the parser has no way to back out.
+static bool reserve(size_t size, bool refusable) {
+    if (limit_bytes == 0) return true;
+
+    bool halted = nac_ctx && nac_ctx->halted;
+    size_t in_use = atomic_load_explicit(&used_total, memory_order_relaxed);
+    if (!halted && in_use + size > limit_bytes) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Memory limit exceeded: %zu bytes requested, %zu of %zu bytes in use",
+                 size, in_use, limit_bytes);
+        report_error(msg);
+        if (nac_ctx) {
+            nac_ctx->halted = true;
+        }
+        halted = true;
+    }
+    return !halted || !refusable;
+}
+
+bool memory_fits(size_t size) {
+    return reserve(size, true);
+}
+
+static void charge(MemCategory category, size_t size) {
+    atomic_fetch_add_explicit(&used[category], size, memory_order_relaxed);
+    size_t total = atomic_fetch_add_explicit(&used_total, size, memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&peak_total, memory_order_relaxed);
+    while (total > peak &&
+           !atomic_compare_exchange_weak_explicit(&peak_total, &peak, total,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void release(MemCategory category, size_t size) {
+    atomic_fetch_sub_explicit(&used[category], size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&used_total, size, memory_order_relaxed);
+}
+
+static void *finish_alloc(MemHeader *header, MemCategory category, size_t size) {
+    if (!header) {
+        error_and_exit("Out of memory");
+    }
+
+    header->info.size = size;
+    header->info.category = category;
+    charge(category, size);
+
+    void *ptr = header + 1;
+    if (is_profiled(category)) {
+        heap_profile_track(ptr, size);
+    }
+    return ptr;
+}
+
+void *nac_alloc(MemCategory category, size_t size) {
+    if (!reserve(size, is_profiled(category))) return NULL;
+    return finish_alloc((MemHeader*)malloc(sizeof(MemHeader) + size), category, size);
+}
+
+void *nac_calloc(MemCategory category, size_t count, size_t size) {
+    size_t total = count * size;
+    if (size != 0 && total / size != count) {
+        error_and_exit("Out of memory");
+    }
+
+    if (!reserve(total, is_profiled(category))) return NULL;
+    return finish_alloc((MemHeader*)calloc(1, sizeof(MemHeader) + total), category, total);
+}
+
+// For the interpreter's own bookkeeping, such as call frames and variable
+// slots, which callers cannot do without: charged, but never refused.
+void *nac_calloc_always(MemCategory category, size_t size) {
+    reserve(size, false);
+    return finish_alloc((MemHeader*)calloc(1, sizeof(MemHeader) + size), category, size);
+}
+
+void *nac_realloc(MemCategory category, void *ptr, size_t size) {
+    if (!ptr) {
+        return nac_alloc(category, size);
+    }
+
+    MemHeader *header = (MemHeader*)ptr - 1;
+    MemCategory owner = header->info.category;
+    size_t old_size = header->info.size;
+
+    // On refusal the old block stays valid, as with realloc().
+    if (size > old_size && !reserve(size - old_size, is_profiled(owner))) {
+        return NULL;
+    }
+
+    if (is_profiled(owner)) {
+        heap_profile_untrack(ptr);
+    }
+    release(owner, old_size);
+
+    MemHeader *grown = (MemHeader*)realloc(header, sizeof(MemHeader) + size);
+    return finish_alloc(grown, owner, size);
+}
+
+void nac_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    MemHeader *header = (MemHeader*)ptr - 1;
+    if (is_profiled(header->info.category)) {
+        heap_profile_untrack(ptr);
+    }
+    release(header->info.category, header->info.size);
+    free(header);
+}
+
+MemCategory memory_set_value_category(MemCategory category) {
+    MemCategory previous = value_category;
+    value_category = category;
+    return previous;
+}
+
+MemCategory memory_value_category(void) {
+    return value_category;
+}
+
+void memory_set_limit(size_t bytes) {
+    limit_bytes = bytes;
+}
+
+size_t memory_limit(void) {
+    return limit_bytes;
+}
+
+size_t memory_used(MemCategory category) {
+    return atomic_load_explicit(&used[category], memory_order_relaxed);
+}
+
+size_t memory_used_total(void) {
+    return atomic_load_explicit(&used_total, memory_order_relaxed);
+}
+
+size_t memory_peak(void) {
+    return atomic_load_explicit(&peak_total, memory_order_relaxed);
+}
+
+const char *memory_category_name(MemCategory category) {
+    return category_names[category];
+}
+
+int memory_parse_size(const char *text, size_t *out) {
+    char *end = NULL;
+    double amount = strtod(text, &end);
+    if (end == text || amount < 0) {
+        return 0;
+    }
+
+    double scale = 1;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': scale = 1024.0; end++; break;
+        case 'M': scale = 1024.0 * 1024.0; end++; break;
+        case 'G': scale = 1024.0 * 1024.0 * 1024.0; end++; break;
+        default: break;
+    }
+    if (toupper((unsigned char)*end) == 'B') {
+        end++;
+    }
+    if (*end != '\0') {
+        return 0;
+    }
+
+    *out = (size_t)(amount * scale);
+    return 1;
+}
@@ -0,0 +1,33 @@
+#ifndef NAC_MEMORY_H
+#define NAC_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    MEM_VALUE,
+    MEM_AST,
+    MEM_TOKEN,
+    MEM_MODULE,
+    MEM_CATEGORY_COUNT
+} MemCategory;
+
+void *nac_alloc(MemCategory category, size_t size);
+void *nac_calloc(MemCategory category, size_t count, size_t size);
+void *nac_realloc(MemCategory category, void *ptr, size_t size);
+void *nac_calloc_always(MemCategory category, size_t size);
+void nac_free(void *ptr);
+
+MemCategory memory_set_value_category(MemCategory category);
+MemCategory memory_value_category(void);
+
+void memory_set_limit(size_t bytes);
+bool memory_fits(size_t size);
+size_t memory_limit(void);
+size_t memory_used(MemCategory category);
+size_t memory_used_total(void);
+size_t memory_peak(void);
+const char *memory_category_name(MemCategory category);
+int memory_parse_size(const char *text, size_t *out);
+
+#endif
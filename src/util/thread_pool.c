@@ -0,0 +1,450 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "ws_deque.h"
+#endif
+
+#define POOL_STACK_SIZE (8u << 20)
+
+static int configured_threads = 0;
+static _Thread_local int current_worker = -1;
+
+#ifdef _WIN32
+
+void thread_pool_configure(int threads) {
+    configured_threads = threads;
+}
+
+int thread_pool_size(void) {
+    return 1;
+}
+
+bool thread_pool_in_worker(void) {
+    return current_worker >= 0;
+}
+
+void thread_pool_run(PoolTask task, void *arg) {
+    current_worker = 0;
+    task(0, arg);
+    current_worker = -1;
+}
+
+void thread_pool_submit(PoolWork *work) {
+    work->run(work);
+}
+
+bool thread_pool_help(void) {
+    return false;
+}
+
+void thread_pool_wait_for(atomic_int *state, int value) {
+    while (atomic_load(state) != value) {}
+}
+
+void thread_pool_notify(void) {
+}
+
+void thread_pool_add_blocked(int workers) {
+    (void)workers;
+}
+
+bool thread_pool_stalled(void) {
+    return true;
+}
+
+void thread_pool_shutdown(void) {
+}
+
+void thread_pool_after_fork(void) {
+}
+
+#else
+
+// Threads start on first use. Submitted work goes to the submitting
+// worker's deque, or to a shared injection queue from other threads; idle
+// workers steal. A broadcast job (thread_pool_run) is one call of the task
+// on every worker, and the caller blocks until all return.
+//
+// A worker parked on a channel keeps its thread. When that leaves queued
+// work with nobody to run it, a spare worker is started; spares run queued
+// work only, never broadcast jobs, and stay until shutdown.
+static pthread_t *threads = NULL;
+static WsDeque *deques = NULL;
+static int deque_count = 0;
+static int thread_count = 0;
+static atomic_int worker_count = 0;
+static atomic_int first_spare = THREAD_POOL_MAX_THREADS;
+static atomic_bool started = false;
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static PoolTask job_task = NULL;
+static void *job_arg = NULL;
+static atomic_ulong job_generation = 0;
+static unsigned long start_generation = 0;
+static int job_pending = 0;
+static bool stopping = false;
+
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static PoolWork *inject_head = NULL;
+static PoolWork *inject_tail = NULL;
+static atomic_int queued = 0;
+static atomic_int idle = 0;
+static atomic_int blocked_workers = 0;
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int waiters = 0;
+static int parked_joiners = 0;
+static unsigned long notifications = 0;
+
+void thread_pool_configure(int threads) {
+    configured_threads = threads;
+}
+
+int thread_pool_size(void) {
+    int n = configured_threads;
+    if (n <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = (cpus > 0) ? (int)cpus : 1;
+    }
+    return (n > THREAD_POOL_MAX_THREADS) ? THREAD_POOL_MAX_THREADS : n;
+}
+
+bool thread_pool_in_worker(void) {
+    return current_worker >= 0;
+}
+
+static PoolWork *take_injected(void) {
+    pthread_mutex_lock(&inject_lock);
+    PoolWork *work = inject_head;
+    if (work) {
+        inject_head = work->next;
+        if (!inject_head) inject_tail = NULL;
+    }
+    pthread_mutex_unlock(&inject_lock);
+    return work;
+}
+
+static PoolWork *take_work(void) {
+    if (atomic_load(&queued) <= 0) return NULL;
+
+    PoolWork *work = NULL;
+    if (current_worker >= 0) {
+        work = (PoolWork*)ws_deque_pop(&deques[current_worker]);
+    }
+    if (!work) {
+        work = take_injected();
+    }
+    int first = (current_worker >= 0) ? current_worker + 1 : 0;
+    int workers = atomic_load(&worker_count);
+    for (int i = 0; !work && i < workers; i++) {
+        int victim = (first + i) % workers;
+        if (victim != current_worker) {
+            work = (PoolWork*)ws_deque_steal(&deques[victim]);
+        }
+    }
+
+    if (work) {
+        atomic_fetch_sub(&queued, 1);
+    }
+    return work;
+}
+
+static void *worker_main(void *p) {
+    current_worker = (int)(size_t)p;
+    bool spare = current_worker >= atomic_load(&first_spare);
+
+    pthread_mutex_lock(&lock);
+    unsigned long seen = start_generation;
+    pthread_mutex_unlock(&lock);
+
+    for (;;) {
+        if (!spare && atomic_load(&job_generation) != seen) {
+            pthread_mutex_lock(&lock);
+            seen = atomic_load(&job_generation);
+            PoolTask task = job_task;
+            void *arg = job_arg;
+            pthread_mutex_unlock(&lock);
+
+            task(current_worker, arg);
+
+            pthread_mutex_lock(&lock);
+            if (--job_pending == 0) {
+                pthread_cond_signal(&job_done);
+            }
+            pthread_mutex_unlock(&lock);
+            continue;
+        }
+
+        PoolWork *work = take_work();
+        if (work) {
+            work->run(work);
+            continue;
+        }
+
+        pthread_mutex_lock(&lock);
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        atomic_fetch_add(&idle, 1);
+        if (atomic_load(&queued) <= 0 && (spare || atomic_load(&job_generation) == seen)) {
+            pthread_cond_wait(&job_ready, &lock);
+        }
+        atomic_fetch_sub(&idle, 1);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+static void start_threads(void) {
+    pthread_mutex_lock(&start_lock);
+    if (atomic_load(&started)) {
+        pthread_mutex_unlock(&start_lock);
+        return;
+    }
+
+    int n = thread_pool_size();
+    threads = (pthread_t*)malloc(sizeof(pthread_t) * THREAD_POOL_MAX_THREADS);
+    deques = (WsDeque*)malloc(sizeof(WsDeque) * THREAD_POOL_MAX_THREADS);
+    for (int i = 0; i < n; i++) {
+        ws_deque_init(&deques[i]);
+    }
+    deque_count = n;
+    start_generation = atomic_load(&job_generation);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, POOL_STACK_SIZE);
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&threads[thread_count], &attr, worker_main, (void*)(size_t)i) != 0) {
+            fprintf(stderr, "Cannot start worker thread %d\n", i);
+            break;
+        }
+        thread_count++;
+    }
+    pthread_attr_destroy(&attr);
+
+    atomic_store(&first_spare, thread_count);
+    atomic_store(&worker_count, thread_count);
+    atomic_store(&started, true);
+    pthread_mutex_unlock(&start_lock);
+}
+
+static void add_spare(void) {
+    pthread_mutex_lock(&start_lock);
+    int index = atomic_load(&worker_count);
+    if (index < THREAD_POOL_MAX_THREADS && atomic_load(&queued) > 0 && atomic_load(&idle) == 0) {
+        if (index == deque_count) {
+            ws_deque_init(&deques[index]);
+            deque_count++;
+        }
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, POOL_STACK_SIZE);
+        if (pthread_create(&threads[index], &attr, worker_main, (void*)(size_t)index) == 0) {
+            atomic_store(&worker_count, index + 1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&start_lock);
+}
+
+void thread_pool_run(PoolTask task, void *arg) {
+    if (!atomic_load(&started)) {
+        start_threads();
+    }
+
+    pthread_mutex_lock(&run_lock);
+    if (thread_count == 0) {
+        current_worker = 0;
+        task(0, arg);
+        current_worker = -1;
+        pthread_mutex_unlock(&run_lock);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    job_task = task;
+    job_arg = arg;
+    job_pending = thread_count;
+    atomic_fetch_add(&job_generation, 1);
+    pthread_cond_broadcast(&job_ready);
+    while (job_pending > 0) {
+        pthread_cond_wait(&job_done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&run_lock);
+}
+
+void thread_pool_submit(PoolWork *work) {
+    if (!atomic_load(&started)) {
+        start_threads();
+    }
+    if (thread_count == 0) {
+        work->run(work);
+        return;
+    }
+
+    atomic_fetch_add(&queued, 1);
+    if (current_worker >= 0) {
+        ws_deque_push(&deques[current_worker], work);
+    } else {
+        work->next = NULL;
+        pthread_mutex_lock(&inject_lock);
+        if (inject_tail) {
+            inject_tail->next = work;
+        } else {
+            inject_head = work;
+        }
+        inject_tail = work;
+        pthread_mutex_unlock(&inject_lock);
+    }
+
+    if (atomic_load(&idle) > 0) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_signal(&job_ready);
+        pthread_mutex_unlock(&lock);
+    } else if (atomic_load(&blocked_workers) >= atomic_load(&worker_count)) {
+        add_spare();
+    }
+}
+
+// Runs one queued item on the calling thread, if there is one.
+bool thread_pool_help(void) {
+    if (!atomic_load(&started)) return false;
+
+    PoolWork *work = take_work();
+    if (!work) return false;
+    work->run(work);
+    return true;
+}
+
+// Helps with queued work until *state reaches value, then sleeps until a
+// thread_pool_notify() when there is nothing left to help with.
+void thread_pool_wait_for(atomic_int *state, int value) {
+    while (atomic_load(state) != value) {
+        if (thread_pool_help()) continue;
+
+        pthread_mutex_lock(&done_lock);
+        atomic_fetch_add(&waiters, 1);
+        if (atomic_load(state) != value && atomic_load(&queued) <= 0) {
+            // thread_pool_notify() unblocks parked workers itself, so a
+            // woken worker never counts as blocked.
+            unsigned long seen = notifications;
+            bool worker = current_worker >= 0;
+            if (worker) {
+                parked_joiners++;
+                thread_pool_add_blocked(1);
+            }
+            pthread_cond_wait(&done_cond, &done_lock);
+            if (worker && notifications == seen) {
+                parked_joiners--;
+                thread_pool_add_blocked(-1);
+            }
+        }
+        atomic_fetch_sub(&waiters, 1);
+        pthread_mutex_unlock(&done_lock);
+    }
+}
+
+void thread_pool_notify(void) {
+    if (atomic_load(&waiters) > 0) {
+        pthread_mutex_lock(&done_lock);
+        notifications++;
+        thread_pool_add_blocked(-parked_joiners);
+        parked_joiners = 0;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+}
+
+// Counts workers parked on something other than the queue, such as a
+// channel. Whoever wakes them takes them off again.
+void thread_pool_add_blocked(int workers) {
+    atomic_fetch_add(&blocked_workers, workers);
+    if (workers > 0 && atomic_load(&queued) > 0 && atomic_load(&idle) == 0) {
+        add_spare();
+    }
+}
+
+// True when nothing is queued and every worker is idle or parked, so no
+// work in the pool can make progress.
+bool thread_pool_stalled(void) {
+    return atomic_load(&queued) <= 0 &&
+           atomic_load(&idle) + atomic_load(&blocked_workers) >= atomic_load(&worker_count);
+}
+
+// Queued work that never started is dropped; its owner frees it.
+void thread_pool_shutdown(void) {
+    if (!atomic_load(&started)) return;
+
+    pthread_mutex_lock(&run_lock);
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&lock);
+
+    int workers = atomic_load(&worker_count);
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < deque_count; i++) {
+        ws_deque_free(&deques[i]);
+    }
+    free(threads);
+    free(deques);
+    threads = NULL;
+    deques = NULL;
+    thread_count = 0;
+    atomic_store(&worker_count, 0);
+    atomic_store(&first_spare, THREAD_POOL_MAX_THREADS);
+    deque_count = 0;
+    inject_head = inject_tail = NULL;
+    atomic_store(&queued, 0);
+    stopping = false;
+    atomic_store(&started, false);
+    pthread_mutex_unlock(&run_lock);
+}
+
+// A forked child has only the thread that forked, and any pool lock may have
+// been held by a worker at that moment. The child runs all work inline; the
+// parent's threads, queues and deques are abandoned, not freed.
+void thread_pool_after_fork(void) {
+    pthread_mutex_init(&start_lock, NULL);
+    pthread_mutex_init(&run_lock, NULL);
+    pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&inject_lock, NULL);
+    pthread_mutex_init(&done_lock, NULL);
+    pthread_cond_init(&job_ready, NULL);
+    pthread_cond_init(&job_done, NULL);
+    pthread_cond_init(&done_cond, NULL);
+
+    threads = NULL;
+    deques = NULL;
+    thread_count = 0;
+    atomic_store(&worker_count, 0);
+    deque_count = 0;
+    job_pending = 0;
+    inject_head = inject_tail = NULL;
+    atomic_store(&queued, 0);
+    atomic_store(&idle, 0);
+    atomic_store(&blocked_workers, 0);
+    parked_joiners = 0;
+    atomic_store(&waiters, 0);
+    current_worker = -1;
+    configured_threads = 1;
+    atomic_store(&started, true);
+}
+
+#endif
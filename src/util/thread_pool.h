@@ -0,0 +1,30 @@
+#ifndef NAC_THREAD_POOL_H
+#define NAC_THREAD_POOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define THREAD_POOL_MAX_THREADS 256
+
+typedef void (*PoolTask)(int worker, void *arg);
+
+// A unit of queued work; embed it in the task it runs.
+typedef struct PoolWork {
+    void (*run)(struct PoolWork *work);
+    struct PoolWork *next;
+} PoolWork;
+
+void thread_pool_configure(int threads);
+int thread_pool_size(void);
+bool thread_pool_in_worker(void);
+void thread_pool_run(PoolTask task, void *arg);
+void thread_pool_submit(PoolWork *work);
+bool thread_pool_help(void);
+void thread_pool_wait_for(atomic_int *state, int value);
+void thread_pool_notify(void);
+void thread_pool_add_blocked(int workers);
+bool thread_pool_stalled(void);
+void thread_pool_shutdown(void);
+void thread_pool_after_fork(void);
+
+#endif
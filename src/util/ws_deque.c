@@ -0,0 +1,100 @@
+#include "ws_deque.h"
+
+#include <stdlib.h>
+
+#define DEQUE_INITIAL_SIZE 64
+
+typedef struct DequeBuffer {
+    long size;
+    struct DequeBuffer *older;  // kept until ws_deque_free: thieves may still read it
+    _Atomic(void *) items[];
+} DequeBuffer;
+
+static DequeBuffer *buffer_new(long size, DequeBuffer *older) {
+    DequeBuffer *buf = (DequeBuffer*)malloc(sizeof(DequeBuffer) + sizeof(void*) * size);
+    buf->size = size;
+    buf->older = older;
+    return buf;
+}
+
+static void *buffer_get(DequeBuffer *buf, long i) {
+    return atomic_load_explicit(&buf->items[i & (buf->size - 1)], memory_order_relaxed);
+}
+
+static void buffer_put(DequeBuffer *buf, long i, void *item) {
+    atomic_store_explicit(&buf->items[i & (buf->size - 1)], item, memory_order_relaxed);
+}
+
+void ws_deque_init(WsDeque *deque) {
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->buffer, buffer_new(DEQUE_INITIAL_SIZE, NULL));
+}
+
+void ws_deque_free(WsDeque *deque) {
+    DequeBuffer *buf = atomic_load(&deque->buffer);
+    while (buf) {
+        DequeBuffer *older = buf->older;
+        free(buf);
+        buf = older;
+    }
+    atomic_store(&deque->buffer, NULL);
+}
+
+void ws_deque_push(WsDeque *deque, void *item) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeBuffer *buf = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+
+    if (b - t > buf->size - 1) {
+        DequeBuffer *grown = buffer_new(buf->size * 2, buf);
+        for (long i = t; i < b; i++) {
+            buffer_put(grown, i, buffer_get(buf, i));
+        }
+        atomic_store_explicit(&deque->buffer, grown, memory_order_release);
+        buf = grown;
+    }
+
+    buffer_put(buf, b, item);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+void *ws_deque_pop(WsDeque *deque) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeBuffer *buf = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    void *item = buffer_get(buf, b);
+    if (t == b) {
+        // Last item: race any thief for it.
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            item = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+void *ws_deque_steal(WsDeque *deque) {
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    DequeBuffer *buf = atomic_load_explicit(&deque->buffer, memory_order_acquire);
+    void *item = buffer_get(buf, t);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return item;
+}
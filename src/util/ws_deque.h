@@ -0,0 +1,22 @@
+#ifndef NAC_WS_DEQUE_H
+#define NAC_WS_DEQUE_H
+
+#include <stdatomic.h>
+
+struct DequeBuffer;
+
+// Chase-Lev work-stealing deque: the owning thread pushes and pops at the
+// bottom, any other thread steals from the top.
+typedef struct {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(struct DequeBuffer *) buffer;
+} WsDeque;
+
+void ws_deque_init(WsDeque *deque);
+void ws_deque_free(WsDeque *deque);
+void ws_deque_push(WsDeque *deque, void *item);
+void *ws_deque_pop(WsDeque *deque);
+void *ws_deque_steal(WsDeque *deque);
+
+#endif
@@ -0,0 +1,167 @@
+// nac-client: run a script on a warm `nac --serve` daemon.
+//
+// Usage: nac-client [--socket=path] <file.nac> [args...]
+//
+// The daemon runs the script with this process's stdin/stdout/stderr and
+// working directory, and nac-client exits with the script's status. When no
+// daemon is listening it falls back to running `nac` directly.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server/protocol.h"
+
+static int connect_daemon(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int send_request(int fd, const char *payload, size_t len) {
+    RequestHeader header;
+    header.magic = NAC_SERVE_MAGIC;
+    header.payload_len = (uint32_t)len;
+
+    int stdio_fds[3] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(stdio_fds))];
+    memset(control, 0, sizeof(control));
+
+    struct iovec iov = { &header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(stdio_fds));
+    memcpy(CMSG_DATA(c), stdio_fds, sizeof(stdio_fds));
+
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return 0;
+    if ((size_t)n < sizeof(header) && !write_full(fd, (char*)&header + n, sizeof(header) - (size_t)n)) {
+        return 0;
+    }
+
+    return write_full(fd, payload, len);
+}
+
+int main(int argc, char *argv[]) {
+    char default_socket[NAC_SERVE_PATH_MAX];
+    const char *socket_path = getenv("NAC_SOCKET");
+    if (!socket_path || !socket_path[0]) {
+        socket_path = serve_default_socket(default_socket, sizeof(default_socket), false) ? default_socket : "";
+    }
+
+    int first = 1;
+    if (argc > 1 && strncmp(argv[1], "--socket=", 9) == 0) {
+        socket_path = argv[1] + 9;
+        first = 2;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [--socket=path] <file.nac> [args...]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = connect_daemon(socket_path);
+    if (fd < 0) {
+        argv[first - 1] = "nac";
+        execvp("nac", argv + first - 1);
+        fprintf(stderr, "nac-client: no daemon on %s and cannot run nac: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+    // The request hands over this process's descriptors; never to another user.
+    if (!serve_peer_trusted(fd)) {
+        fprintf(stderr, "nac-client: %s is served by another user, refusing to use it\n", socket_path);
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "nac-client: cannot determine working directory\n");
+        return 1;
+    }
+
+    size_t len = strlen(cwd) + 1;
+    for (int i = first; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    if (len > NAC_SERVE_MAX_PAYLOAD) {
+        fprintf(stderr, "nac-client: arguments too long\n");
+        return 1;
+    }
+
+    char *payload = (char*)malloc(len);
+    size_t offset = 0;
+    size_t part = strlen(cwd) + 1;
+    memcpy(payload, cwd, part);
+    offset += part;
+    for (int i = first; i < argc; i++) {
+        part = strlen(argv[i]) + 1;
+        memcpy(payload + offset, argv[i], part);
+        offset += part;
+    }
+
+    if (!send_request(fd, payload, len)) {
+        fprintf(stderr, "nac-client: cannot send request to %s\n", socket_path);
+        free(payload);
+        return 1;
+    }
+    free(payload);
+
+    int32_t status = 1;
+    char *p = (char*)&status;
+    size_t remaining = sizeof(status);
+    while (remaining > 0) {
+        ssize_t n = read(fd, p, remaining);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "nac-client: daemon closed the connection\n");
+            return 1;
+        }
+        p += n;
+        remaining -= (size_t)n;
+    }
+
+    close(fd);
+    return status;
+}